@@ -96,6 +96,8 @@ static void tlb_window_reset(CPUTLBDesc *desc, int64_t ns,
 {
     desc->window_begin_ns = ns;
     desc->window_max_entries = max_entries;
+    desc->window_victim_hits = 0;
+    desc->window_fills = 0;
 }
 
 static void tb_jmp_cache_clear_page(CPUState *cpu, target_ulong page_addr)
@@ -154,6 +156,11 @@ static void tb_flush_jmp_cache(CPUState *cpu, target_ulong addr)
  * is direct mapped, so we want the use rate to be low (or at least not too
  * high), since otherwise we are likely to have a significant amount of
  * conflict misses.
+ *
+ * 4. Let conflict misses seen in the window grow the TLB. When most slow
+ * path lookups are served by the victim TLB, entries are evicting each other,
+ * so the TLB doubles even though its use rate is moderate. It still shrinks
+ * like any other TLB once the use rate drops.
  */
 static void tlb_mmu_resize_locked(CPUTLBDesc *desc, CPUTLBDescFast *fast,
                                   int64_t now)
@@ -164,13 +171,16 @@ static void tlb_mmu_resize_locked(CPUTLBDesc *desc, CPUTLBDescFast *fast,
     int64_t window_len_ms = 100;
     int64_t window_len_ns = window_len_ms * 1000 * 1000;
     bool window_expired = now > desc->window_begin_ns + window_len_ns;
+    bool conflicts;
 
     if (desc->n_used_entries > desc->window_max_entries) {
         desc->window_max_entries = desc->n_used_entries;
     }
     rate = desc->window_max_entries * 100 / old_size;
+    conflicts = desc->window_victim_hits > CPU_VTLB_SIZE &&
+                desc->window_victim_hits > desc->window_fills;
 
-    if (rate > 70) {
+    if (rate > 70 || (rate > 30 && conflicts)) {
         new_size = MIN(old_size << 1, 1 << CPU_TLB_DYN_MAX_BITS);
     } else if (rate < 30 && window_expired) {
         size_t ceil = pow2ceil(desc->window_max_entries);
@@ -246,6 +256,7 @@ static void tlb_flush_one_mmuidx_locked(CPUArchState *env, int mmu_idx,
     CPUTLBDesc *desc = &env_tlb(env)->d[mmu_idx];
     CPUTLBDescFast *fast = &env_tlb(env)->f[mmu_idx];
 
+    qatomic_set(&desc->flush_count, desc->flush_count + 1);
     tlb_mmu_resize_locked(desc, fast, now);
     tlb_mmu_flush_locked(desc, fast);
 }
@@ -310,13 +321,22 @@ void tlb_destroy(CPUState *cpu)
  * where all queued work will be finished before execution starts
  * again.
  */
+/*
+ * A parked (powered off) vCPU cannot be holding TLB entries it will use
+ * again without a reset, so leave it asleep rather than queueing work.
+ */
+static inline bool flush_all_skip(CPUState *src, CPUState *dst)
+{
+    return dst == src || qatomic_read(&dst->parked);
+}
+
 static void flush_all_helper(CPUState *src, run_on_cpu_func fn,
                              run_on_cpu_data d)
 {
     CPUState *cpu;
 
     CPU_FOREACH(cpu) {
-        if (cpu != src) {
+        if (!flush_all_skip(src, cpu)) {
             async_run_on_cpu(cpu, fn, d);
         }
     }
@@ -339,6 +359,49 @@ void tlb_flush_counts(size_t *pfull, size_t *ppart, size_t *pelide)
     *pelide = elide;
 }
 
+void tlb_dump_stats(GString *buf)
+{
+    CPUState *cpu;
+    size_t range = 0, range_full = 0;
+    int i;
+
+    CPU_FOREACH(cpu) {
+        CPUArchState *env = cpu->env_ptr;
+
+        range += qatomic_read(&env_tlb(env)->c.range_flush_count);
+        range_full += qatomic_read(&env_tlb(env)->c.range_full_flush_count);
+    }
+    g_string_append_printf(buf, "TLB range flushes   %zu "
+                           "(%zu done as full flushes)\n",
+                           range + range_full, range_full);
+
+    g_string_append_printf(buf, "\nTLB statistics:\n");
+    g_string_append_printf(buf, "cpu idx  entries     used     victim"
+                           "      fills  flushes\n");
+    CPU_FOREACH(cpu) {
+        CPUArchState *env = cpu->env_ptr;
+
+        for (i = 0; i < NB_MMU_MODES; i++) {
+            CPUTLBDesc *desc = &env_tlb(env)->d[i];
+            size_t victim = qatomic_read(&desc->victim_hit_count);
+            size_t fills = qatomic_read(&desc->fill_count);
+            size_t flushes = qatomic_read(&desc->flush_count);
+            size_t misses = victim + fills;
+
+            if (!misses && !flushes) {
+                continue;
+            }
+            g_string_append_printf(buf, "%3d %3d %8zu %8zu %10zu %10zu "
+                                   "%8zu  (%zu%% victim)\n",
+                                   cpu->cpu_index, i,
+                                   tlb_n_entries(&env_tlb(env)->f[i]),
+                                   qatomic_read(&desc->n_used_entries),
+                                   victim, fills, flushes,
+                                   misses ? victim * 100 / misses : 0);
+        }
+    }
+}
+
 static void tlb_flush_by_mmuidx_async_work(CPUState *cpu, run_on_cpu_data data)
 {
     CPUArchState *env = cpu->env_ptr;
@@ -643,7 +706,7 @@ void tlb_flush_page_by_mmuidx_all_cpus(CPUState *src_cpu, target_ulong addr,
 
         /* Allocate a separate data block for each destination cpu.  */
         CPU_FOREACH(dst_cpu) {
-            if (dst_cpu != src_cpu) {
+            if (!flush_all_skip(src_cpu, dst_cpu)) {
                 TLBFlushPageByMMUIdxData *d
                     = g_new(TLBFlushPageByMMUIdxData, 1);
 
@@ -687,7 +750,7 @@ void tlb_flush_page_by_mmuidx_all_cpus_synced(CPUState *src_cpu,
 
         /* Allocate a separate data block for each destination cpu.  */
         CPU_FOREACH(dst_cpu) {
-            if (dst_cpu != src_cpu) {
+            if (!flush_all_skip(src_cpu, dst_cpu)) {
                 d = g_new(TLBFlushPageByMMUIdxData, 1);
                 d->addr = addr;
                 d->idxmap = idxmap;
@@ -709,13 +772,42 @@ void tlb_flush_page_all_cpus_synced(CPUState *src, target_ulong addr)
     tlb_flush_page_by_mmuidx_all_cpus_synced(src, addr, ALL_MMUIDX_BITS);
 }
 
+/*
+ * Ranges larger than this are flushed with the whole mmu_idx: unmapping
+ * that much address space retires most of the working set anyway, and a
+ * full flush lets the resize policy run.
+ */
+#define TLB_FLUSH_RANGE_MAX (TARGET_PAGE_SIZE << 18)
+
+/* Called with tlb_c.lock held */
+static bool tlb_flush_entry_range_locked(CPUTLBEntry *tlb_entry,
+                                         target_ulong addr, target_ulong len,
+                                         target_ulong mask)
+{
+    target_ulong cmp[3] = {
+        tlb_entry->addr_read, tlb_addr_write(tlb_entry), tlb_entry->addr_code
+    };
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(cmp); i++) {
+        if (!(cmp[i] & TLB_INVALID_MASK) &&
+            ((cmp[i] - addr) & mask & TARGET_PAGE_MASK) < len) {
+            memset(tlb_entry, -1, sizeof(*tlb_entry));
+            return true;
+        }
+    }
+    return false;
+}
+
 static void tlb_flush_range_locked(CPUArchState *env, int midx,
                                    target_ulong addr, target_ulong len,
                                    unsigned bits)
 {
     CPUTLBDesc *d = &env_tlb(env)->d[midx];
     CPUTLBDescFast *f = &env_tlb(env)->f[midx];
+    CPUTLBCommon *c = &env_tlb(env)->c;
     target_ulong mask = MAKE_64BIT_MASK(0, bits);
+    size_t n_entries = tlb_n_entries(f);
 
     /*
      * If @bits is smaller than the tlb size, there may be multiple entries
@@ -723,15 +815,13 @@ static void tlb_flush_range_locked(CPUArchState *env, int midx,
      * the same TLB entry.
      * TODO: Perhaps allow bits to be a few bits less than the size.
      * For now, just flush the entire TLB.
-     *
-     * If @len is larger than the tlb size, then it will take longer to
-     * test all of the entries in the TLB than it will to flush it all.
      */
-    if (mask < f->mask || len > f->mask) {
+    if (mask < f->mask || len > TLB_FLUSH_RANGE_MAX) {
         tlb_debug("forcing full flush midx %d ("
                   TARGET_FMT_lx "/" TARGET_FMT_lx "+" TARGET_FMT_lx ")\n",
                   midx, addr, mask, len);
         tlb_flush_one_mmuidx_locked(env, midx, get_clock_realtime());
+        qatomic_set(&c->range_full_flush_count, c->range_full_flush_count + 1);
         return;
     }
 
@@ -745,6 +835,28 @@ static void tlb_flush_range_locked(CPUArchState *env, int midx,
                   TARGET_FMT_lx "/" TARGET_FMT_lx ")\n",
                   midx, d->large_page_addr, d->large_page_mask);
         tlb_flush_one_mmuidx_locked(env, midx, get_clock_realtime());
+        qatomic_set(&c->range_full_flush_count, c->range_full_flush_count + 1);
+        return;
+    }
+
+    qatomic_set(&c->range_flush_count, c->range_flush_count + 1);
+
+    /*
+     * If the range covers more pages than the TLB has entries, one pass
+     * over the table, testing each entry against the range, is cheaper
+     * than probing the table once per page.
+     */
+    if ((len >> TARGET_PAGE_BITS) > n_entries) {
+        size_t i;
+
+        for (i = 0; i < n_entries; i++) {
+            if (tlb_flush_entry_range_locked(&f->table[i], addr, len, mask)) {
+                tlb_n_used_entries_dec(env, midx);
+            }
+        }
+        for (i = 0; i < CPU_VTLB_SIZE; i++) {
+            tlb_flush_entry_range_locked(&d->vtable[i], addr, len, mask);
+        }
         return;
     }
 
@@ -878,7 +990,7 @@ void tlb_flush_range_by_mmuidx_all_cpus(CPUState *src_cpu,
 
     /* Allocate a separate data block for each destination cpu.  */
     CPU_FOREACH(dst_cpu) {
-        if (dst_cpu != src_cpu) {
+        if (!flush_all_skip(src_cpu, dst_cpu)) {
             TLBFlushRangeData *p = g_memdup(&d, sizeof(d));
             async_run_on_cpu(dst_cpu,
                              tlb_flush_range_by_mmuidx_async_1,
@@ -928,7 +1040,7 @@ void tlb_flush_range_by_mmuidx_all_cpus_synced(CPUState *src_cpu,
 
     /* Allocate a separate data block for each destination cpu.  */
     CPU_FOREACH(dst_cpu) {
-        if (dst_cpu != src_cpu) {
+        if (!flush_all_skip(src_cpu, dst_cpu)) {
             p = g_memdup(&d, sizeof(d));
             async_run_on_cpu(dst_cpu, tlb_flush_range_by_mmuidx_async_1,
                              RUN_ON_CPU_HOST_PTR(p));
@@ -1271,6 +1383,8 @@ void tlb_set_page_with_attrs(CPUState *cpu, target_ulong vaddr,
 
     copy_tlb_helper_locked(te, &tn);
     tlb_n_used_entries_inc(env, mmu_idx);
+    desc->window_fills++;
+    qatomic_set(&desc->fill_count, desc->fill_count + 1);
     qemu_spin_unlock(&tlb->c.lock);
 }
 
@@ -1475,6 +1589,10 @@ static bool victim_tlb_hit(CPUArchState *env, size_t mmu_idx, size_t index,
         if (cmp == page) {
             /* Found entry in victim tlb, swap tlb and iotlb.  */
             CPUTLBEntry tmptlb, *tlb = &env_tlb(env)->f[mmu_idx].table[index];
+            CPUTLBDesc *desc = &env_tlb(env)->d[mmu_idx];
+
+            desc->window_victim_hits++;
+            qatomic_set(&desc->victim_hit_count, desc->victim_hit_count + 1);
 
             qemu_spin_lock(&env_tlb(env)->c.lock);
             copy_tlb_helper_locked(&tmptlb, tlb);
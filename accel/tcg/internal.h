@@ -18,4 +18,11 @@ G_NORETURN void cpu_io_recompile(CPUState *cpu, uintptr_t retaddr);
 void page_init(void);
 void tb_htable_init(void);
 
+/* tb-hot.c */
+extern uint32_t tcg_hot_threshold;
+void tb_hot_init(uint32_t threshold);
+bool tb_hot_lookup(tb_page_addr_t phys_pc, target_ulong pc,
+                   target_ulong cs_base, uint32_t flags, uint32_t cflags);
+void tb_superblock_dump_info(GString *buf);
+
 #endif /* ACCEL_TCG_INTERNAL_H */
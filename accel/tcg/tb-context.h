@@ -35,6 +35,9 @@ struct TBContext {
     /* statistics */
     unsigned tb_flush_count;
     unsigned tb_phys_invalidate_count;
+    /* code buffer full: regions evicted and full flushes */
+    unsigned tb_evict_count;
+    unsigned tb_full_flush_count;
 };
 
 extern TBContext tb_ctx;
@@ -0,0 +1,171 @@
+/*
+ * Tiered translation: superblock formation for hot TBs
+ *
+ * With -accel tcg,hot-threshold=N every TB counts its executions.  When
+ * a TB reaches the threshold it is marked hot and invalidated; its next
+ * translation is a superblock that follows direct branches within the
+ * page (see translator_extend_superblock()), so that the merged blocks
+ * share register allocation and liveness instead of being chained.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/thread.h"
+#include "exec/exec-all.h"
+#include "exec/helper-proto.h"
+#include "tcg/tcg.h"
+#include "tb-hash.h"
+#include "internal.h"
+#include "trace.h"
+
+uint32_t tcg_hot_threshold;
+
+typedef struct TBHotKey {
+    tb_page_addr_t phys_pc;
+    target_ulong pc;
+    target_ulong cs_base;
+    uint32_t flags;
+    uint32_t cflags;
+} TBHotKey;
+
+static QemuMutex tb_hot_lock;
+static GHashTable *tb_hot_set;
+static size_t tb_hot_marked;
+
+static guint tb_hot_key_hash(gconstpointer p)
+{
+    const TBHotKey *k = p;
+
+    return tb_hash_func(k->phys_pc, k->pc, k->flags, k->cflags, 0);
+}
+
+static gboolean tb_hot_key_equal(gconstpointer a, gconstpointer b)
+{
+    const TBHotKey *x = a, *y = b;
+
+    return x->phys_pc == y->phys_pc && x->pc == y->pc &&
+           x->cs_base == y->cs_base && x->flags == y->flags &&
+           x->cflags == y->cflags;
+}
+
+void tb_hot_init(uint32_t threshold)
+{
+    qemu_mutex_init(&tb_hot_lock);
+    tb_hot_set = g_hash_table_new_full(tb_hot_key_hash, tb_hot_key_equal,
+                                       g_free, NULL);
+    tcg_hot_threshold = threshold;
+}
+
+bool tb_hot_lookup(tb_page_addr_t phys_pc, target_ulong pc,
+                   target_ulong cs_base, uint32_t flags, uint32_t cflags)
+{
+    TBHotKey key = {
+        .phys_pc = phys_pc,
+        .pc = pc,
+        .cs_base = cs_base,
+        .flags = flags,
+        .cflags = cflags,
+    };
+    bool hot;
+
+    if (!tcg_hot_threshold || phys_pc == -1) {
+        return false;
+    }
+
+    qemu_mutex_lock(&tb_hot_lock);
+    hot = g_hash_table_contains(tb_hot_set, &key);
+    qemu_mutex_unlock(&tb_hot_lock);
+    return hot;
+}
+
+/* Called from the TB itself when its execution count hits the threshold */
+void HELPER(tb_hot)(void *ptr)
+{
+    TranslationBlock *tb = ptr;
+    TBHotKey *key = g_new(TBHotKey, 1);
+
+    key->phys_pc = tb->page_addr[0] + (tb->pc & ~TARGET_PAGE_MASK);
+    key->pc = tb->pc;
+    key->cs_base = tb->cs_base;
+    key->flags = tb->flags;
+    key->cflags = tb_cflags(tb) & ~CF_INVALID;
+
+    qemu_mutex_lock(&tb_hot_lock);
+    if (g_hash_table_add(tb_hot_set, key)) {
+        tb_hot_marked++;
+    }
+    qemu_mutex_unlock(&tb_hot_lock);
+    trace_tb_hot(tb->pc, tb->exec_count);
+
+    /*
+     * The code stays valid until the next flush, so this TB can finish
+     * running; only new lookups miss and retranslate it as a superblock.
+     */
+    mmap_lock();
+    tb_phys_invalidate(tb, -1);
+    mmap_unlock();
+}
+
+static gboolean tb_superblock_collect(gpointer key, gpointer value,
+                                      gpointer data)
+{
+    const TranslationBlock *tb = value;
+
+    if (tb->sb_blocks && !(tb_cflags(tb) & CF_INVALID)) {
+        g_ptr_array_add(data, (gpointer)tb);
+    }
+    return false;
+}
+
+static gint tb_superblock_cmp(gconstpointer a, gconstpointer b)
+{
+    const TranslationBlock *x = *(TranslationBlock * const *)a;
+    const TranslationBlock *y = *(TranslationBlock * const *)b;
+    uint64_t ex = (uint64_t)x->exec_count * (x->sb_blocks - 1);
+    uint64_t ey = (uint64_t)y->exec_count * (y->sb_blocks - 1);
+
+    return ex < ey ? 1 : ex > ey ? -1 : 0;
+}
+
+void tb_superblock_dump_info(GString *buf)
+{
+    g_autoptr(GPtrArray) sbs = NULL;
+    uint64_t saved = 0;
+    size_t marked;
+    guint i;
+
+    if (!tcg_hot_threshold) {
+        return;
+    }
+
+    qemu_mutex_lock(&tb_hot_lock);
+    marked = tb_hot_marked;
+    qemu_mutex_unlock(&tb_hot_lock);
+
+    sbs = g_ptr_array_new();
+    tcg_tb_foreach(tb_superblock_collect, sbs);
+    g_ptr_array_sort(sbs, tb_superblock_cmp);
+    for (i = 0; i < sbs->len; i++) {
+        const TranslationBlock *tb = g_ptr_array_index(sbs, i);
+
+        saved += (uint64_t)tb->exec_count * (tb->sb_blocks - 1);
+    }
+
+    g_string_append_printf(buf, "\nSuperblocks (hot threshold %u):\n",
+                           tcg_hot_threshold);
+    g_string_append_printf(buf, "hot TBs             %zu\n", marked);
+    g_string_append_printf(buf, "live superblocks    %u\n", sbs->len);
+    g_string_append_printf(buf, "block exits saved   %" PRIu64 "\n", saved);
+    for (i = 0; i < MIN(sbs->len, 16); i++) {
+        const TranslationBlock *tb = g_ptr_array_index(sbs, i);
+
+        g_string_append_printf(buf, "  pc 0x" TARGET_FMT_lx
+                               " blocks %u insns %u execs %u"
+                               " exits saved %" PRIu64 "\n",
+                               tb->pc, tb->sb_blocks, tb->icount,
+                               tb->exec_count,
+                               (uint64_t)tb->exec_count *
+                               (tb->sb_blocks - 1));
+    }
+}
@@ -108,6 +108,7 @@ static void rr_wait_io_event(void)
 
     while (all_cpu_threads_idle()) {
         rr_stop_kick_timer();
+        idle_warp_kick();
         qemu_cond_wait_iothread(first_cpu->halt_cond);
     }
 
@@ -43,6 +43,9 @@ struct TCGState {
     bool mttcg_enabled;
     int splitwx_enabled;
     unsigned long tb_size;
+    uint32_t hot_threshold;
+    bool idle_warp;
+    bool tb_evict;
 };
 typedef struct TCGState TCGState;
 
@@ -123,7 +126,8 @@ static int tcg_init_machine(MachineState *ms)
 
     page_init();
     tb_htable_init();
-    tcg_init(s->tb_size * MiB, s->splitwx_enabled, max_cpus);
+    tcg_init(s->tb_size * MiB, s->splitwx_enabled, max_cpus, s->tb_evict);
+    tb_hot_init(s->hot_threshold);
 
 #if defined(CONFIG_SOFTMMU)
     /*
@@ -131,6 +135,16 @@ static int tcg_init_machine(MachineState *ms)
      * initialize the prologue now.
      */
     tcg_prologue_init(tcg_ctx);
+
+    if (s->idle_warp) {
+        Error *err = NULL;
+
+        idle_warp_init(&err);
+        if (err) {
+            error_report_err(err);
+            return -1;
+        }
+    }
 #endif
 
     return 0;
@@ -195,6 +209,54 @@ static void tcg_set_tb_size(Object *obj, Visitor *v,
     s->tb_size = value;
 }
 
+#ifndef CONFIG_USER_ONLY
+static bool tcg_get_idle_warp(Object *obj, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    return s->idle_warp;
+}
+
+static void tcg_set_idle_warp(Object *obj, bool value, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    s->idle_warp = value;
+}
+
+static bool tcg_get_tb_evict(Object *obj, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    return s->tb_evict;
+}
+
+static void tcg_set_tb_evict(Object *obj, bool value, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    s->tb_evict = value;
+}
+#endif
+
+static void tcg_get_hot_threshold(Object *obj, Visitor *v,
+                                  const char *name, void *opaque,
+                                  Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    visit_type_uint32(v, name, &s->hot_threshold, errp);
+}
+
+static void tcg_set_hot_threshold(Object *obj, Visitor *v,
+                                  const char *name, void *opaque,
+                                  Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    visit_type_uint32(v, name, &s->hot_threshold, errp);
+}
+
 static bool tcg_get_splitwx(Object *obj, Error **errp)
 {
     TCGState *s = TCG_STATE(obj);
@@ -224,6 +286,26 @@ static void tcg_accel_class_init(ObjectClass *oc, void *data)
     object_class_property_set_description(oc, "tb-size",
         "TCG translation block cache size");
 
+    object_class_property_add(oc, "hot-threshold", "uint32",
+        tcg_get_hot_threshold, tcg_set_hot_threshold,
+        NULL, NULL);
+    object_class_property_set_description(oc, "hot-threshold",
+        "Retranslate TBs executed this many times as superblocks "
+        "(0 disables)");
+
+#ifndef CONFIG_USER_ONLY
+    object_class_property_add_bool(oc, "idle-warp",
+        tcg_get_idle_warp, tcg_set_idle_warp);
+    object_class_property_set_description(oc, "idle-warp",
+        "Skip the virtual clock to the next timer when all vCPUs are idle");
+
+    object_class_property_add_bool(oc, "tb-evict",
+        tcg_get_tb_evict, tcg_set_tb_evict);
+    object_class_property_set_description(oc, "tb-evict",
+        "Free the least recently used part of the translation cache "
+        "instead of flushing all of it when full");
+#endif
+
     object_class_property_add_bool(oc, "split-wx",
         tcg_get_splitwx, tcg_set_splitwx);
     object_class_property_set_description(oc, "split-wx",
@@ -1245,6 +1245,88 @@ void tb_phys_invalidate(TranslationBlock *tb, tb_page_addr_t page_addr)
     }
 }
 
+/*
+ * Detach @tb from everything that can reach it, so that the code buffer
+ * region holding it can be reused.  TBs that never made it into the hash
+ * table (see tb_link_page) can still be jumped to, so unlink those too.
+ */
+static void tb_evict_one(TranslationBlock *tb)
+{
+    /*
+     * Invalidation takes the TB out of the jump caches and both jump
+     * lists and resets the jumps into it.  Once CF_INVALID is set no jump
+     * can be chained to or from it again, so a TB that was invalidated
+     * earlier has nothing left to tear down.
+     */
+    if (!(tb_cflags(tb) & CF_INVALID)) {
+        tb_phys_invalidate(tb, -1);
+    }
+}
+
+/*
+ * The code buffer is full: with -accel tcg,tb-evict=on free the least
+ * recently used region for this thread's context, otherwise flush all
+ * translations.  The TBs in the vCPUs' jump caches are the ones that ran
+ * last, so their regions count as recently used.
+ */
+static void do_tb_evict(CPUState *cpu, run_on_cpu_data tb_flush_count)
+{
+    CPUState *other;
+    bool evicted = false;
+    int i;
+
+    mmap_lock();
+    if (tb_ctx.tb_flush_count != tb_flush_count.host_int) {
+        /* A flush already gave every context an empty region */
+        mmap_unlock();
+        return;
+    }
+
+    CPU_FOREACH(other) {
+        for (i = 0; i < TB_JMP_CACHE_SIZE; i++) {
+            TranslationBlock *tb = qatomic_read(&other->tb_jmp_cache[i]);
+
+            if (tb) {
+                tcg_region_touch(tb->tc.ptr);
+            }
+        }
+    }
+
+    qemu_thread_jit_write();
+    evicted = tcg_region_evict(tcg_ctx, tb_evict_one);
+    qemu_thread_jit_execute();
+    mmap_unlock();
+
+    if (evicted) {
+        /*
+         * One-shot TBs (see tb_gen_code) are in no region tree, so
+         * tb_evict_one never saw them, but cpu_exec may have put them in
+         * a jump cache.  Their code may be in the region just freed.
+         */
+        CPU_FOREACH(other) {
+            cpu_tb_jmp_cache_clear(other);
+        }
+        qatomic_set(&tb_ctx.tb_evict_count, tb_ctx.tb_evict_count + 1);
+        qemu_plugin_flush_cb();
+    } else {
+        qatomic_set(&tb_ctx.tb_full_flush_count,
+                    tb_ctx.tb_full_flush_count + 1);
+        do_tb_flush(cpu, tb_flush_count);
+    }
+}
+
+static void tb_evict(CPUState *cpu)
+{
+    unsigned tb_flush_count = qatomic_mb_read(&tb_ctx.tb_flush_count);
+
+    if (cpu_in_exclusive_context(cpu)) {
+        do_tb_evict(cpu, RUN_ON_CPU_HOST_INT(tb_flush_count));
+    } else {
+        async_safe_run_on_cpu(cpu, do_tb_evict,
+                              RUN_ON_CPU_HOST_INT(tb_flush_count));
+    }
+}
+
 #ifdef CONFIG_SOFTMMU
 /* call with @p->lock held */
 static void build_page_bitmap(PageDesc *p)
@@ -1412,8 +1494,8 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
  buffer_overflow:
     tb = tcg_tb_alloc(tcg_ctx);
     if (unlikely(!tb)) {
-        /* flush must be done */
-        tb_flush(cpu);
+        /* eviction or flush must be done */
+        tb_evict(cpu);
         mmap_unlock();
         /* Make the execution loop process the flush as soon as possible.  */
         cpu->exception_index = EXCP_INTERRUPT;
@@ -1427,6 +1509,8 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     tb->flags = flags;
     tb->cflags = cflags;
     tb->trace_vcpu_dstate = *cpu->trace_dstate;
+    tb->exec_count = 0;
+    tb->sb_blocks = tb_hot_lookup(phys_pc, pc, cs_base, flags, cflags);
     tcg_ctx->tb_cflags = cflags;
  tb_overflow:
 
@@ -2116,12 +2200,19 @@ void dump_exec_info(GString *buf)
                            qatomic_read(&tb_ctx.tb_flush_count));
     g_string_append_printf(buf, "TB invalidate count %u\n",
                            qatomic_read(&tb_ctx.tb_phys_invalidate_count));
+    g_string_append_printf(buf, "code buffer full    %u evictions, "
+                           "%u flushes\n",
+                           qatomic_read(&tb_ctx.tb_evict_count),
+                           qatomic_read(&tb_ctx.tb_full_flush_count));
 
     tlb_flush_counts(&flush_full, &flush_part, &flush_elide);
     g_string_append_printf(buf, "TLB full flushes    %zu\n", flush_full);
     g_string_append_printf(buf, "TLB partial flushes %zu\n", flush_part);
     g_string_append_printf(buf, "TLB elided flushes  %zu\n", flush_elide);
+    tlb_dump_stats(buf);
     tcg_dump_info(buf);
+    tb_superblock_dump_info(buf);
+    idle_warp_dump_info(buf);
 }
 
 #else /* CONFIG_USER_ONLY */
@@ -13,10 +13,12 @@
 #include "tcg/tcg-op.h"
 #include "exec/exec-all.h"
 #include "exec/gen-icount.h"
+#include "exec/helper-gen.h"
 #include "exec/log.h"
 #include "exec/translator.h"
 #include "exec/plugin-gen.h"
 #include "sysemu/replay.h"
+#include "internal.h"
 
 /* Pairs with tcg_clear_temp_count.
    To be called by #TranslatorOps.{translate_insn,tb_stop} if
@@ -42,6 +44,38 @@ bool translator_use_goto_tb(DisasContextBase *db, target_ulong dest)
     return ((db->pc_first ^ dest) & TARGET_PAGE_MASK) == 0;
 }
 
+bool translator_extend_superblock(DisasContextBase *db, target_ulong dest)
+{
+    if (!db->superblock || db->sb_blocks >= TB_SUPERBLOCK_MAX_BLOCKS ||
+        db->num_insns >= db->max_insns || tcg_op_buf_full()) {
+        return false;
+    }
+    if (dest < db->pc_next || ((db->pc_first ^ dest) & TARGET_PAGE_MASK)) {
+        return false;
+    }
+    db->sb_blocks++;
+    return true;
+}
+
+/* Count executions of the TB and mark it hot at the threshold */
+static void translator_gen_exec_count(DisasContextBase *db)
+{
+    TCGv_ptr tb = tcg_constant_ptr(db->tb);
+    TCGv_i32 count = tcg_temp_new_i32();
+
+    tcg_gen_ld_i32(count, tb, offsetof(TranslationBlock, exec_count));
+    tcg_gen_addi_i32(count, count, 1);
+    tcg_gen_st_i32(count, tb, offsetof(TranslationBlock, exec_count));
+    if (!db->superblock) {
+        TCGLabel *cold = gen_new_label();
+
+        tcg_gen_brcondi_i32(TCG_COND_NE, count, tcg_hot_threshold, cold);
+        gen_helper_tb_hot(tb);
+        gen_set_label(cold);
+    }
+    tcg_temp_free_i32(count);
+}
+
 static inline void translator_page_protect(DisasContextBase *dcbase,
                                            target_ulong pc)
 {
@@ -65,6 +99,8 @@ void translator_loop(const TranslatorOps *ops, DisasContextBase *db,
     db->num_insns = 0;
     db->max_insns = max_insns;
     db->singlestep_enabled = cflags & CF_SINGLE_STEP;
+    db->superblock = tb->sb_blocks != 0;
+    db->sb_blocks = 1;
     translator_page_protect(db, db->pc_next);
 
     ops->init_disas_context(db, cpu);
@@ -75,6 +111,10 @@ void translator_loop(const TranslatorOps *ops, DisasContextBase *db,
 
     /* Start translating.  */
     gen_tb_start(db->tb);
+    if (tcg_hot_threshold &&
+        !(cflags & (CF_COUNT_MASK | CF_USE_ICOUNT | CF_SINGLE_STEP))) {
+        translator_gen_exec_count(db);
+    }
     ops->tb_start(db, cpu);
     tcg_debug_assert(db->is_jmp == DISAS_NEXT);  /* no early exit */
 
@@ -135,6 +175,7 @@ void translator_loop(const TranslatorOps *ops, DisasContextBase *db,
     /* The disas_log hook may use these values rather than recompute.  */
     tb->size = db->pc_next - db->pc_first;
     tb->icount = db->num_insns;
+    tb->sb_blocks = db->superblock ? db->sb_blocks : 0;
 
 #ifdef DEBUG_DISAS
     if (qemu_loglevel_mask(CPU_LOG_TB_IN_ASM)
@@ -28,6 +28,7 @@
 #include "qemu/error-report.h"
 #include "qemu/module.h"
 #include "qemu/memalign.h"
+#include "block/thread-pool.h"
 #include "dmg.h"
 
 int (*dmg_uncompress_bz2)(char *next_in, unsigned int avail_in,
@@ -44,6 +45,17 @@ enum {
     DMG_SECTORCOUNTS_MAX = DMG_LENGTHS_MAX / 512,
 };
 
+enum {
+    /* Memory budget for decoded chunks kept in the chunk cache */
+    DMG_CACHE_BYTES = 64 * 1024 * 1024, /* 64 MB */
+    DMG_CACHE_MIN_ENTRIES = 2,
+    DMG_CACHE_MAX_ENTRIES = 64,
+    /* Chunks decompressed on the thread pool at the same time */
+    DMG_MAX_THREADS = 8,
+    /* Compressed chunks decoded ahead of a sequential reader */
+    DMG_READAHEAD_CHUNKS = 4,
+};
+
 enum {
     /* DMG Block Type */
     UDZE = 0, /* Zeroes */
@@ -433,7 +445,7 @@ static int dmg_open(BlockDriverState *bs, QDict *options, int flags,
     uint64_t rsrc_fork_offset, rsrc_fork_length;
     uint64_t plist_xml_offset, plist_xml_length;
     int64_t offset;
-    int ret;
+    int ret, i;
 
     ret = bdrv_apply_auto_read_only(bs, NULL, errp);
     if (ret < 0) {
@@ -524,24 +536,22 @@ static int dmg_open(BlockDriverState *bs, QDict *options, int flags,
         goto fail;
     }
 
-    /* initialize zlib engine */
-    s->compressed_chunk = qemu_try_blockalign(bs->file->bs,
-                                              ds.max_compressed_size + 1);
-    s->uncompressed_chunk = qemu_try_blockalign(bs->file->bs,
-                                                512 * ds.max_sectors_per_chunk);
-    if (s->compressed_chunk == NULL || s->uncompressed_chunk == NULL) {
-        ret = -ENOMEM;
-        goto fail;
+    /* decoded chunk buffers are allocated as the cache fills up */
+    s->chunk_size = 512 * (size_t)ds.max_sectors_per_chunk;
+    s->cache_size = DMG_CACHE_BYTES / s->chunk_size;
+    s->cache_size = MAX(s->cache_size, DMG_CACHE_MIN_ENTRIES);
+    s->cache_size = MIN(s->cache_size, DMG_CACHE_MAX_ENTRIES);
+    s->cache = g_new0(DMGChunkCacheEntry, s->cache_size);
+    for (i = 0; i < s->cache_size; i++) {
+        s->cache[i].chunk = s->n_chunks;
+        qemu_co_queue_init(&s->cache[i].waiters);
     }
-
-    if (inflateInit(&s->zstream) != Z_OK) {
-        ret = -EINVAL;
-        goto fail;
-    }
-
-    s->current_chunk = s->n_chunks;
+    s->cache_stamp = 0;
+    s->nb_threads = 0;
+    s->last_chunk = s->n_chunks;
 
     qemu_co_mutex_init(&s->lock);
+    qemu_co_queue_init(&s->thread_queue);
     return 0;
 
 fail:
@@ -550,8 +560,6 @@ fail:
     g_free(s->lengths);
     g_free(s->sectors);
     g_free(s->sectorcounts);
-    qemu_vfree(s->compressed_chunk);
-    qemu_vfree(s->uncompressed_chunk);
     return ret;
 }
 
@@ -560,17 +568,6 @@ static void dmg_refresh_limits(BlockDriverState *bs, Error **errp)
     bs->bl.request_alignment = BDRV_SECTOR_SIZE; /* No sub-sector I/O */
 }
 
-static inline int is_sector_in_chunk(BDRVDMGState *s,
-                uint32_t chunk_num, uint64_t sector_num)
-{
-    if (chunk_num >= s->n_chunks || s->sectors[chunk_num] > sector_num ||
-            s->sectors[chunk_num] + s->sectorcounts[chunk_num] <= sector_num) {
-        return 0;
-    } else {
-        return -1;
-    }
-}
-
 static inline uint32_t search_chunk(BDRVDMGState *s, uint64_t sector_num)
 {
     /* binary search */
@@ -592,101 +589,373 @@ err:
     return s->n_chunks; /* error */
 }
 
-static inline int dmg_read_chunk(BlockDriverState *bs, uint64_t sector_num)
+static inline bool dmg_is_compressed(uint32_t type)
+{
+    return type == UDZO || type == UDBZ || type == ULFO;
+}
+
+typedef struct DMGDecompressJob {
+    uint32_t type;
+    uint8_t *in;
+    size_t in_len;
+    uint8_t *out;
+    size_t out_len;
+} DMGDecompressJob;
+
+/* Runs on the thread pool; only touches the buffers in the job */
+static int dmg_decompress_worker(void *opaque)
+{
+    DMGDecompressJob *job = opaque;
+    z_stream zstream = {};
+    int ret;
+
+    switch (job->type) {
+    case UDZO: /* zlib compressed */
+        if (inflateInit(&zstream) != Z_OK) {
+            return -EIO;
+        }
+        zstream.next_in = job->in;
+        zstream.avail_in = job->in_len;
+        zstream.next_out = job->out;
+        zstream.avail_out = job->out_len;
+        ret = inflate(&zstream, Z_FINISH);
+        if (ret != Z_STREAM_END || zstream.total_out != job->out_len) {
+            ret = -EIO;
+        } else {
+            ret = 0;
+        }
+        inflateEnd(&zstream);
+        return ret;
+    case UDBZ: /* bzip2 compressed */
+        ret = dmg_uncompress_bz2((char *)job->in, (unsigned int)job->in_len,
+                                 (char *)job->out, (unsigned int)job->out_len);
+        return ret < 0 ? -EIO : 0;
+    case ULFO: /* lzfse compressed */
+        ret = dmg_uncompress_lzfse((char *)job->in, (unsigned int)job->in_len,
+                                   (char *)job->out,
+                                   (unsigned int)job->out_len);
+        return ret < 0 ? -EIO : 0;
+    }
+    g_assert_not_reached();
+}
+
+/*
+ * Read compressed chunk @chunk and decode it into @out. At most
+ * DMG_MAX_THREADS chunks are decompressed at once; independent chunks
+ * are decoded in parallel.
+ */
+static int coroutine_fn dmg_co_decode_chunk(BlockDriverState *bs,
+                                            uint32_t chunk, uint8_t *out)
 {
     BDRVDMGState *s = bs->opaque;
+    ThreadPool *pool = aio_get_thread_pool(bdrv_get_aio_context(bs));
+    DMGDecompressJob job = {
+        .type = s->types[chunk],
+        .in_len = s->lengths[chunk],
+        .out = out,
+        .out_len = 512 * s->sectorcounts[chunk],
+    };
+    int ret;
 
-    if (!is_sector_in_chunk(s, s->current_chunk, sector_num)) {
-        int ret;
-        uint32_t chunk = search_chunk(s, sector_num);
+    if ((job.type == UDBZ && !dmg_uncompress_bz2) ||
+        (job.type == ULFO && !dmg_uncompress_lzfse)) {
+        return -ENOTSUP;
+    }
 
-        if (chunk >= s->n_chunks) {
-            return -1;
+    /* we need to buffer, because only the chunk as whole can be inflated. */
+    job.in = qemu_try_blockalign(bs->file->bs, job.in_len);
+    if (!job.in) {
+        return -ENOMEM;
+    }
+    ret = bdrv_co_pread(bs->file, s->offsets[chunk], job.in_len, job.in, 0);
+    if (ret < 0) {
+        goto out;
+    }
+
+    qemu_co_mutex_lock(&s->lock);
+    while (s->nb_threads >= DMG_MAX_THREADS) {
+        qemu_co_queue_wait(&s->thread_queue, &s->lock);
+    }
+    s->nb_threads++;
+    qemu_co_mutex_unlock(&s->lock);
+
+    ret = thread_pool_submit_co(pool, dmg_decompress_worker, &job);
+
+    qemu_co_mutex_lock(&s->lock);
+    s->nb_threads--;
+    qemu_co_queue_next(&s->thread_queue);
+    qemu_co_mutex_unlock(&s->lock);
+
+out:
+    qemu_vfree(job.in);
+    return ret;
+}
+
+/* Called with s->lock held */
+static DMGChunkCacheEntry *dmg_cache_find(BDRVDMGState *s, uint32_t chunk)
+{
+    int i;
+
+    for (i = 0; i < s->cache_size; i++) {
+        if (s->cache[i].chunk == chunk) {
+            return &s->cache[i];
         }
+    }
+    return NULL;
+}
 
-        s->current_chunk = s->n_chunks;
-        switch (s->types[chunk]) { /* block entry type */
-        case UDZO: { /* zlib compressed */
-            /* we need to buffer, because only the chunk as whole can be
-             * inflated. */
-            ret = bdrv_pread(bs->file, s->offsets[chunk], s->lengths[chunk],
-                             s->compressed_chunk, 0);
-            if (ret < 0) {
-                return -1;
-            }
+/*
+ * Take a slot for @chunk and mark it loading: an unused slot if there is
+ * one, otherwise the least recently used slot nobody is reading from.
+ * Returns NULL if every slot is busy. Called with s->lock held.
+ */
+static DMGChunkCacheEntry *dmg_cache_claim(BDRVDMGState *s, uint32_t chunk)
+{
+    DMGChunkCacheEntry *e = NULL;
+    int i;
 
-            s->zstream.next_in = s->compressed_chunk;
-            s->zstream.avail_in = s->lengths[chunk];
-            s->zstream.next_out = s->uncompressed_chunk;
-            s->zstream.avail_out = 512 * s->sectorcounts[chunk];
-            ret = inflateReset(&s->zstream);
-            if (ret != Z_OK) {
-                return -1;
-            }
-            ret = inflate(&s->zstream, Z_FINISH);
-            if (ret != Z_STREAM_END ||
-                s->zstream.total_out != 512 * s->sectorcounts[chunk]) {
-                return -1;
-            }
-            break; }
-        case UDBZ: /* bzip2 compressed */
-            if (!dmg_uncompress_bz2) {
-                break;
-            }
-            /* we need to buffer, because only the chunk as whole can be
-             * inflated. */
-            ret = bdrv_pread(bs->file, s->offsets[chunk], s->lengths[chunk],
-                             s->compressed_chunk, 0);
-            if (ret < 0) {
-                return -1;
-            }
+    for (i = 0; i < s->cache_size; i++) {
+        DMGChunkCacheEntry *c = &s->cache[i];
 
-            ret = dmg_uncompress_bz2((char *)s->compressed_chunk,
-                                     (unsigned int) s->lengths[chunk],
-                                     (char *)s->uncompressed_chunk,
-                                     (unsigned int)
-                                         (512 * s->sectorcounts[chunk]));
-            if (ret < 0) {
-                return ret;
-            }
+        if (c->loading || c->refs) {
+            continue;
+        }
+        if (c->chunk == s->n_chunks) {
+            e = c;
             break;
-        case ULFO:
-            if (!dmg_uncompress_lzfse) {
-                break;
-            }
-            /* we need to buffer, because only the chunk as whole can be
-             * inflated. */
-            ret = bdrv_pread(bs->file, s->offsets[chunk], s->lengths[chunk],
-                             s->compressed_chunk, 0);
-            if (ret < 0) {
-                return -1;
-            }
+        }
+        if (!e || c->lru_stamp < e->lru_stamp) {
+            e = c;
+        }
+    }
+    if (!e) {
+        return NULL;
+    }
 
-            ret = dmg_uncompress_lzfse((char *)s->compressed_chunk,
-                                       (unsigned int) s->lengths[chunk],
-                                       (char *)s->uncompressed_chunk,
-                                       (unsigned int)
-                                           (512 * s->sectorcounts[chunk]));
-            if (ret < 0) {
-                return ret;
-            }
+    if (!e->data) {
+        e->data = g_try_malloc(s->chunk_size);
+        if (!e->data) {
+            return NULL;
+        }
+    }
+    e->chunk = chunk;
+    e->loading = true;
+    e->ret = 0;
+    e->lru_stamp = ++s->cache_stamp;
+    return e;
+}
+
+/* Decode the chunk of a slot returned by dmg_cache_claim() */
+static void coroutine_fn dmg_cache_fill(BlockDriverState *bs,
+                                        DMGChunkCacheEntry *e)
+{
+    BDRVDMGState *s = bs->opaque;
+    int ret;
+
+    ret = dmg_co_decode_chunk(bs, e->chunk, e->data);
+
+    qemu_co_mutex_lock(&s->lock);
+    e->loading = false;
+    e->ret = ret;
+    if (ret < 0) {
+        /* waiters hold a reference and pick up the error from e->ret */
+        e->chunk = s->n_chunks;
+    }
+    qemu_co_queue_restart_all(&e->waiters);
+    qemu_co_mutex_unlock(&s->lock);
+}
+
+/*
+ * Look up decoded chunk @chunk, decoding it if it is not cached, and
+ * return it referenced in @pe. Returns -EAGAIN if the cache has no slot
+ * to spare, in which case the caller decodes into a buffer of its own.
+ */
+static int coroutine_fn dmg_cache_get(BlockDriverState *bs, uint32_t chunk,
+                                      DMGChunkCacheEntry **pe)
+{
+    BDRVDMGState *s = bs->opaque;
+    DMGChunkCacheEntry *e;
+    int ret;
+
+    qemu_co_mutex_lock(&s->lock);
+    e = dmg_cache_find(s, chunk);
+    if (e) {
+        e->refs++;
+        while (e->loading) {
+            qemu_co_queue_wait(&e->waiters, &s->lock);
+        }
+    } else {
+        e = dmg_cache_claim(s, chunk);
+        if (!e) {
+            qemu_co_mutex_unlock(&s->lock);
+            return -EAGAIN;
+        }
+        e->refs++;
+        qemu_co_mutex_unlock(&s->lock);
+
+        dmg_cache_fill(bs, e);
+        qemu_co_mutex_lock(&s->lock);
+    }
+
+    ret = e->ret;
+    if (ret < 0) {
+        e->refs--;
+    } else {
+        e->lru_stamp = ++s->cache_stamp;
+        *pe = e;
+    }
+    qemu_co_mutex_unlock(&s->lock);
+    return ret;
+}
+
+static void coroutine_fn dmg_cache_put(BDRVDMGState *s, DMGChunkCacheEntry *e)
+{
+    qemu_co_mutex_lock(&s->lock);
+    e->refs--;
+    qemu_co_mutex_unlock(&s->lock);
+}
+
+typedef struct DMGPrefetch {
+    BlockDriverState *bs;
+    DMGChunkCacheEntry *e;
+} DMGPrefetch;
+
+static void coroutine_fn dmg_prefetch_entry(void *opaque)
+{
+    DMGPrefetch *p = opaque;
+    BlockDriverState *bs = p->bs;
+
+    dmg_cache_fill(bs, p->e);
+    g_free(p);
+    bdrv_dec_in_flight(bs);
+}
+
+/*
+ * Start decoding compressed chunk @chunk in the background, unless it is
+ * cached already or it would have to evict a chunk someone is reading.
+ * Returns false once the cache has no slot left.
+ */
+static bool coroutine_fn dmg_prefetch(BlockDriverState *bs, uint32_t chunk)
+{
+    BDRVDMGState *s = bs->opaque;
+    DMGChunkCacheEntry *e;
+    DMGPrefetch *p;
+
+    if (!dmg_is_compressed(s->types[chunk])) {
+        return true;
+    }
+
+    qemu_co_mutex_lock(&s->lock);
+    if (dmg_cache_find(s, chunk)) {
+        qemu_co_mutex_unlock(&s->lock);
+        return true;
+    }
+    e = dmg_cache_claim(s, chunk);
+    qemu_co_mutex_unlock(&s->lock);
+    if (!e) {
+        return false;
+    }
+
+    p = g_new(DMGPrefetch, 1);
+    p->bs = bs;
+    p->e = e;
+    bdrv_inc_in_flight(bs);
+    aio_co_enter(bdrv_get_aio_context(bs),
+                 qemu_coroutine_create(dmg_prefetch_entry, p));
+    return true;
+}
+
+/*
+ * Kick off decoding of the compressed chunks in [@first, @last] that the
+ * request will need after the first one, plus a readahead window past
+ * @last for sequential readers. Leave half the cache for other readers.
+ */
+static void coroutine_fn dmg_prefetch_range(BlockDriverState *bs,
+                                            uint32_t first, uint32_t last)
+{
+    BDRVDMGState *s = bs->opaque;
+    bool sequential = first == s->last_chunk || first == s->last_chunk + 1;
+    uint32_t end = last;
+    int budget = s->cache_size / 2;
+    uint32_t chunk;
+
+    if (sequential) {
+        end = MIN((uint64_t)last + DMG_READAHEAD_CHUNKS, s->n_chunks - 1);
+    }
+    s->last_chunk = last;
+
+    for (chunk = first + 1; chunk <= end && budget > 0; chunk++) {
+        if (!dmg_is_compressed(s->types[chunk])) {
+            continue;
+        }
+        if (!dmg_prefetch(bs, chunk)) {
             break;
-        case UDRW: /* copy */
-            ret = bdrv_pread(bs->file, s->offsets[chunk], s->lengths[chunk],
-                             s->uncompressed_chunk, 0);
+        }
+        budget--;
+    }
+}
+
+/* Copy @bytes of chunk @chunk, starting @offset bytes into it, to @qiov */
+static int coroutine_fn dmg_co_read_chunk(BlockDriverState *bs, uint32_t chunk,
+                                          uint64_t offset, uint64_t bytes,
+                                          QEMUIOVector *qiov,
+                                          size_t qiov_offset)
+{
+    BDRVDMGState *s = bs->opaque;
+    DMGChunkCacheEntry *e;
+    uint8_t *buf;
+    int ret;
+
+    switch (s->types[chunk]) { /* block entry type */
+    case UDZE: /* zeros */
+    case UDIG: /* ignore */
+        qemu_iovec_memset(qiov, qiov_offset, 0, bytes);
+        return 0;
+    case UDRW: { /* copy */
+        /* the stored data may be shorter than the sectors it covers */
+        uint64_t avail = s->lengths[chunk] > offset ?
+                         MIN(s->lengths[chunk] - offset, bytes) : 0;
+
+        if (avail) {
+            ret = bdrv_co_preadv_part(bs->file, s->offsets[chunk] + offset,
+                                      avail, qiov, qiov_offset, 0);
             if (ret < 0) {
-                return -1;
+                return ret;
             }
-            break;
-        case UDZE: /* zeros */
-        case UDIG: /* ignore */
-            /* see dmg_read, it is treated specially. No buffer needs to be
-             * pre-filled, the zeroes can be set directly. */
-            break;
         }
-        s->current_chunk = chunk;
+        if (avail < bytes) {
+            qemu_iovec_memset(qiov, qiov_offset + avail, 0, bytes - avail);
+        }
+        return 0;
     }
-    return 0;
+    case UDZO:
+    case UDBZ:
+    case ULFO:
+        break;
+    default:
+        return -EIO;
+    }
+
+    ret = dmg_cache_get(bs, chunk, &e);
+    if (ret == 0) {
+        qemu_iovec_from_buf(qiov, qiov_offset, e->data + offset, bytes);
+        dmg_cache_put(s, e);
+        return 0;
+    } else if (ret != -EAGAIN) {
+        return ret;
+    }
+
+    /* every cache slot is busy, decode privately */
+    buf = g_try_malloc(512 * s->sectorcounts[chunk]);
+    if (!buf) {
+        return -ENOMEM;
+    }
+    ret = dmg_co_decode_chunk(bs, chunk, buf);
+    if (ret == 0) {
+        qemu_iovec_from_buf(qiov, qiov_offset, buf + offset, bytes);
+    }
+    g_free(buf);
+    return ret;
 }
 
 static int coroutine_fn
@@ -695,54 +964,149 @@ dmg_co_preadv(BlockDriverState *bs, int64_t offset, int64_t bytes,
 {
     BDRVDMGState *s = bs->opaque;
     uint64_t sector_num = offset >> BDRV_SECTOR_BITS;
-    int nb_sectors = bytes >> BDRV_SECTOR_BITS;
-    int ret, i;
+    uint64_t end_sector = (offset + bytes) >> BDRV_SECTOR_BITS;
+    size_t qiov_offset = 0;
+    uint32_t first, last;
+    int ret;
 
     assert(QEMU_IS_ALIGNED(offset, BDRV_SECTOR_SIZE));
     assert(QEMU_IS_ALIGNED(bytes, BDRV_SECTOR_SIZE));
 
-    qemu_co_mutex_lock(&s->lock);
+    if (!bytes) {
+        return 0;
+    }
 
-    for (i = 0; i < nb_sectors; i++) {
-        uint32_t sector_offset_in_chunk;
-        void *data;
+    first = search_chunk(s, sector_num);
+    last = search_chunk(s, end_sector - 1);
+    if (first >= s->n_chunks || last >= s->n_chunks) {
+        return -EIO;
+    }
+    dmg_prefetch_range(bs, first, last);
 
-        if (dmg_read_chunk(bs, sector_num + i) != 0) {
-            ret = -EIO;
-            goto fail;
+    while (sector_num < end_sector) {
+        uint32_t chunk = search_chunk(s, sector_num);
+        uint64_t chunk_end;
+        uint64_t n;
+
+        if (chunk >= s->n_chunks) {
+            return -EIO;
         }
-        /* Special case: current chunk is all zeroes. Do not perform a memcpy as
-         * s->uncompressed_chunk may be too small to cover the large all-zeroes
-         * section. dmg_read_chunk is called to find s->current_chunk */
-        if (s->types[s->current_chunk] == UDZE
-            || s->types[s->current_chunk] == UDIG) { /* all zeroes block entry */
-            qemu_iovec_memset(qiov, i * 512, 0, 512);
-            continue;
+        chunk_end = s->sectors[chunk] + s->sectorcounts[chunk];
+        n = MIN(chunk_end, end_sector) - sector_num;
+
+        ret = dmg_co_read_chunk(bs, chunk,
+                                (sector_num - s->sectors[chunk]) * 512,
+                                n * 512, qiov, qiov_offset);
+        if (ret < 0) {
+            return ret;
         }
-        sector_offset_in_chunk = sector_num + i - s->sectors[s->current_chunk];
-        data = s->uncompressed_chunk + sector_offset_in_chunk * 512;
-        qemu_iovec_from_buf(qiov, i * 512, data, 512);
+        sector_num += n;
+        qiov_offset += n * 512;
     }
 
-    ret = 0;
-fail:
-    qemu_co_mutex_unlock(&s->lock);
-    return ret;
+    return 0;
+}
+
+/* Block status class of a chunk, adjacent chunks of one class are merged */
+static int dmg_chunk_status(BDRVDMGState *s, uint32_t chunk)
+{
+    switch (s->types[chunk]) {
+    case UDZE: /* zeros */
+        return BDRV_BLOCK_ZERO;
+    case UDIG: /* ignore */
+        return 0;
+    default:
+        return BDRV_BLOCK_DATA;
+    }
+}
+
+/*
+ * Report the chunk table: zero and ignored chunks are skipped by image
+ * copies, raw chunks map straight onto the file.
+ */
+static int coroutine_fn dmg_co_block_status(BlockDriverState *bs,
+                                            bool want_zero,
+                                            int64_t offset, int64_t bytes,
+                                            int64_t *pnum, int64_t *map,
+                                            BlockDriverState **file)
+{
+    BDRVDMGState *s = bs->opaque;
+    uint64_t sector_num = offset >> BDRV_SECTOR_BITS;
+    uint64_t end_sector = DIV_ROUND_UP(offset + bytes, BDRV_SECTOR_SIZE);
+    uint64_t chunk_end;
+    uint32_t chunk = search_chunk(s, sector_num);
+    int status;
+
+    assert(QEMU_IS_ALIGNED(offset, BDRV_SECTOR_SIZE));
+
+    if (chunk >= s->n_chunks) {
+        /* not covered by any chunk: unallocated up to the next one */
+        uint32_t lo = 0, hi = s->n_chunks;
+
+        while (lo < hi) {
+            uint32_t mid = lo + (hi - lo) / 2;
+
+            if (s->sectors[mid] <= sector_num) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        chunk_end = lo < s->n_chunks ? s->sectors[lo] : bs->total_sectors;
+        *pnum = (MAX(chunk_end, sector_num + 1) - sector_num) * 512;
+        return 0;
+    }
+
+    chunk_end = s->sectors[chunk] + s->sectorcounts[chunk];
+
+    if (s->types[chunk] == UDRW) {
+        uint64_t in_chunk = (sector_num - s->sectors[chunk]) * 512;
+        uint64_t chunk_bytes = s->sectorcounts[chunk] * 512;
+        uint64_t stored = MIN(s->lengths[chunk], chunk_bytes);
+        uint64_t whole = QEMU_ALIGN_DOWN(stored, BDRV_SECTOR_SIZE);
+
+        if (in_chunk < whole) {
+            *pnum = whole - in_chunk;
+            *map = s->offsets[chunk] + in_chunk;
+            *file = bs->file->bs;
+            return BDRV_BLOCK_DATA | BDRV_BLOCK_OFFSET_VALID;
+        }
+        if (in_chunk < stored) {
+            /* partial last sector, padded with zeroes on read */
+            *pnum = BDRV_SECTOR_SIZE;
+            return BDRV_BLOCK_DATA;
+        }
+        /* sectors past the stored data read as zeroes */
+        *pnum = chunk_bytes - in_chunk;
+        return BDRV_BLOCK_ZERO;
+    }
+
+    status = dmg_chunk_status(s, chunk);
+    while (chunk_end < end_sector && chunk + 1 < s->n_chunks &&
+           s->sectors[chunk + 1] == chunk_end &&
+           s->types[chunk + 1] != UDRW &&
+           dmg_chunk_status(s, chunk + 1) == status) {
+        chunk++;
+        chunk_end = s->sectors[chunk] + s->sectorcounts[chunk];
+    }
+    *pnum = (chunk_end - sector_num) * 512;
+    return status;
 }
 
 static void dmg_close(BlockDriverState *bs)
 {
     BDRVDMGState *s = bs->opaque;
+    int i;
 
     g_free(s->types);
     g_free(s->offsets);
     g_free(s->lengths);
     g_free(s->sectors);
     g_free(s->sectorcounts);
-    qemu_vfree(s->compressed_chunk);
-    qemu_vfree(s->uncompressed_chunk);
-
-    inflateEnd(&s->zstream);
+    for (i = 0; i < s->cache_size; i++) {
+        g_free(s->cache[i].data);
+    }
+    g_free(s->cache);
 }
 
 static BlockDriver bdrv_dmg = {
@@ -753,6 +1117,7 @@ static BlockDriver bdrv_dmg = {
     .bdrv_refresh_limits = dmg_refresh_limits,
     .bdrv_child_perm     = bdrv_default_perms,
     .bdrv_co_preadv = dmg_co_preadv,
+    .bdrv_co_block_status = dmg_co_block_status,
     .bdrv_close     = dmg_close,
     .is_format      = true,
 };
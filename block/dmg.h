@@ -27,9 +27,27 @@
 #define BLOCK_DMG_H
 
 #include "block/block_int.h"
+#include "qemu/coroutine.h"
 #include <zlib.h>
 
+/*
+ * One decoded chunk in the chunk cache. A slot is unused when @chunk is
+ * n_chunks. While @loading is set the data is being read and decompressed
+ * and readers queue on @waiters; @refs pins the slot against eviction while
+ * readers copy out of @data.
+ */
+typedef struct DMGChunkCacheEntry {
+    uint32_t chunk;
+    uint8_t *data;
+    int ret;
+    bool loading;
+    unsigned refs;
+    uint64_t lru_stamp;
+    CoQueue waiters;
+} DMGChunkCacheEntry;
+
 typedef struct BDRVDMGState {
+    /* protects the chunk cache and the decompression thread count */
     CoMutex lock;
     /* each chunk contains a certain number of sectors,
      * offsets[i] is the offset in the .dmg file,
@@ -45,10 +63,20 @@ typedef struct BDRVDMGState {
     uint64_t *lengths;
     uint64_t *sectors;
     uint64_t *sectorcounts;
-    uint32_t current_chunk;
-    uint8_t *compressed_chunk;
-    uint8_t *uncompressed_chunk;
-    z_stream zstream;
+    /* size of the largest decoded chunk */
+    size_t chunk_size;
+
+    /* LRU cache of decoded compressed chunks */
+    DMGChunkCacheEntry *cache;
+    int cache_size;
+    uint64_t cache_stamp;
+
+    /* decompression jobs running on the thread pool */
+    int nb_threads;
+    CoQueue thread_queue;
+
+    /* last chunk read, to detect sequential access for readahead */
+    uint32_t last_chunk;
 } BDRVDMGState;
 
 extern int (*dmg_uncompress_bz2)(char *next_in, unsigned int avail_in,
@@ -923,6 +923,20 @@ SRST
     Show guest Apple DART IOMMUs.
 ERST
 
+    {
+        .name         = "apple-stats",
+        .args_type    = "name:s?",
+        .params       = "[name]",
+        .help         = "show Apple SoC device statistics",
+        .cmd          = hmp_info_apple_stats,
+    },
+
+SRST
+  ``info apple-stats`` [*name*]
+    Show MMIO, interrupt, mailbox, IOMMU and crypto counters of the Apple
+    SoC device models, optionally only of the device *name*.
+ERST
+
     {
         .name       = "stats",
         .args_type  = "target:s,names:s?,provider:s?",
@@ -1,6 +1,10 @@
 #include "qemu/osdep.h"
 #include "qemu/queue.h"
 #include "qemu/timer.h"
+#include "qemu/bitmap.h"
+#include "qemu/cutils.h"
+#include "qapi/error.h"
+#include "qapi/visitor.h"
 #include "exec/address-spaces.h"
 #include "hw/qdev-properties.h"
 #include "migration/vmstate.h"
@@ -13,6 +17,9 @@
 #include "arm-powerctl.h"
 #include "sysemu/reset.h"
 #include "qemu/main-loop.h"
+#ifdef CONFIG_TCG
+#include "hw/core/tcg-cpu-ops.h"
+#endif
 
 #define VMSTATE_A13_CPREG(name) \
         VMSTATE_UINT64(A13_CPREG_VAR_NAME(name), AppleA13State)
@@ -71,6 +78,9 @@
 #define NSEC_PER_MSEC   1000000ull      /* nanoseconds per millisecond */
 #define RTCLOCK_SEC_DIVISOR     24000000ull
 
+#define A13_THROTTLE_PCT_MAX        99
+#define A13_THROTTLE_TIMESLICE_NS   10000000
+
 static void
 absolutetime_to_nanoseconds(uint64_t abstime,
                             uint64_t *result)
@@ -109,6 +119,31 @@ inline bool apple_a13_cpu_is_powered_off(AppleA13State *tcpu)
     return ARM_CPU(tcpu)->power_state == PSCI_OFF;
 }
 
+/* Time spent powered off, including the current power off, if any */
+static uint64_t apple_a13_cpu_off_ns(AppleA13State *tcpu)
+{
+    int64_t start = tcpu->off_start_ns;
+    uint64_t value = stat64_get(&tcpu->off_ns);
+
+    if (start) {
+        value += get_clock() - start;
+    }
+    return value;
+}
+
+/*
+ * Arm the deferred IPI timer if it is not already due sooner. It is only
+ * armed while a deferred or no-wake IPI is outstanding, so idle cores are
+ * left alone until the AIC, an IPI or their own CNTV deadline wakes them.
+ */
+static void apple_a13_ipicr_schedule(void)
+{
+    if (ipicr_timer) {
+        timer_mod_anticipate_ns(ipicr_timer,
+                                qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + ipi_cr);
+    }
+}
+
 void apple_a13_cpu_start(AppleA13State *tcpu)
 {
     int ret = QEMU_ARM_POWERCTL_RET_SUCCESS;
@@ -137,12 +172,22 @@ void apple_a13_cpu_reset(AppleA13State *tcpu)
     }
 }
 
+static void apple_a13_cpu_off_work(CPUState *cs, run_on_cpu_data data)
+{
+    APPLE_A13(cs)->off_start_ns = get_clock();
+}
+
 void apple_a13_cpu_off(AppleA13State *tcpu)
 {
     int ret = QEMU_ARM_POWERCTL_RET_SUCCESS;
 
     if (ARM_CPU(tcpu)->power_state != PSCI_OFF) {
         ret = arm_set_cpu_off(tcpu->mpidr);
+        if (ret == QEMU_ARM_POWERCTL_RET_SUCCESS) {
+            /* queued behind the power off itself */
+            async_run_on_cpu(CPU(tcpu), apple_a13_cpu_off_work,
+                             RUN_ON_CPU_NULL);
+        }
     }
 
     if (ret != QEMU_ARM_POWERCTL_RET_SUCCESS) {
@@ -207,6 +252,7 @@ static int apple_a13_cluster_pre_save(void *opaque) {
 static int apple_a13_cluster_post_load(void *opaque, int version_id) {
     AppleA13Cluster *cluster = APPLE_A13_CLUSTER(opaque);
     ipi_cr = cluster->ipi_cr;
+    apple_a13_ipicr_schedule();
     return 0;
 }
 
@@ -229,11 +275,160 @@ static int add_cpu_to_cluster(Object *obj, void *opaque)
             cluster->base = tcpu->cluster_reg[0];
             cluster->size = tcpu->cluster_reg[1];
             cluster->cpus[tcpu->cpu_id] = tcpu;
+            if (!cluster->cluster_type) {
+                cluster->cluster_type = tcpu->cluster_type;
+            }
         }
     }
     return 0;
 }
 
+/* Parse a host CPU list such as "0-3,8" into a freshly allocated bitmap */
+static unsigned long *apple_a13_parse_host_cpus(const char *str,
+                                                unsigned long *nbits,
+                                                Error **errp)
+{
+    g_auto(GStrv) ranges = g_strsplit(str, ",", -1);
+    g_autofree uint64_t *first = g_new0(uint64_t, g_strv_length(ranges));
+    g_autofree uint64_t *last = g_new0(uint64_t, g_strv_length(ranges));
+    unsigned long *bitmap;
+    uint64_t max = 0;
+    int i;
+
+    for (i = 0; ranges[i]; i++) {
+        const char *end;
+
+        if (qemu_strtou64(ranges[i], &end, 10, &first[i]) < 0) {
+            error_setg(errp, "Invalid host CPU list '%s'", str);
+            return NULL;
+        }
+        last[i] = first[i];
+        if (*end == '-' &&
+            qemu_strtou64(end + 1, NULL, 10, &last[i]) < 0) {
+            error_setg(errp, "Invalid host CPU list '%s'", str);
+            return NULL;
+        } else if (*end != '-' && *end != '\0') {
+            error_setg(errp, "Invalid host CPU list '%s'", str);
+            return NULL;
+        }
+        if (last[i] < first[i] || last[i] >= 4096) {
+            error_setg(errp, "Invalid host CPU range '%s'", ranges[i]);
+            return NULL;
+        }
+        max = MAX(max, last[i]);
+    }
+
+    if (i == 0) {
+        error_setg(errp, "Empty host CPU list");
+        return NULL;
+    }
+
+    *nbits = max + 1;
+    bitmap = bitmap_new(*nbits);
+    for (i = 0; ranges[i]; i++) {
+        bitmap_set(bitmap, first[i], last[i] - first[i] + 1);
+    }
+
+    return bitmap;
+}
+
+static void apple_a13_cluster_apply_host_cpus(AppleA13Cluster *c,
+                                              Error **errp)
+{
+    g_autofree unsigned long *bitmap = NULL;
+    unsigned long nbits = 0;
+    int i;
+
+    if (!c->host_cpus) {
+        return;
+    }
+
+    if (!qemu_tcg_mttcg_enabled()) {
+        error_setg(errp, "Cluster host CPU affinity requires MTTCG");
+        return;
+    }
+
+    bitmap = apple_a13_parse_host_cpus(c->host_cpus, &nbits, errp);
+    if (!bitmap) {
+        return;
+    }
+
+    for (i = 0; i < A13_MAX_CPU; i++) {
+        CPUState *cs;
+        int err;
+
+        if (!c->cpus[i]) {
+            continue;
+        }
+
+        cs = CPU(c->cpus[i]);
+        if (!cs->thread) {
+            continue;
+        }
+
+        err = qemu_thread_set_affinity(cs->thread, bitmap, nbits);
+        if (err) {
+            error_setg_errno(errp, err < 0 ? -err : err,
+                             "Failed to pin %s to host CPUs %s",
+                             DEVICE(cs)->id, c->host_cpus);
+            return;
+        }
+    }
+}
+
+static void apple_a13_cluster_throttle_fn(CPUState *cpu, run_on_cpu_data data)
+{
+    AppleA13State *tcpu = APPLE_A13(cpu);
+    int64_t sleeptime_ns = data.host_ulong;
+    int64_t endtime_ns = qemu_clock_get_ns(QEMU_CLOCK_REALTIME) + sleeptime_ns;
+
+    while (sleeptime_ns > 0 && !cpu->stop) {
+        if (sleeptime_ns > SCALE_MS) {
+            qemu_cond_timedwait_iothread(cpu->halt_cond,
+                                         sleeptime_ns / SCALE_MS);
+        } else {
+            qemu_mutex_unlock_iothread();
+            g_usleep(sleeptime_ns / SCALE_US);
+            qemu_mutex_lock_iothread();
+        }
+        sleeptime_ns = endtime_ns - qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+    }
+    qatomic_set(&tcpu->throttle_scheduled, 0);
+}
+
+/*
+ * Model a slower cluster by stealing a fixed share of every timeslice
+ * from its running vCPUs, the same way migration throttles all CPUs.
+ */
+static void apple_a13_cluster_throttle_tick(void *opaque)
+{
+    AppleA13Cluster *c = APPLE_A13_CLUSTER(opaque);
+    uint32_t pct = qatomic_read(&c->throttle);
+    uint64_t sleeptime_ns;
+    int i;
+
+    if (!pct) {
+        return;
+    }
+
+    sleeptime_ns = (uint64_t)A13_THROTTLE_TIMESLICE_NS * pct / (100 - pct);
+    for (i = 0; i < A13_MAX_CPU; i++) {
+        AppleA13State *tcpu = c->cpus[i];
+
+        if (!tcpu || apple_a13_cpu_is_powered_off(tcpu)
+            || apple_a13_cpu_is_sleep(tcpu)) {
+            continue;
+        }
+        if (!qatomic_xchg(&tcpu->throttle_scheduled, 1)) {
+            async_run_on_cpu(CPU(tcpu), apple_a13_cluster_throttle_fn,
+                             RUN_ON_CPU_HOST_ULONG(sleeptime_ns));
+        }
+    }
+
+    timer_mod(c->throttle_timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL_RT) +
+              A13_THROTTLE_TIMESLICE_NS * 100 / (100 - pct));
+}
+
 static void apple_a13_cluster_realize(DeviceState *dev, Error **errp)
 {
     AppleA13Cluster *cluster = APPLE_A13_CLUSTER(dev);
@@ -244,10 +439,165 @@ static void apple_a13_cluster_realize(DeviceState *dev, Error **errp)
                                           TYPE_APPLE_A13_CLUSTER ".cpm-impl-reg",
                                           cluster->size, g_malloc0(cluster->size));
     }
+
+    cluster->throttle_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL_RT,
+                                           apple_a13_cluster_throttle_tick,
+                                           cluster);
+    apple_a13_cluster_apply_host_cpus(cluster, errp);
+    apple_a13_cluster_throttle_tick(cluster);
+}
+
+static char *apple_a13_cluster_get_host_cpus(Object *obj, Error **errp)
+{
+    AppleA13Cluster *cluster = APPLE_A13_CLUSTER(obj);
+
+    return g_strdup(cluster->host_cpus);
+}
+
+static void apple_a13_cluster_set_host_cpus(Object *obj, const char *value,
+                                            Error **errp)
+{
+    AppleA13Cluster *cluster = APPLE_A13_CLUSTER(obj);
+
+    g_free(cluster->host_cpus);
+    cluster->host_cpus = g_strdup(value);
+
+    if (DEVICE(obj)->realized) {
+        apple_a13_cluster_apply_host_cpus(cluster, errp);
+    }
+}
+
+static void apple_a13_cluster_get_throttle(Object *obj, Visitor *v,
+                                           const char *name, void *opaque,
+                                           Error **errp)
+{
+    AppleA13Cluster *cluster = APPLE_A13_CLUSTER(obj);
+    uint32_t value = qatomic_read(&cluster->throttle);
+
+    visit_type_uint32(v, name, &value, errp);
+}
+
+static void apple_a13_cluster_set_throttle(Object *obj, Visitor *v,
+                                           const char *name, void *opaque,
+                                           Error **errp)
+{
+    AppleA13Cluster *cluster = APPLE_A13_CLUSTER(obj);
+    uint32_t old = qatomic_read(&cluster->throttle);
+    uint32_t value;
+
+    if (!visit_type_uint32(v, name, &value, errp)) {
+        return;
+    }
+
+    if (value > A13_THROTTLE_PCT_MAX) {
+        error_setg(errp, "Cluster throttle must be between 0 and %d percent",
+                   A13_THROTTLE_PCT_MAX);
+        return;
+    }
+
+    qatomic_set(&cluster->throttle, value);
+    if (!old && cluster->throttle_timer) {
+        apple_a13_cluster_throttle_tick(cluster);
+    }
 }
 
-static void apple_a13_cluster_tick(AppleA13Cluster *c)
+static void apple_a13_cluster_get_exec_ns(Object *obj, Visitor *v,
+                                          const char *name, void *opaque,
+                                          Error **errp)
 {
+    AppleA13Cluster *cluster = APPLE_A13_CLUSTER(obj);
+    uint64_t value = 0;
+    int i;
+
+    for (i = 0; i < A13_MAX_CPU; i++) {
+        if (cluster->cpus[i]) {
+            value += stat64_get(&cluster->cpus[i]->exec_ns);
+        }
+    }
+
+    visit_type_uint64(v, name, &value, errp);
+}
+
+static void apple_a13_cluster_get_idle_ns(Object *obj, Visitor *v,
+                                          const char *name, void *opaque,
+                                          Error **errp)
+{
+    AppleA13Cluster *cluster = APPLE_A13_CLUSTER(obj);
+    uint64_t value = 0;
+    int i;
+
+    for (i = 0; i < A13_MAX_CPU; i++) {
+        if (cluster->cpus[i]) {
+            value += stat64_get(&cluster->cpus[i]->idle_ns);
+        }
+    }
+
+    visit_type_uint64(v, name, &value, errp);
+}
+
+static void apple_a13_get_exec_ns(Object *obj, Visitor *v, const char *name,
+                                  void *opaque, Error **errp)
+{
+    uint64_t value = stat64_get(&APPLE_A13(obj)->exec_ns);
+
+    visit_type_uint64(v, name, &value, errp);
+}
+
+static void apple_a13_get_idle_ns(Object *obj, Visitor *v, const char *name,
+                                  void *opaque, Error **errp)
+{
+    uint64_t value = stat64_get(&APPLE_A13(obj)->idle_ns);
+
+    visit_type_uint64(v, name, &value, errp);
+}
+
+static void apple_a13_get_off_ns(Object *obj, Visitor *v, const char *name,
+                                 void *opaque, Error **errp)
+{
+    uint64_t value = apple_a13_cpu_off_ns(APPLE_A13(obj));
+
+    visit_type_uint64(v, name, &value, errp);
+}
+
+static void apple_a13_cluster_get_off_ns(Object *obj, Visitor *v,
+                                         const char *name, void *opaque,
+                                         Error **errp)
+{
+    AppleA13Cluster *cluster = APPLE_A13_CLUSTER(obj);
+    uint64_t value = 0;
+    int i;
+
+    for (i = 0; i < A13_MAX_CPU; i++) {
+        if (cluster->cpus[i]) {
+            value += apple_a13_cpu_off_ns(cluster->cpus[i]);
+        }
+    }
+
+    visit_type_uint64(v, name, &value, errp);
+}
+
+/*
+ * True if the IPI from @src to @tgt is outstanding but not what @tgt is
+ * currently being interrupted for. Once delivered, the target's write to
+ * the status register clears it, so only these need another tick.
+ */
+static bool apple_a13_cluster_ipi_undelivered(AppleA13Cluster *c, int src,
+                                              int tgt, uint64_t flag)
+{
+    uint64_t sr = c->cpus[tgt]->ipi_sr;
+
+    return !sr || IPI_SR_SRC_CPU(sr) != src ||
+           (sr & IPI_RR_TYPE_MASK) != flag;
+}
+
+/*
+ * Deliver outstanding deferred and no-wake IPIs. Returns true if any are
+ * left undelivered although their target could take them, e.g. because it
+ * was still handling another IPI, i.e. the timer must rerun.
+ */
+static bool apple_a13_cluster_tick(AppleA13Cluster *c)
+{
+    bool pending = false;
     int i, j;
 
     for (i = 0; i < A13_MAX_CPU; i++) { /* source */
@@ -270,16 +620,48 @@ static void apple_a13_cluster_tick(AppleA13Cluster *c)
             }
         }
     }
+
+    for (i = 0; i < A13_MAX_CPU && !pending; i++) { /* source */
+        for (j = 0; j < A13_MAX_CPU; j++) { /* target */
+            if (c->cpus[j] == NULL
+                || apple_a13_cpu_is_powered_off(c->cpus[j])) {
+                continue;
+            }
+            if (c->deferredIPI[i][j] &&
+                apple_a13_cluster_ipi_undelivered(c, i, j,
+                                                  IPI_RR_TYPE_DEFERRED)) {
+                pending = true;
+                break;
+            }
+            if (c->noWakeIPI[i][j] && !apple_a13_cpu_is_sleep(c->cpus[j]) &&
+                apple_a13_cluster_ipi_undelivered(c, i, j,
+                                                  IPI_RR_TYPE_NOWAKE)) {
+                pending = true;
+                break;
+            }
+        }
+    }
+
+    return pending;
 }
 
 static void apple_a13_cluster_ipicr_tick(void* opaque)
 {
     AppleA13Cluster *cluster;
+    bool pending = false;
+
     QTAILQ_FOREACH(cluster, &clusters, next) {
-        apple_a13_cluster_tick(cluster);
+        pending |= apple_a13_cluster_tick(cluster);
     }
 
-    timer_mod_ns(ipicr_timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + ipi_cr);
+    /*
+     * No-wake IPIs to sleeping cores are picked up again when the core
+     * leaves WFI, see apple_a13_cpu_exec_enter().
+     */
+    if (pending) {
+        timer_mod_ns(ipicr_timer,
+                     qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + ipi_cr);
+    }
 }
 
 
@@ -291,8 +673,6 @@ static void apple_a13_cluster_reset_handler(void *opaque)
     }
     ipicr_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL,
                                apple_a13_cluster_ipicr_tick, NULL);
-    timer_mod_ns(ipicr_timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL)
-                              + kDeferredIPITimerDefault);
 }
 
 static void apple_a13_cluster_instance_init(Object *obj)
@@ -337,6 +717,7 @@ static void apple_a13_ipi_rr_local(CPUARMState *env, const ARMCPRegInfo *ri,
     case IPI_RR_TYPE_NOWAKE:
         if (apple_a13_cpu_is_sleep(c->cpus[cpu_id])) {
             c->noWakeIPI[tcpu->cpu_id][cpu_id] = 1;
+            apple_a13_ipicr_schedule();
         } else {
             apple_a13_cluster_deliver_ipi(c, cpu_id, tcpu->cpu_id,
                                       IPI_RR_TYPE_IMMEDIATE);
@@ -344,6 +725,7 @@ static void apple_a13_ipi_rr_local(CPUARMState *env, const ARMCPRegInfo *ri,
         break;
     case IPI_RR_TYPE_DEFERRED:
         c->deferredIPI[tcpu->cpu_id][cpu_id] = 1;
+        apple_a13_ipicr_schedule();
         break;
     case IPI_RR_TYPE_RETRACT:
         c->deferredIPI[tcpu->cpu_id][cpu_id] = 0;
@@ -396,6 +778,7 @@ static void apple_a13_ipi_rr_global(CPUARMState *env, const ARMCPRegInfo *ri,
     case IPI_RR_TYPE_NOWAKE:
         if (apple_a13_cpu_is_sleep(c->cpus[cpu_id])) {
             c->noWakeIPI[tcpu->cpu_id][cpu_id] = 1;
+            apple_a13_ipicr_schedule();
         } else {
             apple_a13_cluster_deliver_ipi(c, cpu_id, tcpu->cpu_id,
                                       IPI_RR_TYPE_IMMEDIATE);
@@ -403,6 +786,7 @@ static void apple_a13_ipi_rr_global(CPUARMState *env, const ARMCPRegInfo *ri,
         break;
     case IPI_RR_TYPE_DEFERRED:
         c->deferredIPI[tcpu->cpu_id][cpu_id] = 1;
+        apple_a13_ipicr_schedule();
         break;
     case IPI_RR_TYPE_RETRACT:
         c->deferredIPI[tcpu->cpu_id][cpu_id] = 0;
@@ -473,7 +857,9 @@ static void apple_a13_ipi_write_cr(CPUARMState *env, const ARMCPRegInfo *ri,
         value = kDeferredIPITimerDefault;
 
     ct = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
-    timer_mod_ns(ipicr_timer, (ct / ipi_cr) * ipi_cr + nanosec);
+    if (timer_pending(ipicr_timer)) {
+        timer_mod_ns(ipicr_timer, (ct / ipi_cr) * ipi_cr + nanosec);
+    }
     ipi_cr = nanosec;
 }
 
@@ -550,6 +936,64 @@ static const ARMCPRegInfo apple_a13_cp_reginfo_tcg[] = {
     },
 };
 
+#ifdef CONFIG_TCG
+static struct TCGCPUOps apple_a13_tcg_ops;
+
+/*
+ * Account host time spent executing guest code, time spent halted
+ * between leaving cpu_exec() on WFI and entering it again, and time
+ * spent powered off.
+ */
+static void apple_a13_cpu_exec_enter(CPUState *cs)
+{
+    AppleA13State *tcpu = APPLE_A13(cs);
+    int64_t now = get_clock();
+    bool woken = false;
+
+    if (tcpu->off_start_ns) {
+        /* Powered back on; a WFI before the power off counts as idle */
+        if (tcpu->idle_start_ns && tcpu->idle_start_ns < tcpu->off_start_ns) {
+            stat64_add(&tcpu->idle_ns,
+                       tcpu->off_start_ns - tcpu->idle_start_ns);
+        }
+        stat64_add(&tcpu->off_ns, now - tcpu->off_start_ns);
+        tcpu->off_start_ns = 0;
+        tcpu->idle_start_ns = 0;
+        woken = true;
+    } else if (tcpu->idle_start_ns) {
+        stat64_add(&tcpu->idle_ns, now - tcpu->idle_start_ns);
+        tcpu->idle_start_ns = 0;
+        woken = true;
+    }
+
+    if (woken) {
+        /* IPIs held back while we slept or were off can be delivered now */
+        AppleA13Cluster *c = apple_a13_find_cluster(tcpu->cluster_id);
+        int i;
+
+        for (i = 0; c && i < A13_MAX_CPU; i++) {
+            if (qatomic_read(&c->noWakeIPI[i][tcpu->cpu_id])
+                || qatomic_read(&c->deferredIPI[i][tcpu->cpu_id])) {
+                apple_a13_ipicr_schedule();
+                break;
+            }
+        }
+    }
+    tcpu->exec_start_ns = now;
+}
+
+static void apple_a13_cpu_exec_exit(CPUState *cs)
+{
+    AppleA13State *tcpu = APPLE_A13(cs);
+    int64_t now = get_clock();
+
+    stat64_add(&tcpu->exec_ns, now - tcpu->exec_start_ns);
+    if (cs->halted) {
+        tcpu->idle_start_ns = now;
+    }
+}
+#endif
+
 static void apple_a13_add_cpregs(AppleA13State *tcpu)
 {
     ARMCPU *cpu = ARM_CPU(tcpu);
@@ -593,6 +1037,15 @@ static void apple_a13_reset(DeviceState *dev)
     AppleA13State *tcpu = APPLE_A13(dev);
     AppleA13Class *tclass = APPLE_A13_GET_CLASS(dev);
     tclass->parent_reset(dev);
+
+    /*
+     * Cores held in reset count as powered off until they are started.
+     * Leave an open interval alone: this is also the reset done while
+     * powering the core on.
+     */
+    if (apple_a13_cpu_is_powered_off(tcpu) && !tcpu->off_start_ns) {
+        tcpu->off_start_ns = get_clock();
+    }
 }
 
 static void apple_a13_instance_init(Object *obj)
@@ -647,6 +1100,7 @@ AppleA13State *apple_a13_cpu_create(DTBNode *node)
     cpu->midr = FIELD_DP64(cpu->midr, MIDR_EL1, REVISION, 0x1);
 
     prop = find_dtb_prop(node, "cluster-type");
+    tcpu->cluster_type = prop->value[0];
     switch (prop->value[0]) {
     case 'P':
         mpidr |= 1 << MPIDR_AFF2_SHIFT;
@@ -824,6 +1278,24 @@ static void apple_a13_class_init(ObjectClass *klass, void *data)
     dc->vmsd = &vmstate_apple_a13;
     set_bit(DEVICE_CATEGORY_CPU, dc->categories);
     device_class_set_props(dc, apple_a13_properties);
+
+    object_class_property_add(klass, "exec-ns", "uint64",
+                              apple_a13_get_exec_ns, NULL, NULL, NULL);
+    object_class_property_add(klass, "idle-ns", "uint64",
+                              apple_a13_get_idle_ns, NULL, NULL, NULL);
+    object_class_property_add(klass, "off-ns", "uint64",
+                              apple_a13_get_off_ns, NULL, NULL, NULL);
+    object_class_property_set_description(klass, "off-ns",
+        "Host time the core has spent powered off, in ns");
+
+#ifdef CONFIG_TCG
+    CPUClass *cc = CPU_CLASS(klass);
+
+    apple_a13_tcg_ops = *cc->tcg_ops;
+    apple_a13_tcg_ops.cpu_exec_enter = apple_a13_cpu_exec_enter;
+    apple_a13_tcg_ops.cpu_exec_exit = apple_a13_cpu_exec_exit;
+    cc->tcg_ops = &apple_a13_tcg_ops;
+#endif
 }
 
 static void apple_a13_cluster_class_init(ObjectClass *klass, void *data)
@@ -836,6 +1308,27 @@ static void apple_a13_cluster_class_init(ObjectClass *klass, void *data)
     dc->user_creatable = false;
     dc->vmsd = &vmstate_apple_a13_cluster;
     device_class_set_props(dc, apple_a13_cluster_properties);
+
+    object_class_property_add_str(klass, "host-cpus",
+                                  apple_a13_cluster_get_host_cpus,
+                                  apple_a13_cluster_set_host_cpus);
+    object_class_property_set_description(klass, "host-cpus",
+        "Pin the cluster's vCPU threads to a host CPU list (e.g. 0-3,8)");
+    object_class_property_add(klass, "throttle", "uint32",
+                              apple_a13_cluster_get_throttle,
+                              apple_a13_cluster_set_throttle,
+                              NULL, NULL);
+    object_class_property_set_description(klass, "throttle",
+        "Percentage of host time withheld from the cluster's vCPUs");
+    object_class_property_add(klass, "exec-ns", "uint64",
+                              apple_a13_cluster_get_exec_ns,
+                              NULL, NULL, NULL);
+    object_class_property_add(klass, "idle-ns", "uint64",
+                              apple_a13_cluster_get_idle_ns,
+                              NULL, NULL, NULL);
+    object_class_property_add(klass, "off-ns", "uint64",
+                              apple_a13_cluster_get_off_ns,
+                              NULL, NULL, NULL);
 }
 
 static const TypeInfo apple_a13_info = {
@@ -10,6 +10,7 @@
 #include "hw/arm/xnu.h"
 #include "hw/arm/xnu_dtb.h"
 #include "hw/arm/apple_dart.h"
+#include "hw/misc/apple_soc_stats.h"
 #include "monitor/monitor.h"
 #include "monitor/qdev.h"
 #include "monitor/hmp-target.h"
@@ -145,6 +146,7 @@ struct AppleDARTInstance {
         };
     };
 #pragma pack(pop)
+    VMStateGen base_reg_gen;
 
     GHashTable *tlb;
     QemuMutex mutex;
@@ -165,6 +167,10 @@ struct AppleDARTState {
     uint32_t sids;
     uint32_t bypass;
     uint64_t bypass_address;
+    AppleSoCStats stats;
+    Stat64 tlb_hits;
+    Stat64 tlb_misses;
+    Stat64 walks;
 };
 
 static int apple_dart_device_list(Object *obj, void *opaque)
@@ -223,6 +229,8 @@ static void base_reg_write(void *opaque, hwaddr addr,
     uint32_t orig;
     uint32_t val = data;
     bool iflg = 0;
+
+    apple_soc_stats_mmio_write(&s->stats);
     DPRINTF("%s[%d]: (%s) %s @ 0x" TARGET_FMT_plx
             " value: 0x" TARGET_FMT_plx "\n", s->name, o->id,
             dart_instance_name[o->type], __func__, addr, data);
@@ -269,7 +277,10 @@ static void base_reg_write(void *opaque, hwaddr addr,
             break;
         }
     }
-    o->base_reg[addr >> 2] = val;
+    if (val != orig) {
+        o->base_reg[addr >> 2] = val;
+        vmstate_gen_bump(&o->base_reg_gen);
+    }
     if (iflg) {
         apple_dart_update_irq(s);
     }
@@ -283,6 +294,8 @@ static uint64_t base_reg_read(void *opaque,
     DPRINTF("%s[%d]: (%s) %s @ 0x"TARGET_FMT_plx"\n", o->s->name, o->id,
             dart_instance_name[o->type], __func__, addr);
 
+    apple_soc_stats_mmio_read(&o->s->stats);
+
     if (o->type == DART_DART) {
         switch (addr) {
         case DART_TLB_OP:
@@ -317,6 +330,7 @@ static AppleDARTTLBEntry *apple_dart_ptw(AppleDARTInstance *o, uint32_t sid,
     AppleDARTTLBEntry *tlb_entry = NULL;
     uint32_t err_status = 0;
 
+    stat64_add(&s->walks, 1);
     if ((idx >= DART_MAX_TTBR)
         || ((o->ttbr[sid][idx] & DART_TTBR_VALID) == 0)) {
         err_status = (DART_ERROR_FLAG | DART_ERROR_TTBR_INVLD);
@@ -414,6 +428,8 @@ static IOMMUTLBEntry apple_dart_translate(IOMMUMemoryRegion *mr, hwaddr addr,
 
     if (tlb_entry == NULL) {
         uint32_t status = 0;
+
+        stat64_add(&s->tlb_misses, 1);
         tlb_entry = apple_dart_ptw(o, sid, iova, &status);
         if (tlb_entry) {
             g_hash_table_insert(o->tlb, GUINT_TO_POINTER(key), tlb_entry);
@@ -430,7 +446,10 @@ static IOMMUTLBEntry apple_dart_translate(IOMMUMemoryRegion *mr, hwaddr addr,
                                         DART_ERROR_STREAM_SHIFT,
                                         DART_ERROR_STREAM_LENGTH, iommu->sid);
             o->error_address = addr;
+            vmstate_gen_bump(&o->base_reg_gen);
         }
+    } else {
+        stat64_add(&s->tlb_hits, 1);
     }
     if (tlb_entry) {
         entry.translated_addr = tlb_entry->block_addr
@@ -443,6 +462,7 @@ static IOMMUTLBEntry apple_dart_translate(IOMMUMemoryRegion *mr, hwaddr addr,
         o->error_status |= (DART_ERROR_FLAG | DART_ERROR_WRITE_PROT);
         o->error_status = deposit32(o->error_status, DART_ERROR_STREAM_SHIFT,
                                     DART_ERROR_STREAM_LENGTH, iommu->sid);
+        vmstate_gen_bump(&o->base_reg_gen);
     }
 
     if ((flag & IOMMU_RO) && !(entry.perm & IOMMU_RO)) {
@@ -450,6 +470,7 @@ static IOMMUTLBEntry apple_dart_translate(IOMMUMemoryRegion *mr, hwaddr addr,
         o->error_status |= (DART_ERROR_FLAG | DART_ERROR_READ_PROT);
         o->error_status = deposit32(o->error_status, DART_ERROR_STREAM_SHIFT,
                                     DART_ERROR_STREAM_LENGTH, iommu->sid);
+        vmstate_gen_bump(&o->base_reg_gen);
     }
 
 end:
@@ -472,6 +493,7 @@ static void apple_dart_reset(DeviceState *dev)
 
     for (i = 0; i < s->num_instances; i++) {
         memset(s->instances[i].base_reg, 0, sizeof(s->instances[i].base_reg));
+        vmstate_gen_bump(&s->instances[i].base_reg_gen);
         switch (s->instances[i].type) {
         case DART_DART: {
             s->instances[i].params1 = DART_PARAMS1_PAGE_SHIFT(s->page_shift);
@@ -747,7 +769,48 @@ void hmp_info_dart(Monitor *mon, const QDict *qdict)
     }
 }
 
+static VMStateGen *apple_dart_instance_base_reg_gen(void *opaque)
+{
+    AppleDARTInstance *o = opaque;
+
+    return &o->base_reg_gen;
+}
+
+static bool apple_dart_v1(void *opaque, int version_id)
+{
+    return version_id < 2;
+}
+
+static const VMStateDescription vmstate_apple_dart_instance_base_reg = {
+    .name = "apple_dart_instance/base_reg",
+    .version_id = 2,
+    .minimum_version_id = 1,
+    .gen = apple_dart_instance_base_reg_gen,
+    .fields = (VMStateField[]) {
+        VMSTATE_ARRAY_TEST(base_reg, AppleDARTInstance,
+                           0x4000 / sizeof(uint32_t), apple_dart_v1,
+                           vmstate_info_uint32, uint32_t),
+        VMSTATE_UINT32_SPARSE_ARRAY_V(base_reg, AppleDARTInstance,
+                                      0x4000 / sizeof(uint32_t), 2),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
 static const VMStateDescription vmstate_apple_dart_instance = {
+    .name = "apple_dart_instance",
+    .version_id = 2,
+    .minimum_version_id = 2,
+    .fields = (VMStateField[]) {
+        VMSTATE_END_OF_LIST()
+    },
+    .subsections = (const VMStateDescription * []) {
+        &vmstate_apple_dart_instance_base_reg,
+        NULL
+    }
+};
+
+/* Before version 2 the registers were not in a subsection */
+static const VMStateDescription vmstate_apple_dart_instance_v1 = {
     .name = "apple_dart_instance",
     .version_id = 1,
     .minimum_version_id = 1,
@@ -760,21 +823,54 @@ static const VMStateDescription vmstate_apple_dart_instance = {
 
 static const VMStateDescription vmstate_apple_dart = {
     .name = "apple_dart",
-    .version_id = 1,
+    .version_id = 2,
     .minimum_version_id = 1,
     .priority = MIG_PRI_IOMMU,
+    .threaded_save = true,
+    .save_early = true,
     .fields = (VMStateField[]) {
-        VMSTATE_STRUCT_ARRAY(instances, AppleDARTState, DART_MAX_INSTANCE, 1,
+        VMSTATE_STRUCT_ARRAY_TEST(instances, AppleDARTState,
+                                  DART_MAX_INSTANCE, apple_dart_v1, 1,
+                                  vmstate_apple_dart_instance_v1,
+                                  AppleDARTInstance),
+        VMSTATE_STRUCT_ARRAY(instances, AppleDARTState, DART_MAX_INSTANCE, 2,
                               vmstate_apple_dart_instance, AppleDARTInstance),
 
         VMSTATE_END_OF_LIST()
     }
 };
 
+static void apple_dart_stats_fill(void *opaque, AppleSoCDeviceStats *info)
+{
+    AppleDARTState *s = APPLE_DART(opaque);
+
+    info->has_dart = true;
+    info->dart = g_new0(AppleSoCDARTStats, 1);
+    info->dart->tlb_hits = stat64_get(&s->tlb_hits);
+    info->dart->tlb_misses = stat64_get(&s->tlb_misses);
+    info->dart->walks = stat64_get(&s->walks);
+}
+
+static void apple_dart_realize(DeviceState *dev, Error **errp)
+{
+    AppleDARTState *s = APPLE_DART(dev);
+
+    apple_soc_stats_register(&s->stats, s->name, apple_dart_stats_fill, s);
+}
+
+static void apple_dart_unrealize(DeviceState *dev)
+{
+    AppleDARTState *s = APPLE_DART(dev);
+
+    apple_soc_stats_unregister(&s->stats);
+}
+
 static void apple_dart_class_init(ObjectClass *klass, void *data)
 {
     DeviceClass *dc = DEVICE_CLASS(klass);
 
+    dc->realize = apple_dart_realize;
+    dc->unrealize = apple_dart_unrealize;
     dc->reset = apple_dart_reset;
     dc->desc = "Apple DART IOMMU";
     dc->vmsd = &vmstate_apple_dart;
@@ -40,6 +40,7 @@ struct AppleSARTState {
     AppleSARTRegion regions[SART_NUM_REGIONS];
     uint32_t version;
     uint32_t reg[0x8000 / sizeof(uint32_t)];
+    VMStateGen reg_gen;
 };
 
 static inline uint64_t sart_get_reg(AppleSARTState *s, uint32_t offset)
@@ -109,8 +110,12 @@ static void base_reg_write(void *opaque, hwaddr addr,
             __func__, addr, data);
 
     orig = s->reg[addr >> 2];
+    if (val == orig) {
+        return;
+    }
 
     s->reg[addr >> 2] = val;
+    vmstate_gen_bump(&s->reg_gen);
 
     for (int i = 0; i < SART_NUM_REGIONS; i++) {
         if ((sart_get_region_addr(s, i) != s->regions[i].addr)
@@ -189,6 +194,7 @@ static void apple_sart_reset(DeviceState *dev)
     AppleSARTState *s = APPLE_SART(dev);
     memset(s->reg, 0, sizeof(s->reg));
     memset(s->regions, 0, sizeof(s->regions));
+    vmstate_gen_bump(&s->reg_gen);
 }
 
 SysBusDevice *apple_sart_create(DTBNode *node)
@@ -229,12 +235,68 @@ SysBusDevice *apple_sart_create(DTBNode *node)
     return sbd;
 }
 
+static int apple_sart_post_load(void *opaque, int version_id)
+{
+    AppleSARTState *s = APPLE_SART(opaque);
+
+    for (int i = 0; i < SART_NUM_REGIONS; i++) {
+        s->regions[i].addr = sart_get_region_addr(s, i);
+        s->regions[i].size = sart_get_region_size(s, i);
+        s->regions[i].flags = sart_get_region_flags(s, i);
+    }
+    return 0;
+}
+
+static VMStateGen *apple_sart_reg_gen(void *opaque)
+{
+    AppleSARTState *s = APPLE_SART(opaque);
+
+    return &s->reg_gen;
+}
+
+static bool apple_sart_reg_v1(void *opaque, int version_id)
+{
+    return version_id < 2;
+}
+
+static const VMStateDescription vmstate_apple_sart_reg = {
+    .name = "apple_sart/reg",
+    .version_id = 2,
+    .minimum_version_id = 1,
+    .gen = apple_sart_reg_gen,
+    .fields = (VMStateField[]) {
+        VMSTATE_ARRAY_TEST(reg, AppleSARTState, 0x8000 / sizeof(uint32_t),
+                           apple_sart_reg_v1, vmstate_info_uint32, uint32_t),
+        VMSTATE_UINT32_SPARSE_ARRAY_V(reg, AppleSARTState,
+                                      0x8000 / sizeof(uint32_t), 2),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static const VMStateDescription vmstate_apple_sart = {
+    .name = "apple_sart",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .priority = MIG_PRI_IOMMU,
+    .threaded_save = true,
+    .save_early = true,
+    .post_load = apple_sart_post_load,
+    .fields = (VMStateField[]) {
+        VMSTATE_END_OF_LIST()
+    },
+    .subsections = (const VMStateDescription * []) {
+        &vmstate_apple_sart_reg,
+        NULL
+    }
+};
+
 static void apple_sart_class_init(ObjectClass *klass, void *data)
 {
     DeviceClass *dc = DEVICE_CLASS(klass);
 
     dc->reset = apple_sart_reset;
     dc->desc = "Apple SART IOMMU";
+    dc->vmsd = &vmstate_apple_sart;
 }
 
 static void apple_sart_iommu_memory_region_class_init(ObjectClass *klass,
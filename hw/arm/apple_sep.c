@@ -8,8 +8,8 @@
 #include "qemu/lockable.h"
 #include "qemu/log.h"
 #include "qemu/module.h"
-#include "qemu/queue.h"
 #include "qemu/timer.h"
+#include "sysemu/dma.h"
 #include "sysemu/runstate.h"
 #include "hw/arm/xnu.h"
 #include "hw/arm/xnu_dtb.h"
@@ -30,23 +30,165 @@ enum {
     kStatusTz0Booted = 2,
 };
 
+#define SEP_NUM_ENDPOINTS   (256)
+
 typedef void AppleSEPEPHandler (AppleSEPState *s, struct sep_message *msg);
 
+/*
+ * Out-of-line buffer shared with the AP.  The kernel sets its device
+ * address and size through the control endpoint.  The address goes
+ * through the SEP's DMA translation (DART or SART), which the guest may
+ * change at any time, so it is translated on every access.
+ */
+typedef struct sep_ool_buffer {
+    uint64_t addr;
+    uint32_t size;
+} sep_ool_buffer;
+
 typedef struct sep_endpoint {
     uint8_t id;
     uint32_t name;
-    QTAILQ_ENTRY(sep_endpoint) entry;
     AppleSEPEPHandler *handler;
+    sep_ool_buffer ool_in;
+    sep_ool_buffer ool_out;
 } sep_endpoint;
 
 
 struct AppleSEPState {
     SysBusDevice parent_obj;
     AppleMboxState *mbox;
-    QTAILQ_HEAD(, sep_endpoint) endpoints;
+    MemoryRegion *dma_mr;
+    AddressSpace dma_as;
+    /* Indexed by endpoint number */
+    sep_endpoint *endpoints[SEP_NUM_ENDPOINTS];
     uint32_t boot_status;
 };
 
+static void apple_sep_ool_check(AppleSEPState *s, uint8_t ep,
+                                sep_ool_buffer *ool, bool is_write)
+{
+    if (!ool->addr || !ool->size) {
+        return;
+    }
+    if (!dma_memory_valid(&s->dma_as, ool->addr, ool->size,
+                          is_write ? DMA_DIRECTION_FROM_DEVICE
+                                   : DMA_DIRECTION_TO_DEVICE,
+                          MEMTXATTRS_UNSPECIFIED)) {
+        qemu_log_mask(LOG_GUEST_ERROR, "SEP: OOL %s buffer of endpoint %u "
+                      "at 0x%" PRIx64 "+0x%x is not mapped\n",
+                      is_write ? "out" : "in", ep, ool->addr, ool->size);
+    }
+}
+
+/*
+ * Copy @len bytes at offset @off of endpoint @ep's OOL buffer to or from
+ * @buf.  The range must lie within the buffer the kernel configured.
+ */
+static MemTxResult apple_sep_ool_rw(AppleSEPState *s, uint8_t ep,
+                                    sep_ool_buffer *ool, uint32_t off,
+                                    void *buf, uint32_t len, bool is_write)
+{
+    MemTxResult res;
+
+    if (!ool->addr || (uint64_t)off + len > ool->size) {
+        qemu_log_mask(LOG_GUEST_ERROR, "SEP: OOL %s access of endpoint %u "
+                      "at 0x%x+0x%x outside of its 0x%x byte buffer\n",
+                      is_write ? "out" : "in", ep, off, len, ool->size);
+        return MEMTX_ERROR;
+    }
+
+    if (is_write) {
+        res = dma_memory_write(&s->dma_as, ool->addr + off, buf, len,
+                               MEMTXATTRS_UNSPECIFIED);
+    } else {
+        res = dma_memory_read(&s->dma_as, ool->addr + off, buf, len,
+                              MEMTXATTRS_UNSPECIFIED);
+    }
+    if (res != MEMTX_OK) {
+        qemu_log_mask(LOG_GUEST_ERROR, "SEP: OOL %s access of endpoint %u "
+                      "at 0x%" PRIx64 "+0x%x failed\n",
+                      is_write ? "out" : "in", ep, ool->addr + off, len);
+    }
+    return res;
+}
+
+/* Read from the buffer the AP passes to endpoint @ep */
+static MemTxResult apple_sep_ool_read(AppleSEPState *s, uint8_t ep,
+                                      uint32_t off, void *buf, uint32_t len)
+{
+    sep_endpoint *e = s->endpoints[ep];
+
+    assert(e);
+    return apple_sep_ool_rw(s, ep, &e->ool_in, off, buf, len, false);
+}
+
+/* Write to the buffer endpoint @ep returns to the AP */
+static MemTxResult apple_sep_ool_write(AppleSEPState *s, uint8_t ep,
+                                       uint32_t off, const void *buf,
+                                       uint32_t len)
+{
+    sep_endpoint *e = s->endpoints[ep];
+
+    assert(e);
+    return apple_sep_ool_rw(s, ep, &e->ool_out, off, (void *)buf, len, true);
+}
+
+/*
+ * The self test is a loopback through the control endpoint's OOL
+ * buffers: copy as much of the in buffer as fits in the out buffer and
+ * report the number of bytes copied.
+ */
+static uint32_t apple_sep_selftest(AppleSEPState *s)
+{
+    sep_endpoint *ep = s->endpoints[kEndpoint_CONTROL];
+    uint32_t len = MIN(ep->ool_in.size, ep->ool_out.size);
+    g_autofree uint8_t *buf = NULL;
+
+    if (!ep->ool_in.addr || !ep->ool_out.addr || !len) {
+        return 0;
+    }
+
+    buf = g_malloc(len);
+    if (apple_sep_ool_read(s, kEndpoint_CONTROL, 0, buf, len) != MEMTX_OK ||
+        apple_sep_ool_write(s, kEndpoint_CONTROL, 0, buf, len) != MEMTX_OK) {
+        return 0;
+    }
+    return len;
+}
+
+static void apple_sep_set_ool(AppleSEPState *s, struct sep_message *msg)
+{
+    sep_endpoint *ep = s->endpoints[msg->param];
+
+    if (!ep) {
+        qemu_log_mask(LOG_GUEST_ERROR, "SEP: OOL buffer for unknown "
+                      "endpoint %u\n", msg->param);
+        return;
+    }
+
+    /* Addresses are passed in 4K pages, sizes in bytes */
+    switch (msg->opcode) {
+    case kOpCode_SET_OOL_IN_ADDR:
+        ep->ool_in.addr = (uint64_t)msg->data << 12;
+        apple_sep_ool_check(s, ep->id, &ep->ool_in, false);
+        break;
+    case kOpCode_SET_OOL_IN_SIZE:
+        ep->ool_in.size = msg->data;
+        apple_sep_ool_check(s, ep->id, &ep->ool_in, false);
+        break;
+    case kOpCode_SET_OOL_OUT_ADDR:
+        ep->ool_out.addr = (uint64_t)msg->data << 12;
+        apple_sep_ool_check(s, ep->id, &ep->ool_out, true);
+        break;
+    case kOpCode_SET_OOL_OUT_SIZE:
+        ep->ool_out.size = msg->data;
+        apple_sep_ool_check(s, ep->id, &ep->ool_out, true);
+        break;
+    default:
+        g_assert_not_reached();
+    }
+}
+
 static void apple_sep_control_endpoint(AppleSEPState *s,
                                        struct sep_message *msg)
 {
@@ -64,19 +206,16 @@ static void apple_sep_control_endpoint(AppleSEPState *s,
         apple_mbox_send_control_message(s->mbox, 0, reply.raw);
         break;
     case kOpCode_SET_OOL_IN_ADDR:
-        reply.param = 0;
-        apple_mbox_send_control_message(s->mbox, 0, reply.raw);
-        break;
     case kOpCode_SET_OOL_IN_SIZE:
-        reply.param = 0;
-        apple_mbox_send_control_message(s->mbox, 0, reply.raw);
-        break;
     case kOpCode_SET_OOL_OUT_ADDR:
+    case kOpCode_SET_OOL_OUT_SIZE:
+        apple_sep_set_ool(s, msg);
         reply.param = 0;
         apple_mbox_send_control_message(s->mbox, 0, reply.raw);
         break;
-    case kOpCode_SET_OOL_OUT_SIZE:
+    case kOpCode_SELFTEST:
         reply.param = 0;
+        reply.data = apple_sep_selftest(s);
         apple_mbox_send_control_message(s->mbox, 0, reply.raw);
         break;
     default:
@@ -89,8 +228,14 @@ static void apple_sep_control_endpoint(AppleSEPState *s,
 static void apple_sep_ep_discover(AppleSEPState *s)
 {
     sep_endpoint *ep = NULL;
-    QTAILQ_FOREACH(ep, &s->endpoints, entry) {
+    int i;
+
+    for (i = 0; i < SEP_NUM_ENDPOINTS; i++) {
         struct sep_message msg = { 0 };
+        ep = s->endpoints[i];
+        if (!ep) {
+            continue;
+        }
         msg.endpoint = kEndpoint_DISCOVERY;
         msg.tag = 0;
         msg.opcode = kOpCode_Advertise;
@@ -99,8 +244,12 @@ static void apple_sep_ep_discover(AppleSEPState *s)
         apple_mbox_send_control_message(s->mbox, 0, msg.raw);
     }
 
-    QTAILQ_FOREACH(ep, &s->endpoints, entry) {
+    for (i = 0; i < SEP_NUM_ENDPOINTS; i++) {
         struct sep_message msg = { 0 };
+        ep = s->endpoints[i];
+        if (!ep) {
+            continue;
+        }
         msg.endpoint = kEndpoint_DISCOVERY;
         msg.tag = 0;
         msg.opcode = kOpCode_Expose;
@@ -154,26 +303,17 @@ static void apple_seprom_endpoint(AppleSEPState *s, struct sep_message *msg)
     }
 }
 
-static sep_endpoint *apple_sep_get_endpoint(AppleSEPState *s, uint8_t id)
-{
-    sep_endpoint *d;
-    QTAILQ_FOREACH(d, &s->endpoints, entry) {
-        if (d->id == id) {
-            return d;
-        }
-    }
-    return NULL;
-}
-
 static void apple_sep_register_endpoint(AppleSEPState *s, uint8_t id,
                                         uint32_t name,
                                         AppleSEPEPHandler *handler)
 {
     sep_endpoint *ep = g_new0(sep_endpoint, 1);
+
+    assert(!s->endpoints[id]);
     ep->name = name;
     ep->id = id;
     ep->handler = handler;
-    QTAILQ_INSERT_TAIL(&s->endpoints, ep, entry);
+    s->endpoints[id] = ep;
 }
 
 static void apple_sep_endpoint_handler(void *opaque, uint32_t ep,
@@ -187,7 +327,7 @@ static void apple_sep_endpoint_handler(void *opaque, uint32_t ep,
         apple_seprom_endpoint(s, m);
         break;
     default: {
-        sep_endpoint *ep = apple_sep_get_endpoint(s, m->endpoint);
+        sep_endpoint *ep = s->endpoints[m->endpoint];
         if (ep) {
             ep->handler(s, m);
         } else {
@@ -257,8 +397,6 @@ SysBusDevice *apple_sep_create(DTBNode *node, uint32_t build_version)
 
     s->boot_status = kStatusSEPROM;
 
-    QTAILQ_INIT(&s->endpoints);
-
     apple_sep_register_endpoint(s, kEndpoint_CONTROL, 'cntl',
                                            apple_sep_control_endpoint);
     return sbd;
@@ -266,11 +404,28 @@ SysBusDevice *apple_sep_create(DTBNode *node, uint32_t build_version)
 
 static void apple_sep_reset(DeviceState *dev)
 {
+    AppleSEPState *s = APPLE_SEP(dev);
+    int i;
+
+    for (i = 0; i < SEP_NUM_ENDPOINTS; i++) {
+        sep_endpoint *ep = s->endpoints[i];
+
+        if (ep) {
+            memset(&ep->ool_in, 0, sizeof(ep->ool_in));
+            memset(&ep->ool_out, 0, sizeof(ep->ool_out));
+        }
+    }
 }
 
 static void apple_sep_realize(DeviceState *dev, Error **errp)
 {
     AppleSEPState *s = APPLE_SEP(dev);
+    Object *obj;
+
+    obj = object_property_get_link(OBJECT(dev), "dma-mr", &error_abort);
+    s->dma_mr = MEMORY_REGION(obj);
+    address_space_init(&s->dma_as, s->dma_mr, TYPE_APPLE_SEP);
+
     sysbus_realize(SYS_BUS_DEVICE(s->mbox), errp);
 }
 
@@ -278,9 +433,39 @@ static void apple_sep_unrealize(DeviceState *dev)
 {
     AppleSEPState *s = APPLE_SEP(dev);
 
+    apple_sep_reset(dev);
     qdev_unrealize(DEVICE(s->mbox));
+    address_space_destroy(&s->dma_as);
 }
 
+static const VMStateDescription vmstate_apple_sep_endpoint = {
+    .name = "apple_sep_endpoint",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .fields = (VMStateField[]) {
+        VMSTATE_UINT64(ool_in.addr, sep_endpoint),
+        VMSTATE_UINT32(ool_in.size, sep_endpoint),
+        VMSTATE_UINT64(ool_out.addr, sep_endpoint),
+        VMSTATE_UINT32(ool_out.size, sep_endpoint),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static const VMStateDescription vmstate_apple_sep = {
+    .name = "apple_sep",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .fields = (VMStateField[]) {
+        VMSTATE_UINT32(boot_status, AppleSEPState),
+        /* Both sides register the same endpoints, the others are NULL */
+        VMSTATE_ARRAY_OF_POINTER_TO_STRUCT(endpoints, AppleSEPState,
+                                           SEP_NUM_ENDPOINTS, 0,
+                                           vmstate_apple_sep_endpoint,
+                                           sep_endpoint),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
 static void apple_sep_class_init(ObjectClass *klass, void *data)
 {
     DeviceClass *dc = DEVICE_CLASS(klass);
@@ -289,6 +474,7 @@ static void apple_sep_class_init(ObjectClass *klass, void *data)
     dc->unrealize = apple_sep_unrealize;
     dc->reset = apple_sep_reset;
     dc->desc = "Apple SEP";
+    dc->vmsd = &vmstate_apple_sep;
     set_bit(DEVICE_CATEGORY_MISC, dc->categories);
 }
 
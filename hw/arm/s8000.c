@@ -29,6 +29,7 @@
 #include "qemu/cutils.h"
 #include "hw/arm/boot.h"
 #include "exec/address-spaces.h"
+#include "exec/ram_addr.h"
 #include "hw/misc/unimp.h"
 #include "sysemu/block-backend.h"
 #include "sysemu/sysemu.h"
@@ -60,6 +61,10 @@
 #define S8000_SROM_SIZE (0x80000ULL)
 #define S8000_SRAM_BASE (0x180000000ULL)
 #define S8000_SRAM_SIZE (0x400000ULL)
+/* Where the SecureROM loads and starts an image received over DFU */
+#define S8000_DFU_LOAD_BASE (0x180380000ULL)
+#define S8000_DFU_LOAD_SIZE (S8000_SRAM_BASE + S8000_SRAM_SIZE \
+                             - S8000_DFU_LOAD_BASE)
 #define S8000_DRAM_BASE (0x800000000ULL)
 #define S8000_SPI0_BASE (0x00A080000ULL)
 #define S8000_SPI0_IRQ  (188)
@@ -161,17 +166,75 @@ static void s8000_memory_setup(MachineState *machine)
         return;
     }
 
+    if (!tms->srom_mapped) {
+        if (!g_file_get_contents(machine->firmware, &securerom, &fsize,
+                                 NULL)) {
+            error_report("Could not load data from file '%s'",
+                         machine->firmware);
+            exit(EXIT_FAILURE);
+        }
+        address_space_rw(nsas, S8000_SROM_BASE, MEMTXATTRS_UNSPECIFIED,
+                         (uint8_t *)securerom, fsize, 1);
+    }
+
+    if (tms->dfu_image) {
+        g_autofree uint8_t *image = NULL;
+        uint64_t image_size = 0;
+
+        image = load_im4p_payload_from_file(tms->dfu_image, &image_size);
+        if (image_size > S8000_DFU_LOAD_SIZE) {
+            error_report("DFU image '%s' does not fit in SRAM", tms->dfu_image);
+            exit(EXIT_FAILURE);
+        }
+        address_space_rw(nsas, S8000_DFU_LOAD_BASE, MEMTXATTRS_UNSPECIFIED,
+                         image, image_size, 1);
+    }
+}
+
+/*
+ * Map the SecureROM read-only straight from its file, the same way the
+ * hardware sees it, so it needs neither a copy on every reset nor a
+ * place in the migration stream.  Dumps whose size is not a multiple of
+ * the host page size are copied into RAM instead.
+ */
+static void s8000_srom_setup(MachineState *machine)
+{
+    S8000MachineState *tms = S8000_MACHINE(machine);
+    MemoryRegion *mr;
+    struct stat st;
+    Error *err = NULL;
+
     if (machine->firmware == NULL) {
         error_report("Please set firmware to SecureROM's path");
         exit(EXIT_FAILURE);
     }
 
-    if (!g_file_get_contents(machine->firmware, &securerom, &fsize, NULL)) {
+    if (stat(machine->firmware, &st)) {
         error_report("Could not load data from file '%s'", machine->firmware);
         exit(EXIT_FAILURE);
     }
-    address_space_rw(nsas, S8000_SROM_BASE, MEMTXATTRS_UNSPECIFIED,
-                     (uint8_t *)securerom, fsize, 1);
+    if (st.st_size > S8000_SROM_SIZE) {
+        error_report("SecureROM '%s' is larger than 0x%llx bytes",
+                     machine->firmware, S8000_SROM_SIZE);
+        exit(EXIT_FAILURE);
+    }
+    if (!st.st_size
+        || !QEMU_IS_ALIGNED(st.st_size, qemu_real_host_page_size())) {
+        return;
+    }
+
+    mr = g_new(MemoryRegion, 1);
+    memory_region_init_ram_from_file(mr, NULL, "SROM.file", st.st_size, 0, 0,
+                                     machine->firmware, true, &err);
+    if (err) {
+        warn_report_err(err);
+        g_free(mr);
+        return;
+    }
+    memory_region_set_readonly(mr, true);
+    qemu_ram_unset_migratable(mr->ram_block);
+    memory_region_add_subregion_overlap(tms->sysmem, S8000_SROM_BASE, mr, 1);
+    tms->srom_mapped = true;
 }
 
 static void pmgr_unk_reg_write(void *opaque, hwaddr addr, uint64_t data, unsigned size)
@@ -703,7 +766,8 @@ static void apple_a9_reset(void *opaque)
                 found_first = true;
                 cs = CPU(first_cpu);
                 env = &ARM_CPU(cs)->env;
-                env->pc = S8000_SROM_BASE;
+                env->pc = tms->dfu_image ? S8000_DFU_LOAD_BASE
+                                         : S8000_SROM_BASE;
             }
         }
     }
@@ -748,6 +812,7 @@ static void s8000_machine_init(MachineState *machine)
     allocate_ram(tms->sysmem, "SROM", S8000_SROM_BASE, S8000_SROM_SIZE, 0);
     allocate_ram(tms->sysmem, "SRAM", S8000_SRAM_BASE, S8000_SRAM_SIZE, 0);
     allocate_ram(tms->sysmem, "DRAM", S8000_DRAM_BASE, machine->ram_size, 0);
+    s8000_srom_setup(machine);
 
     tms->device_tree = load_dtb_from_file(machine->dtb);
     child = find_dtb_node(tms->device_tree, "arm-io");
@@ -811,6 +876,21 @@ static char *s8000_get_force_dfu(Object *obj, Error **errp)
     return g_strdup(tms->force_dfu ? "true" : "false");
 }
 
+static void s8000_set_dfu_image(Object *obj, const char *value, Error **errp)
+{
+    S8000MachineState *tms = S8000_MACHINE(obj);
+
+    g_free(tms->dfu_image);
+    tms->dfu_image = *value ? g_strdup(value) : NULL;
+}
+
+static char *s8000_get_dfu_image(Object *obj, Error **errp)
+{
+    S8000MachineState *tms = S8000_MACHINE(obj);
+
+    return g_strdup(tms->dfu_image ? tms->dfu_image : "");
+}
+
 static void s8000_machine_class_init(ObjectClass *klass, void *data)
 {
     MachineClass *mc = MACHINE_CLASS(klass);
@@ -833,6 +913,13 @@ static void s8000_machine_class_init(ObjectClass *klass, void *data)
                                   s8000_set_force_dfu);
     object_class_property_set_description(klass, "force-dfu",
                                           "Set FORCE_DFU pin state");
+    object_class_property_add_str(klass, "dfu-image",
+                                  s8000_get_dfu_image,
+                                  s8000_set_dfu_image);
+    object_class_property_set_description(klass, "dfu-image",
+                                          "Decrypted iBSS/iBEC (IM4P or raw) "
+                                          "to start instead of going through "
+                                          "SecureROM DFU");
 }
 
 static const TypeInfo s8000_machine_info = {
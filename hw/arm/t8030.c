@@ -65,8 +65,10 @@
 #include "hw/ssi/ssi.h"
 #include "hw/ssi/apple_spi.h"
 #include "hw/char/apple_uart.h"
+#include "hw/misc/apple_boot_trace.h"
 
 #include "hw/arm/xnu_pf.h"
+#include "hw/arm/xnu_snapshot.h"
 #include "hw/display/m1_fb.h"
 
 #define T8030_DRAM_BASE         (0x800000000)
@@ -197,6 +199,56 @@ static bool t8030_check_panic(MachineState *machine)
     return panic_info->eph_magic == EMBEDDED_PANIC_MAGIC;
 }
 
+#ifdef CONFIG_TCG
+typedef struct T8030BootMilestone {
+    const char *symbol;
+    bool hit;
+} T8030BootMilestone;
+
+/* Kernel milestones shown on the guest track of the boot timeline */
+static T8030BootMilestone t8030_boot_milestones[] = {
+    { "_arm_init" },
+    { "_machine_startup" },
+    { "_kernel_bootstrap" },
+    { "_PE_init_iokit" },
+    { "_bsd_init" },
+    { "_load_init_program" },
+};
+
+static void t8030_boot_milestone_hook(ARMCPU *cpu, uint64_t pc, void *opaque)
+{
+    T8030BootMilestone *m = opaque;
+
+    if (!qatomic_xchg(&m->hit, true)) {
+        apple_boot_trace_instant(APPLE_BOOT_TRACE_GUEST, m->symbol + 1);
+    }
+}
+#endif
+
+static void t8030_boot_trace_milestones(T8030MachineState *tms,
+                                        hwaddr slide_virt)
+{
+#ifdef CONFIG_TCG
+    int i;
+
+    if (!apple_boot_trace_enabled()) {
+        return;
+    }
+
+    arm_remove_pc_hooks(t8030_boot_milestone_hook);
+    for (i = 0; i < ARRAY_SIZE(t8030_boot_milestones); i++) {
+        T8030BootMilestone *m = &t8030_boot_milestones[i];
+        uint64_t va = macho_find_symbol(tms->kernel, m->symbol);
+
+        m->hit = false;
+        if (va) {
+            arm_register_pc_hook(va + slide_virt, t8030_boot_milestone_hook,
+                                 m);
+        }
+    }
+#endif
+}
+
 static size_t get_kaslr_random()
 {
     size_t value = 0;
@@ -291,6 +343,7 @@ static void t8030_load_classic_kc(T8030MachineState *tms, const char *cmdline)
                     "slide_phys: 0x" TARGET_FMT_lx "\n",
                     slide_virt, slide_phys);
     fprintf(stderr, "entry: 0x" TARGET_FMT_lx "\n", info->entry);
+    t8030_boot_trace_milestones(tms, slide_virt);
 
     virt_end += slide_virt;
     phys_ptr = vtop_static(align_16k_high(virt_end));
@@ -410,6 +463,7 @@ static void t8030_load_fileset_kc(T8030MachineState *tms, const char *cmdline)
                     "slide_phys: 0x" TARGET_FMT_lx "\n",
                     slide_virt, slide_phys);
     fprintf(stderr, "entry: 0x" TARGET_FMT_lx "\n", info->entry);
+    t8030_boot_trace_milestones(tms, slide_virt);
 
     virt_end += slide_virt;
     phys_ptr = vtop_static(align_16k_high(virt_end));
@@ -459,6 +513,8 @@ static void t8030_memory_setup(MachineState *machine)
     macho_boot_info_t info = &tms->bootinfo;
     DTBNode *memory_map = get_dtb_node(tms->device_tree, "/chosen/memory-map");
     g_autofree char *cmdline = NULL;
+    int64_t setup_start = apple_boot_trace_now();
+    int64_t phase_start;
 
 
     #if 0
@@ -478,6 +534,7 @@ static void t8030_memory_setup(MachineState *machine)
     info->dram_base = T8030_DRAM_BASE;
     info->dram_size = T8030_DRAM_SIZE;
 
+    phase_start = apple_boot_trace_now();
     nvram = APPLE_NVRAM(qdev_find_recursive(sysbus_get_default(), "nvram"));
     if (!nvram) {
         error_setg(&error_abort, "%s: Failed to find nvram device", __func__);
@@ -521,6 +578,7 @@ static void t8030_memory_setup(MachineState *machine)
     if (apple_nvram_serialize(nvram, info->nvram_data, sizeof(info->nvram_data)) < 0) {
         error_report("%s: Failed to read NVRAM", __func__);
     }
+    apple_boot_trace_complete(APPLE_BOOT_TRACE_MACHINE, "nvram", phase_start);
 
     if (tms->ticket_filename) {
         if (!g_file_get_contents(tms->ticket_filename, &info->ticket_data, (gsize *)&info->ticket_length, NULL)) {
@@ -576,8 +634,12 @@ static void t8030_memory_setup(MachineState *machine)
 
     macho_allocate_segment_records(memory_map, hdr);
 
+    phase_start = apple_boot_trace_now();
     macho_populate_dtb(tms->device_tree, info);
+    apple_boot_trace_complete(APPLE_BOOT_TRACE_MACHINE, "dtb_populate",
+                              phase_start);
 
+    phase_start = apple_boot_trace_now();
     switch (hdr->filetype) {
     case MH_EXECUTE:
         t8030_load_classic_kc(tms, cmdline);
@@ -590,6 +652,10 @@ static void t8030_memory_setup(MachineState *machine)
                    __func__, hdr->filetype);                
         break;
     }
+    apple_boot_trace_complete(APPLE_BOOT_TRACE_MACHINE, "kernelcache_load",
+                              phase_start);
+    apple_boot_trace_complete(APPLE_BOOT_TRACE_MACHINE, "memory_setup",
+                              setup_start);
 }
 
 static void pmgr_unk_reg_write(void *opaque, hwaddr addr, uint64_t data, unsigned size)
@@ -693,11 +759,32 @@ static void t8030_cluster_realize(MachineState *machine)
 {
     T8030MachineState *tms = T8030_MACHINE(machine);
     for (int i = 0; i < A13_MAX_CLUSTER; i++) {
+        Object *cluster = OBJECT(&tms->clusters[i]);
+
         qdev_realize(DEVICE(&tms->clusters[i]), NULL, &error_fatal);
         if (tms->clusters[i].base) {
             memory_region_add_subregion(tms->sysmem, tms->clusters[i].base,
                                         &tms->clusters[i].mr);
         }
+
+        switch (tms->clusters[i].cluster_type) {
+        case 'E':
+            if (tms->ecluster_host_cpus) {
+                object_property_set_str(cluster, "host-cpus",
+                                        tms->ecluster_host_cpus, &error_fatal);
+            }
+            object_property_set_uint(cluster, "throttle",
+                                     tms->ecluster_throttle, &error_fatal);
+            break;
+        case 'P':
+            if (tms->pcluster_host_cpus) {
+                object_property_set_str(cluster, "host-cpus",
+                                        tms->pcluster_host_cpus, &error_fatal);
+            }
+            break;
+        default:
+            break;
+        }
     }
 }
 
@@ -1666,12 +1753,26 @@ static void t8030_machine_init(MachineState *machine)
     DTBNode *child;
     DTBProp *prop;
     hwaddr *ranges;
+    MemoryRegion *dram;
+    int64_t init_start, phase_start;
+
+    if (tms->boot_trace_filename) {
+        apple_boot_trace_start(tms->boot_trace_filename);
+    }
+    init_start = apple_boot_trace_now();
 
     tms->sysmem = get_system_memory();
-    allocate_ram(tms->sysmem, "DRAM", T8030_DRAM_BASE, T8030_DRAM_SIZE, 0);
+    dram = allocate_ram(tms->sysmem, "DRAM", T8030_DRAM_BASE,
+                        T8030_DRAM_SIZE, 0);
+    if (tms->dram_snapshot) {
+        xnu_snapshot_init(dram, tms->dram_snapshot, &error_fatal);
+    }
 
+    phase_start = apple_boot_trace_now();
     hdr = macho_load_file(machine->kernel_filename);
     assert(hdr);
+    apple_boot_trace_complete(APPLE_BOOT_TRACE_MACHINE, "im4p_decode",
+                              phase_start);
     tms->kernel = hdr;
     xnu_header = hdr;
     build_version = macho_build_version(hdr);
@@ -1705,8 +1806,12 @@ static void t8030_machine_init(MachineState *machine)
     g_virt_base = kernel_low;
     g_phys_base = (hwaddr)macho_get_buffer(hdr);
 
+    phase_start = apple_boot_trace_now();
     t8030_patch_kernel(hdr);
+    apple_boot_trace_complete(APPLE_BOOT_TRACE_MACHINE, "xnu_kpf",
+                              phase_start);
 
+    phase_start = apple_boot_trace_now();
     tms->device_tree = load_dtb_from_file(machine->dtb);
     tms->trustcache = load_trustcache_from_file(tms->trustcache_filename,
                                                 &tms->bootinfo.trustcache_size);
@@ -1768,7 +1873,10 @@ static void t8030_machine_init(MachineState *machine)
     child = get_dtb_node(tms->device_tree, "product");
     /* TODO: SEP, iOS 15 data encryption */
     set_dtb_prop(child, "product-name", 8, "FastSim");
+    apple_boot_trace_complete(APPLE_BOOT_TRACE_MACHINE, "dtb_setup",
+                              phase_start);
 
+    phase_start = apple_boot_trace_now();
     t8030_cpu_setup(machine);
 
     t8030_create_aic(machine);
@@ -1816,9 +1924,13 @@ static void t8030_machine_init(MachineState *machine)
     }
 
     t8030_create_boot_display(machine);
+    apple_boot_trace_complete(APPLE_BOOT_TRACE_MACHINE, "devices",
+                              phase_start);
 
     tms->init_done_notifier.notify = t8030_machine_init_done;
     qemu_add_machine_init_done_notifier(&tms->init_done_notifier);
+    apple_boot_trace_complete(APPLE_BOOT_TRACE_MACHINE, "machine_init",
+                              init_start);
 }
 
 static void t8030_set_trustcache_filename(Object *obj, const char *value, Error **errp)
@@ -1948,6 +2060,93 @@ static bool t8030_get_kaslr_off(Object *obj, Error **errp)
     return tms->kaslr_off;
 }
 
+static void t8030_set_ecluster_host_cpus(Object *obj, const char *value,
+                                         Error **errp)
+{
+    T8030MachineState *tms = T8030_MACHINE(obj);
+
+    g_free(tms->ecluster_host_cpus);
+    tms->ecluster_host_cpus = g_strdup(value);
+}
+
+static char *t8030_get_ecluster_host_cpus(Object *obj, Error **errp)
+{
+    T8030MachineState *tms = T8030_MACHINE(obj);
+
+    return g_strdup(tms->ecluster_host_cpus);
+}
+
+static void t8030_set_pcluster_host_cpus(Object *obj, const char *value,
+                                         Error **errp)
+{
+    T8030MachineState *tms = T8030_MACHINE(obj);
+
+    g_free(tms->pcluster_host_cpus);
+    tms->pcluster_host_cpus = g_strdup(value);
+}
+
+static char *t8030_get_pcluster_host_cpus(Object *obj, Error **errp)
+{
+    T8030MachineState *tms = T8030_MACHINE(obj);
+
+    return g_strdup(tms->pcluster_host_cpus);
+}
+
+static void t8030_set_boot_trace(Object *obj, const char *value, Error **errp)
+{
+    T8030MachineState *tms = T8030_MACHINE(obj);
+
+    g_free(tms->boot_trace_filename);
+    tms->boot_trace_filename = g_strdup(value);
+}
+
+static char *t8030_get_boot_trace(Object *obj, Error **errp)
+{
+    T8030MachineState *tms = T8030_MACHINE(obj);
+
+    return g_strdup(tms->boot_trace_filename);
+}
+
+static void t8030_set_dram_snapshot(Object *obj, const char *value,
+                                    Error **errp)
+{
+    T8030MachineState *tms = T8030_MACHINE(obj);
+
+    g_free(tms->dram_snapshot);
+    tms->dram_snapshot = g_strdup(value);
+}
+
+static char *t8030_get_dram_snapshot(Object *obj, Error **errp)
+{
+    T8030MachineState *tms = T8030_MACHINE(obj);
+
+    return g_strdup(tms->dram_snapshot);
+}
+
+static void t8030_get_ecluster_throttle(Object *obj, Visitor *v,
+                                        const char *name, void *opaque,
+                                        Error **errp)
+{
+    T8030MachineState *tms = T8030_MACHINE(obj);
+    uint32_t value = tms->ecluster_throttle;
+
+    visit_type_uint32(v, name, &value, errp);
+}
+
+static void t8030_set_ecluster_throttle(Object *obj, Visitor *v,
+                                        const char *name, void *opaque,
+                                        Error **errp)
+{
+    T8030MachineState *tms = T8030_MACHINE(obj);
+    uint32_t value;
+
+    if (!visit_type_uint32(v, name, &value, errp)) {
+        return;
+    }
+
+    tms->ecluster_throttle = value;
+}
+
 static ram_addr_t t8030_machine_fixup_ram_size(ram_addr_t size)
 {
     if (size != T8030_DRAM_SIZE) {
@@ -2007,6 +2206,33 @@ static void t8030_machine_class_init(ObjectClass *oc, void *data)
                                   t8030_set_kaslr_off);
     object_class_property_set_description(oc, "kaslr-off",
                                           "Disable KASLR");
+    object_class_property_add_str(oc, "e-cluster-host-cpus",
+                                  t8030_get_ecluster_host_cpus,
+                                  t8030_set_ecluster_host_cpus);
+    object_class_property_set_description(oc, "e-cluster-host-cpus",
+        "Host CPUs to run the E-cluster vCPU threads on (MTTCG only)");
+    object_class_property_add_str(oc, "p-cluster-host-cpus",
+                                  t8030_get_pcluster_host_cpus,
+                                  t8030_set_pcluster_host_cpus);
+    object_class_property_set_description(oc, "p-cluster-host-cpus",
+        "Host CPUs to run the P-cluster vCPU threads on (MTTCG only)");
+    object_class_property_add(oc, "e-cluster-throttle", "uint32",
+        t8030_get_ecluster_throttle,
+        t8030_set_ecluster_throttle,
+        NULL, NULL);
+    object_class_property_set_description(oc, "e-cluster-throttle",
+        "Slow down E-cluster vCPUs by this percentage of host time");
+    object_class_property_add_str(oc, "boot-trace",
+                                  t8030_get_boot_trace,
+                                  t8030_set_boot_trace);
+    object_class_property_set_description(oc, "boot-trace",
+        "Write a Chrome trace of the boot phases to this file at exit");
+    object_class_property_add_str(oc, "dram-snapshot",
+                                  t8030_get_dram_snapshot,
+                                  t8030_set_dram_snapshot);
+    object_class_property_set_description(oc, "dram-snapshot",
+        "Save DRAM incrementally to <prefix>.<n> files instead of the "
+        "snapshot itself");
 }
 
 static const TypeInfo t8030_machine_info = {
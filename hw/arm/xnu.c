@@ -486,6 +486,17 @@ void macho_load_dtb(DTBNode *root, AddressSpace *as, MemoryRegion *mem,
     allocate_and_copy(mem, as, name, info->dtb_pa, info->dtb_size, buf);
 }
 
+uint8_t *load_im4p_payload_from_file(const char *filename, uint64_t *size)
+{
+    uint8_t *data = NULL;
+    uint32_t length = 0;
+    char payload_type[4];
+
+    extract_im4p_payload(filename, payload_type, &data, &length);
+    *size = length;
+    return data;
+}
+
 uint8_t *load_trustcache_from_file(const char *filename, uint64_t *size)
 {
     uint32_t *trustcache_data = NULL;
@@ -953,40 +964,100 @@ static struct section_64 *endsect(struct segment_command_64 *seg)
     return &sp[seg->nsects];
 }
 
-static void macho_process_symbols(struct mach_header_64 *mh, uint64_t slide)
+typedef void MachoSymbolFn(struct nlist_64 *sym, const char *name,
+                           void *opaque);
+
+/*
+ * Call @fn for every non-debug symbol in the symbol table of @mh. @base is
+ * where file offset 0 would be if __LINKEDIT were read from the file, so
+ * the table can be walked in the host image or in a copy of the segment.
+ * @name is NULL for symbols with an out of range string index.
+ */
+static void macho_for_each_symbol(struct mach_header_64 *mh, uint8_t *base,
+                                  MachoSymbolFn *fn, void *opaque)
 {
     struct load_command *cmd;
-    uint8_t *data = macho_get_buffer(mh);
-    uint64_t kernel_low, kernel_high;
     unsigned int index;
-    macho_highest_lowest(mh, &kernel_low, &kernel_high);
 
     cmd = (struct load_command *)((char *)mh + sizeof(struct mach_header_64));
     for (index = 0; index < mh->ncmds; index++) {
         if (cmd->cmd == LC_SYMTAB) {
             struct symtab_command *symtab = (struct symtab_command *)cmd;
-            struct segment_command_64 *linkedit_seg = macho_get_segment(mh, "__LINKEDIT");
-            void *base;
-            uint32_t off;
-            struct nlist_64 *sym;
-            if (linkedit_seg == NULL) {
-                fprintf(stderr, "%s: cannot find __LINKEDIT segment\n", __func__);
-                return;
-            }
-            base = (data + linkedit_seg->vmaddr - kernel_low);
-            off = linkedit_seg->fileoff;
-            sym = (struct nlist_64 *)(base + symtab->symoff - off);
+            struct nlist_64 *sym = (struct nlist_64 *)(base + symtab->symoff);
+            const char *strtab = (const char *)(base + symtab->stroff);
+
             for (int i = 0; i < symtab->nsyms; i++) {
                 if (sym[i].n_type & N_STAB) {
                     continue;
                 }
-                sym[i].n_value += slide;
+                fn(&sym[i], sym[i].n_un.n_strx < symtab->strsize ?
+                            strtab + sym[i].n_un.n_strx : NULL, opaque);
             }
         }
         cmd = (struct load_command *)((char *)cmd + cmd->cmdsize);
     }
 }
 
+static void macho_slide_symbol(struct nlist_64 *sym, const char *name,
+                               void *opaque)
+{
+    sym->n_value += *(uint64_t *)opaque;
+}
+
+/* name -> unslid address, built once per kernel by macho_find_symbol() */
+static GHashTable *macho_symbols;
+static struct mach_header_64 *macho_symbols_mh;
+
+static void macho_index_symbol(struct nlist_64 *sym, const char *name,
+                               void *opaque)
+{
+    GHashTable *symbols = opaque;
+
+    /* the first definition wins, as with a linear lookup */
+    if (name && !g_hash_table_contains(symbols, name)) {
+        g_hash_table_insert(symbols, (gpointer)name,
+                            g_memdup2(&sym->n_value, sizeof(sym->n_value)));
+    }
+}
+
+uint64_t macho_find_symbol(struct mach_header_64 *mh, const char *name)
+{
+    uint64_t *value;
+
+    if (macho_symbols_mh != mh) {
+        struct mach_header_64 *kernel = mh;
+        struct segment_command_64 *linkedit_seg;
+        uint8_t *data = macho_get_buffer(mh);
+        uint64_t kernel_low, kernel_high;
+
+        g_clear_pointer(&macho_symbols, g_hash_table_destroy);
+        macho_symbols_mh = NULL;
+
+        if (mh->filetype == MH_FILESET) {
+            kernel = macho_get_fileset_header(mh, "com.apple.kernel");
+            if (kernel == NULL) {
+                return 0;
+            }
+        }
+        macho_highest_lowest(mh, &kernel_low, &kernel_high);
+        linkedit_seg = macho_get_segment(kernel, "__LINKEDIT");
+        if (linkedit_seg == NULL) {
+            return 0;
+        }
+
+        macho_symbols = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                              NULL, g_free);
+        macho_for_each_symbol(kernel,
+                              data + linkedit_seg->vmaddr - kernel_low
+                              - linkedit_seg->fileoff,
+                              macho_index_symbol, macho_symbols);
+        macho_symbols_mh = mh;
+    }
+
+    value = g_hash_table_lookup(macho_symbols, name);
+    return value ? *value : 0;
+}
+
 void macho_allocate_segment_records(DTBNode *memory_map,
                                     struct mach_header_64 *mh)
 {
@@ -1019,6 +1090,85 @@ void macho_allocate_segment_records(DTBNode *memory_map,
     }
 }
 
+/*
+ * Apply the KASLR slide to @dst, a copy of segment @seg of @mh: non-lazy
+ * symbol pointers, the load commands at the start of __TEXT and the
+ * symbol table in __LINKEDIT.
+ */
+static void macho_slide_segment(struct mach_header_64 *mh,
+                                struct segment_command_64 *seg,
+                                uint8_t *dst, uint64_t slide)
+{
+    struct section_64 *sp;
+
+    for (sp = firstsect(seg); sp != endsect(seg); sp = nextsect(sp)) {
+        if ((sp->flags & SECTION_TYPE) == S_NON_LAZY_SYMBOL_POINTERS) {
+            uint64_t *nl_symbol_ptr = (uint64_t *)(dst + sp->addr
+                                                   - seg->vmaddr);
+            uint64_t i;
+
+            for (i = 0; i < sp->size / sizeof(uint64_t); i++) {
+                nl_symbol_ptr[i] += slide;
+            }
+        }
+    }
+
+    if (strcmp(seg->segname, "__TEXT") == 0) {
+        struct mach_header_64 *text_mh = (struct mach_header_64 *)dst;
+        struct segment_command_64 *text_seg;
+
+        assert(text_mh->magic == MACH_MAGIC_64);
+        for (text_seg = macho_get_firstseg(text_mh); text_seg != NULL;
+             text_seg = macho_get_nextseg(text_mh, text_seg)) {
+            text_seg->vmaddr += slide;
+            for (sp = firstsect(text_seg); sp != endsect(text_seg);
+                 sp = nextsect(sp)) {
+                sp->addr += slide;
+            }
+        }
+    } else if (strcmp(seg->segname, "__LINKEDIT") == 0) {
+        macho_for_each_symbol(mh, dst - seg->fileoff, macho_slide_symbol,
+                              &slide);
+    }
+}
+
+/*
+ * Copy segment @seg from the host image at @src into guest memory at @pa.
+ * The slide is applied to the guest's copy only, in place when the
+ * destination is plain RAM, so the host image never has to be slid and
+ * unslid again.
+ */
+static void macho_load_segment(struct mach_header_64 *mh,
+                               struct segment_command_64 *seg,
+                               AddressSpace *as, hwaddr pa,
+                               const uint8_t *src, uint64_t slide)
+{
+    hwaddr len = seg->vmsize;
+    uint8_t *dst;
+
+    if (!slide) {
+        address_space_write(as, pa, MEMTXATTRS_UNSPECIFIED, src, len);
+        return;
+    }
+
+    dst = address_space_map(as, pa, &len, true, MEMTXATTRS_UNSPECIFIED);
+    if (dst && len == seg->vmsize) {
+        memcpy(dst, src, len);
+        macho_slide_segment(mh, seg, dst, slide);
+        address_space_unmap(as, dst, len, true, len);
+        return;
+    }
+    if (dst) {
+        address_space_unmap(as, dst, len, false, 0);
+    }
+
+    /* not a single RAM block, go through a bounce copy */
+    dst = g_memdup2(src, seg->vmsize);
+    macho_slide_segment(mh, seg, dst, slide);
+    address_space_write(as, pa, MEMTXATTRS_UNSPECIFIED, dst, seg->vmsize);
+    g_free(dst);
+}
+
 hwaddr arm_load_macho(struct mach_header_64 *mh, AddressSpace *as, MemoryRegion *mem,
                       DTBNode *memory_map, hwaddr phys_base, uint64_t virt_slide)
 {
@@ -1032,9 +1182,6 @@ hwaddr arm_load_macho(struct mach_header_64 *mh, AddressSpace *as, MemoryRegion
     bool is_fileset = mh->filetype == MH_FILESET;
 
     cmd = (struct load_command *)((char *)mh + sizeof(struct mach_header_64));
-    if (!is_fileset) {
-        macho_process_symbols(mh, virt_slide);
-    }
     for (index = 0; index < mh->ncmds; index++) {
         switch (cmd->cmd) {
         case LC_SEGMENT_64: {
@@ -1056,76 +1203,11 @@ hwaddr arm_load_macho(struct mach_header_64 *mh, AddressSpace *as, MemoryRegion
                 break;
             }
 
-            if (!is_fileset) {
-                 struct section_64 *sp;
-                 for (sp = firstsect(segCmd); sp != endsect(segCmd); sp = nextsect(sp)) {
-                    if ((sp->flags & SECTION_TYPE) == S_NON_LAZY_SYMBOL_POINTERS) {
-                        void *load_from = (void *)(data + sp->addr - kernel_low);
-                        void **nl_symbol_ptr;
-                        for (nl_symbol_ptr = load_from;
-                             nl_symbol_ptr < (void **)(load_from + sp->size);
-                             nl_symbol_ptr++) {
-                             *nl_symbol_ptr += virt_slide;
-                        }
-                    }
-                 }
-            }
-
-            if (!is_fileset) {
-                if (strcmp(segCmd->segname, "__TEXT") == 0) {
-                    struct mach_header_64 *mh = load_from;
-                    struct segment_command_64 *seg;
-                    assert(mh->magic == MACH_MAGIC_64);
-                    for (seg = macho_get_firstseg(mh); seg != NULL;
-                         seg = macho_get_nextseg(mh, seg)) {
-                         struct section_64 *sp;
-                         seg->vmaddr += virt_slide;
-                         for (sp = firstsect(seg); sp != endsect(seg); sp = nextsect(sp)) {
-                            sp->addr += virt_slide;
-                         }
-                    }
-
-                }
-            }
-
-
             #if 0
             fprintf(stderr, "%s: Loading %s to 0x%llx \n", __func__, region_name, load_to);
             #endif
-            allocate_and_copy(mem, as, region_name,
-                              load_to, segCmd->vmsize,
-                              load_from);
-
-            if (!is_fileset) {
-                if (strcmp(segCmd->segname, "__TEXT") == 0) {
-                    struct mach_header_64 *mh = load_from;
-                    struct segment_command_64 *seg;
-                    for (seg = macho_get_firstseg(mh); seg != NULL;
-                         seg = macho_get_nextseg(mh, seg)) {
-                         struct section_64 *sp;
-                         seg->vmaddr -= virt_slide;
-                         for (sp = firstsect(seg); sp != endsect(seg); sp = nextsect(sp)) {
-                            sp->addr -= virt_slide;
-                         }
-                    }
-
-                }
-            }
-
-            if (!is_fileset) {
-                 struct section_64 *sp;
-                 for (sp = firstsect(segCmd); sp != endsect(segCmd); sp = nextsect(sp)) {
-                    if ((sp->flags & SECTION_TYPE) == S_NON_LAZY_SYMBOL_POINTERS) {
-                        void *load_from = (void *)(data + sp->addr - kernel_low);
-                        void **nl_symbol_ptr;
-                        for (nl_symbol_ptr = load_from;
-                             nl_symbol_ptr < (void **)(load_from + sp->size);
-                             nl_symbol_ptr++) {
-                             *nl_symbol_ptr -= virt_slide;
-                        }
-                    }
-                 }
-            }
+            macho_load_segment(mh, segCmd, as, load_to, load_from,
+                               is_fileset ? 0 : virt_slide);
             break;
         }
 
@@ -1146,10 +1228,6 @@ hwaddr arm_load_macho(struct mach_header_64 *mh, AddressSpace *as, MemoryRegion
         cmd = (struct load_command *)((char *)cmd + cmd->cmdsize);
     }
 
-    if (!is_fileset) {
-        macho_process_symbols(mh, -virt_slide);
-    }
-
     return pc;
 }
 
@@ -1165,6 +1243,10 @@ uint8_t *macho_get_buffer(struct mach_header_64 *hdr)
 
 void macho_free(struct mach_header_64 *hdr)
 {
+    if (macho_symbols_mh == hdr) {
+        g_clear_pointer(&macho_symbols, g_hash_table_destroy);
+        macho_symbols_mh = NULL;
+    }
     g_free(macho_get_buffer(hdr));
 }
 
@@ -101,10 +101,11 @@ hwaddr get_low_bits_mask_for_bit_index(uint8_t bit_index)
     return (1 << bit_index) - 1;
 }
 
-void allocate_ram(MemoryRegion *top, const char *name, hwaddr addr,
-                  hwaddr size, int priority)
+MemoryRegion *allocate_ram(MemoryRegion *top, const char *name, hwaddr addr,
+                           hwaddr size, int priority)
 {
     MemoryRegion *sec = g_new(MemoryRegion, 1);
     memory_region_init_ram(sec, NULL, name, size, &error_fatal);
     memory_region_add_subregion_overlap(top, addr, sec, priority);
+    return sec;
 }
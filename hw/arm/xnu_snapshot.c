@@ -0,0 +1,643 @@
+/*
+ * Incremental DRAM snapshots
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qemu/bitmap.h"
+#include "qemu/bitops.h"
+#include "qemu/cutils.h"
+#include "qemu/error-report.h"
+#include "qemu/thread.h"
+#include "qemu/timer.h"
+#include "exec/exec-all.h"
+#include "exec/ram_addr.h"
+#include "migration/vmstate.h"
+#include "sysemu/runstate.h"
+#include "sysemu/sysemu.h"
+#include "sysemu/tcg.h"
+#include "hw/core/cpu.h"
+#include "hw/arm/xnu_snapshot.h"
+#include "trace.h"
+
+#define XNU_SNAPSHOT_MAGIC      "XNUDRAM"
+#define XNU_SNAPSHOT_HINT_MAGIC "XNUHINT"
+#define XNU_SNAPSHOT_VERSION    1
+
+/*
+ * Every run of pages mapped from a link is a separate VMA; past this many
+ * the remaining runs of a restore are copied instead so that we stay well
+ * below vm.max_map_count.
+ */
+#define XNU_SNAPSHOT_MAX_MAPPINGS 32768
+
+/*
+ * On-disk link header, little endian.  It is followed by the dirty page
+ * bitmap (deltas only) and, from @data_offset on, by the page data.  The
+ * base link stores the whole region 1:1 so it can be mapped in one go;
+ * deltas store the dirty pages back to back in bitmap order.
+ *
+ * The prefetch hint uses the same header followed by the bitmap of pages
+ * touched after the last restore of the previous run.
+ */
+typedef struct QEMU_PACKED XNUSnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t page_size;
+    uint64_t ram_size;
+    uint64_t generation;
+    uint64_t id;
+    uint64_t parent_id;
+    uint64_t nr_pages;
+    uint64_t data_offset;
+} XNUSnapshotHeader;
+
+typedef struct XNUSnapshot {
+    MemoryRegion *dram;
+    char *prefix;
+    uint64_t page_size;
+    uint64_t nr_pages;
+    /* Last link written or restored, none if @id is 0 */
+    uint64_t generation;
+    uint64_t id;
+    bool restored;
+    /* Bumped on every restore to stop a prefetch of the previous one */
+    unsigned prefetch_epoch;
+    Notifier exit_notifier;
+} XNUSnapshot;
+
+typedef struct XNUSnapshotPrefetch {
+    XNUSnapshot *s;
+    unsigned long *pages;
+    unsigned epoch;
+} XNUSnapshotPrefetch;
+
+static int xnu_snapshot_pwrite(int fd, const uint8_t *buf, uint64_t len,
+                               uint64_t offset)
+{
+    while (len) {
+        ssize_t ret = pwrite(fd, buf, len, offset);
+
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -errno;
+        }
+        buf += ret;
+        len -= ret;
+        offset += ret;
+    }
+    return 0;
+}
+
+static int xnu_snapshot_pread(int fd, uint8_t *buf, uint64_t len,
+                              uint64_t offset)
+{
+    while (len) {
+        ssize_t ret = pread(fd, buf, len, offset);
+
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -errno;
+        }
+        if (ret == 0) {
+            return -EIO;
+        }
+        buf += ret;
+        len -= ret;
+        offset += ret;
+    }
+    return 0;
+}
+
+static uint64_t xnu_snapshot_new_id(void)
+{
+    uint64_t id;
+
+    do {
+        id = ((uint64_t)g_random_int() << 32) | g_random_int();
+    } while (!id);
+    return id;
+}
+
+static char *xnu_snapshot_path(XNUSnapshot *s, uint64_t generation)
+{
+    return g_strdup_printf("%s.%" PRIu64, s->prefix, generation);
+}
+
+static int xnu_snapshot_checkpoint(XNUSnapshot *s, Error **errp)
+{
+    bool base = s->id == 0;
+    uint64_t generation = base ? 0 : s->generation + 1;
+    uint64_t ps = s->page_size;
+    uint64_t bits = ROUND_UP(s->nr_pages, 64);
+    uint64_t bitmap_bytes = base ? 0 : bits / BITS_PER_BYTE;
+    g_autofree unsigned long *pages = bitmap_new(bits);
+    g_autofree char *path = xnu_snapshot_path(s, generation);
+    g_autofree char *tmp = g_strdup_printf("%s.tmp", path);
+    uint8_t *host = memory_region_get_ram_ptr(s->dram);
+    DirtyBitmapSnapshot *snap;
+    XNUSnapshotHeader hdr = { 0 };
+    uint64_t data_offset, nr_pages, rank = 0, id, i, end = 0;
+    int64_t start_ns = get_clock();
+    int fd, ret = 0;
+
+    snap = memory_region_snapshot_and_clear_dirty(s->dram, 0,
+                                                  memory_region_size(s->dram),
+                                                  DIRTY_MEMORY_VGA);
+    for (i = 0; i < s->nr_pages; i++) {
+        if (base ? !buffer_is_zero(host + i * ps, ps)
+                 : memory_region_snapshot_get_dirty(s->dram, snap, i * ps, ps)) {
+            set_bit(i, pages);
+        }
+    }
+    g_free(snap);
+
+    nr_pages = bitmap_count_one(pages, s->nr_pages);
+    data_offset = ROUND_UP(sizeof(hdr) + bitmap_bytes, ps);
+
+    fd = qemu_create(tmp, O_RDWR | O_TRUNC | O_BINARY, 0644, errp);
+    if (fd < 0) {
+        ret = -EIO;
+        goto fail;
+    }
+    if (ftruncate(fd, data_offset + (base ? s->nr_pages : nr_pages) * ps)) {
+        ret = -errno;
+        goto fail_write;
+    }
+
+    if (!base) {
+        g_autofree unsigned long *le = bitmap_new(bits);
+
+        bitmap_to_le(le, pages, bits);
+        ret = xnu_snapshot_pwrite(fd, (uint8_t *)le, bitmap_bytes,
+                                  sizeof(hdr));
+        if (ret < 0) {
+            goto fail_write;
+        }
+    }
+
+    /* Zero pages of the base are left as holes */
+    for (i = find_first_bit(pages, s->nr_pages); i < s->nr_pages;
+         i = find_next_bit(pages, s->nr_pages, end)) {
+        end = find_next_zero_bit(pages, s->nr_pages, i);
+        ret = xnu_snapshot_pwrite(fd, host + i * ps, (end - i) * ps,
+                                  data_offset + (base ? i : rank) * ps);
+        if (ret < 0) {
+            goto fail_write;
+        }
+        rank += end - i;
+    }
+
+    id = xnu_snapshot_new_id();
+    memcpy(hdr.magic, XNU_SNAPSHOT_MAGIC, sizeof(hdr.magic));
+    hdr.version = cpu_to_le32(XNU_SNAPSHOT_VERSION);
+    hdr.page_size = cpu_to_le32(ps);
+    hdr.ram_size = cpu_to_le64(memory_region_size(s->dram));
+    hdr.generation = cpu_to_le64(generation);
+    hdr.id = cpu_to_le64(id);
+    hdr.parent_id = cpu_to_le64(base ? 0 : s->id);
+    hdr.nr_pages = cpu_to_le64(nr_pages);
+    hdr.data_offset = cpu_to_le64(data_offset);
+    ret = xnu_snapshot_pwrite(fd, (uint8_t *)&hdr, sizeof(hdr), 0);
+    if (ret < 0) {
+        goto fail_write;
+    }
+    if (qemu_fdatasync(fd) < 0) {
+        ret = -errno;
+        goto fail_write;
+    }
+    close(fd);
+
+    if (rename(tmp, path)) {
+        ret = -errno;
+        error_setg_errno(errp, -ret, "Cannot rename %s to %s", tmp, path);
+        unlink(tmp);
+        goto fail;
+    }
+
+    s->generation = generation;
+    s->id = id;
+    trace_xnu_snapshot_checkpoint(generation, nr_pages,
+                                  get_clock() - start_ns);
+    return 0;
+
+fail_write:
+    error_setg_errno(errp, -ret, "Cannot write DRAM snapshot %s", tmp);
+    close(fd);
+    unlink(tmp);
+fail:
+    /*
+     * The dirty log has already been cleared; hand the pages back so the
+     * next delta still contains them.  A failed base is simply retried.
+     */
+    if (!base) {
+        ram_addr_t ram_addr = memory_region_get_ram_addr(s->dram);
+
+        for (i = find_first_bit(pages, s->nr_pages); i < s->nr_pages;
+             i = find_next_bit(pages, s->nr_pages, end)) {
+            end = find_next_zero_bit(pages, s->nr_pages, i);
+            cpu_physical_memory_set_dirty_range(ram_addr + i * ps,
+                                                (end - i) * ps,
+                                                1 << DIRTY_MEMORY_VGA);
+        }
+    }
+    return ret;
+}
+
+static int xnu_snapshot_open(XNUSnapshot *s, uint64_t generation,
+                             XNUSnapshotHeader *hdr, Error **errp)
+{
+    g_autofree char *path = xnu_snapshot_path(s, generation);
+    uint64_t ram_size = memory_region_size(s->dram);
+    uint64_t data_size;
+    struct stat st;
+    int fd, ret;
+
+    fd = qemu_open(path, O_RDONLY | O_BINARY, errp);
+    if (fd < 0) {
+        return -1;
+    }
+
+    ret = xnu_snapshot_pread(fd, (uint8_t *)hdr, sizeof(*hdr), 0);
+    if (ret < 0) {
+        error_setg_errno(errp, -ret, "Cannot read DRAM snapshot %s", path);
+        goto fail;
+    }
+    hdr->version = le32_to_cpu(hdr->version);
+    hdr->page_size = le32_to_cpu(hdr->page_size);
+    hdr->ram_size = le64_to_cpu(hdr->ram_size);
+    hdr->generation = le64_to_cpu(hdr->generation);
+    hdr->id = le64_to_cpu(hdr->id);
+    hdr->parent_id = le64_to_cpu(hdr->parent_id);
+    hdr->nr_pages = le64_to_cpu(hdr->nr_pages);
+    hdr->data_offset = le64_to_cpu(hdr->data_offset);
+
+    if (memcmp(hdr->magic, XNU_SNAPSHOT_MAGIC, sizeof(hdr->magic)) ||
+        hdr->version != XNU_SNAPSHOT_VERSION) {
+        error_setg(errp, "%s is not a DRAM snapshot", path);
+        goto fail;
+    }
+    if (hdr->generation != generation || hdr->ram_size != ram_size ||
+        !hdr->page_size || ram_size % hdr->page_size) {
+        error_setg(errp, "DRAM snapshot %s does not match this machine", path);
+        goto fail;
+    }
+
+    data_size = (generation ? hdr->nr_pages * hdr->page_size : ram_size);
+    if (fstat(fd, &st) || (uint64_t)st.st_size < hdr->data_offset + data_size) {
+        error_setg(errp, "DRAM snapshot %s is truncated", path);
+        goto fail;
+    }
+    return fd;
+
+fail:
+    close(fd);
+    return -1;
+}
+
+/*
+ * Make [@offset, @offset + @len) of DRAM read from @fd at @file_offset.
+ * The range is mapped privately when the layout allows it, so nothing is
+ * read until the guest touches a page, and copied otherwise.
+ */
+static int xnu_snapshot_map(XNUSnapshot *s, int fd, uint64_t file_offset,
+                            uint64_t offset, uint64_t len, uint32_t page_size,
+                            unsigned *mappings)
+{
+    uint8_t *host = (uint8_t *)memory_region_get_ram_ptr(s->dram) + offset;
+    uint64_t host_page_size = qemu_real_host_page_size();
+
+    if (*mappings < XNU_SNAPSHOT_MAX_MAPPINGS &&
+        page_size % host_page_size == 0 &&
+        file_offset % host_page_size == 0) {
+        if (mmap(host, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED,
+                 fd, file_offset) != MAP_FAILED) {
+            (*mappings)++;
+            return 0;
+        }
+    }
+    return xnu_snapshot_pread(fd, host, len, file_offset);
+}
+
+static char *xnu_snapshot_hint_path(XNUSnapshot *s)
+{
+    return g_strdup_printf("%s.hint", s->prefix);
+}
+
+static void *xnu_snapshot_prefetch_thread(void *opaque)
+{
+    XNUSnapshotPrefetch *p = opaque;
+    XNUSnapshot *s = p->s;
+    uint8_t *host = memory_region_get_ram_ptr(s->dram);
+    uint64_t runs = 0, i, end = 0;
+
+    /*
+     * Only start readahead of the backing links; the PTEs are left to the
+     * guest so that the next hint still reflects what it really touched.
+     */
+    for (i = find_first_bit(p->pages, s->nr_pages);
+         i < s->nr_pages && qatomic_read(&s->prefetch_epoch) == p->epoch;
+         i = find_next_bit(p->pages, s->nr_pages, end)) {
+        end = find_next_zero_bit(p->pages, s->nr_pages, i);
+        posix_madvise(host + i * s->page_size, (end - i) * s->page_size,
+                      POSIX_MADV_WILLNEED);
+        runs++;
+    }
+    trace_xnu_snapshot_prefetch(bitmap_count_one(p->pages, s->nr_pages),
+                                runs);
+
+    g_free(p->pages);
+    g_free(p);
+    return NULL;
+}
+
+static void xnu_snapshot_prefetch(XNUSnapshot *s)
+{
+    g_autofree char *path = xnu_snapshot_hint_path(s);
+    uint64_t bits = ROUND_UP(s->nr_pages, 64);
+    g_autofree unsigned long *le = NULL;
+    XNUSnapshotPrefetch *p;
+    XNUSnapshotHeader hdr;
+    QemuThread thread;
+    int fd;
+
+    /* The hint is best effort, a missing or stale one is ignored */
+    fd = open(path, O_RDONLY | O_BINARY);
+    if (fd < 0) {
+        return;
+    }
+    le = bitmap_new(bits);
+    if (xnu_snapshot_pread(fd, (uint8_t *)&hdr, sizeof(hdr), 0) < 0 ||
+        memcmp(hdr.magic, XNU_SNAPSHOT_HINT_MAGIC, sizeof(hdr.magic)) ||
+        le32_to_cpu(hdr.version) != XNU_SNAPSHOT_VERSION ||
+        le32_to_cpu(hdr.page_size) != s->page_size ||
+        le64_to_cpu(hdr.ram_size) != memory_region_size(s->dram) ||
+        xnu_snapshot_pread(fd, (uint8_t *)le, bits / BITS_PER_BYTE,
+                           le64_to_cpu(hdr.data_offset)) < 0) {
+        close(fd);
+        return;
+    }
+    close(fd);
+
+    p = g_new0(XNUSnapshotPrefetch, 1);
+    p->s = s;
+    p->pages = bitmap_new(bits);
+    p->epoch = qatomic_read(&s->prefetch_epoch);
+    bitmap_from_le(p->pages, le, bits);
+    qemu_thread_create(&thread, "xnu-snap-prefetch",
+                       xnu_snapshot_prefetch_thread, p, QEMU_THREAD_DETACHED);
+}
+
+/* Pages touched in this process, from the present bits of their PTEs */
+static unsigned long *xnu_snapshot_touched_pages(XNUSnapshot *s,
+                                                 uint64_t bits)
+{
+#ifdef CONFIG_LINUX
+    uintptr_t host = (uintptr_t)memory_region_get_ram_ptr(s->dram);
+    uint64_t entries[512];
+    unsigned long *pages;
+    uint64_t i, j, n;
+    int fd;
+
+    fd = open("/proc/self/pagemap", O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    pages = bitmap_new(bits);
+    for (i = 0; i < s->nr_pages; i += n) {
+        n = MIN(ARRAY_SIZE(entries), s->nr_pages - i);
+        if (xnu_snapshot_pread(fd, (uint8_t *)entries, n * sizeof(entries[0]),
+                               (host / s->page_size + i) *
+                               sizeof(entries[0])) < 0) {
+            g_free(pages);
+            close(fd);
+            return NULL;
+        }
+        for (j = 0; j < n; j++) {
+            /* Bit 63 is "present", bit 62 "swapped" */
+            if (entries[j] & (3ULL << 62)) {
+                set_bit(i + j, pages);
+            }
+        }
+    }
+    close(fd);
+    return pages;
+#else
+    return NULL;
+#endif
+}
+
+static void xnu_snapshot_write_hint(Notifier *notifier, void *data)
+{
+    XNUSnapshot *s = container_of(notifier, XNUSnapshot, exit_notifier);
+    g_autofree char *path = xnu_snapshot_hint_path(s);
+    uint64_t bits = ROUND_UP(s->nr_pages, 64);
+    g_autofree unsigned long *pages = NULL;
+    g_autofree unsigned long *le = NULL;
+    XNUSnapshotHeader hdr = { 0 };
+    uint64_t nr_pages;
+    int fd;
+
+    /* Only a run that resumed from the chain says what a resume needs */
+    if (!s->restored) {
+        return;
+    }
+    pages = xnu_snapshot_touched_pages(s, bits);
+    if (!pages) {
+        return;
+    }
+    nr_pages = bitmap_count_one(pages, s->nr_pages);
+    le = bitmap_new(bits);
+    bitmap_to_le(le, pages, bits);
+
+    memcpy(hdr.magic, XNU_SNAPSHOT_HINT_MAGIC, sizeof(hdr.magic));
+    hdr.version = cpu_to_le32(XNU_SNAPSHOT_VERSION);
+    hdr.page_size = cpu_to_le32(s->page_size);
+    hdr.ram_size = cpu_to_le64(memory_region_size(s->dram));
+    hdr.nr_pages = cpu_to_le64(nr_pages);
+    hdr.data_offset = cpu_to_le64(sizeof(hdr));
+
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0644);
+    if (fd < 0) {
+        warn_report("Cannot write DRAM snapshot hint %s: %s", path,
+                    strerror(errno));
+        return;
+    }
+    if (xnu_snapshot_pwrite(fd, (uint8_t *)&hdr, sizeof(hdr), 0) < 0 ||
+        xnu_snapshot_pwrite(fd, (uint8_t *)le, bits / BITS_PER_BYTE,
+                            sizeof(hdr)) < 0) {
+        warn_report("Cannot write DRAM snapshot hint %s", path);
+        unlink(path);
+    } else {
+        trace_xnu_snapshot_hint(nr_pages);
+    }
+    close(fd);
+}
+
+static int xnu_snapshot_restore(XNUSnapshot *s, uint64_t generation,
+                                uint64_t id, Error **errp)
+{
+    uint64_t ram_size = memory_region_size(s->dram);
+    uint64_t parent_id = 0, g;
+    unsigned mappings = 0;
+    XNUSnapshotHeader hdr;
+    int fd, ret;
+
+    qatomic_inc(&s->prefetch_epoch);
+    for (g = 0; g <= generation; g++) {
+        fd = xnu_snapshot_open(s, g, &hdr, errp);
+        if (fd < 0) {
+            return -EIO;
+        }
+        if (hdr.parent_id != parent_id) {
+            error_setg(errp, "DRAM snapshot %s.%" PRIu64 " does not continue "
+                       "the chain", s->prefix, g);
+            close(fd);
+            return -EINVAL;
+        }
+
+        if (g == 0) {
+            ret = xnu_snapshot_map(s, fd, hdr.data_offset, 0, ram_size,
+                                   hdr.page_size, &mappings);
+        } else {
+            uint64_t nr_pages = ram_size / hdr.page_size;
+            uint64_t bits = ROUND_UP(nr_pages, 64);
+            g_autofree unsigned long *le = bitmap_new(bits);
+            g_autofree unsigned long *pages = bitmap_new(bits);
+            uint64_t rank = 0, i, end = 0;
+
+            ret = xnu_snapshot_pread(fd, (uint8_t *)le, bits / BITS_PER_BYTE,
+                                     sizeof(hdr));
+            if (ret == 0) {
+                bitmap_from_le(pages, le, bits);
+                if (bitmap_count_one(pages, nr_pages) != hdr.nr_pages) {
+                    ret = -EINVAL;
+                }
+            }
+            for (i = find_first_bit(pages, nr_pages);
+                 ret == 0 && i < nr_pages;
+                 i = find_next_bit(pages, nr_pages, end)) {
+                end = find_next_zero_bit(pages, nr_pages, i);
+                ret = xnu_snapshot_map(s, fd,
+                                       hdr.data_offset + rank * hdr.page_size,
+                                       i * hdr.page_size,
+                                       (end - i) * hdr.page_size,
+                                       hdr.page_size, &mappings);
+                rank += end - i;
+            }
+        }
+        close(fd);
+
+        if (ret < 0) {
+            error_setg_errno(errp, -ret, "Cannot load DRAM snapshot "
+                             "%s.%" PRIu64, s->prefix, g);
+            return ret;
+        }
+        parent_id = hdr.id;
+    }
+
+    if (parent_id != id) {
+        error_setg(errp, "DRAM snapshot %s.%" PRIu64 " was overwritten by a "
+                   "later savevm", s->prefix, generation);
+        return -EINVAL;
+    }
+
+    /* The next delta is relative to what was just restored */
+    g_free(memory_region_snapshot_and_clear_dirty(s->dram, 0, ram_size,
+                                                  DIRTY_MEMORY_VGA));
+    if (tcg_enabled()) {
+        tb_flush(first_cpu);
+    }
+    trace_xnu_snapshot_restore(generation, mappings);
+
+    s->restored = true;
+    xnu_snapshot_prefetch(s);
+    return 0;
+}
+
+static int xnu_snapshot_pre_save(void *opaque)
+{
+    XNUSnapshot *s = opaque;
+    Error *local_err = NULL;
+    int ret;
+
+    /*
+     * DRAM is not in the migration stream, only savevm can carry it.
+     * Both go through the migration state machine, but only savevm stops
+     * the VM in RUN_STATE_SAVE_VM first.
+     */
+    if (!runstate_check(RUN_STATE_SAVE_VM)) {
+        error_report("%s is kept in DRAM snapshots and cannot be migrated, "
+                     "use savevm and loadvm instead",
+                     memory_region_name(s->dram));
+        return -EPERM;
+    }
+
+    ret = xnu_snapshot_checkpoint(s, &local_err);
+    if (ret < 0) {
+        error_report_err(local_err);
+    }
+    return ret;
+}
+
+static int xnu_snapshot_post_load(void *opaque, int version_id)
+{
+    XNUSnapshot *s = opaque;
+    Error *local_err = NULL;
+    int ret;
+
+    ret = xnu_snapshot_restore(s, s->generation, s->id, &local_err);
+    if (ret < 0) {
+        error_report_err(local_err);
+        /* DRAM no longer matches any link, start a new chain */
+        s->id = 0;
+    }
+    return ret;
+}
+
+static const VMStateDescription vmstate_xnu_snapshot = {
+    .name = "xnu-dram-snapshot",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .pre_save = xnu_snapshot_pre_save,
+    .post_load = xnu_snapshot_post_load,
+    .fields = (VMStateField[]) {
+        VMSTATE_UINT64(generation, XNUSnapshot),
+        VMSTATE_UINT64(id, XNUSnapshot),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+void xnu_snapshot_init(MemoryRegion *dram, const char *prefix, Error **errp)
+{
+    XNUSnapshot *s;
+    uint64_t page_size = qemu_real_host_page_size();
+
+    if (memory_region_size(dram) % page_size) {
+        error_setg(errp, "%s size is not a multiple of the host page size",
+                   memory_region_name(dram));
+        return;
+    }
+
+    s = g_new0(XNUSnapshot, 1);
+    s->dram = dram;
+    s->prefix = g_strdup(prefix);
+    s->page_size = page_size;
+    s->nr_pages = memory_region_size(dram) / page_size;
+
+    /* DRAM goes to the chain instead of the migration stream */
+    qemu_ram_unset_migratable(dram->ram_block);
+    memory_region_set_log(dram, true, DIRTY_MEMORY_VGA);
+    vmstate_register(NULL, 0, &vmstate_xnu_snapshot, s);
+
+    s->exit_notifier.notify = xnu_snapshot_write_hint;
+    qemu_add_exit_notifier(&s->exit_notifier);
+}
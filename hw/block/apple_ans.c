@@ -62,6 +62,7 @@ struct AppleANSState {
     NvmeCtrl nvme;
     uint32_t nvme_interrupt_idx;
     uint32_t vendor_reg[NVME_APPLE_VENDOR_REG_SIZE / sizeof(uint32_t)];
+    VMStateGen vendor_reg_gen;
     bool started;
 };
 
@@ -122,7 +123,10 @@ static void apple_ans_vendor_reg_write(void *opaque, hwaddr addr,
     uint32_t *mmio = &s->vendor_reg[addr >> 2];
     DPRINTF("ANS2: vendor reg WRITE @ 0x"
                   TARGET_FMT_plx " value: 0x" TARGET_FMT_plx "\n", addr, data);
-    *mmio = data;
+    if (*mmio != data) {
+        *mmio = data;
+        vmstate_gen_bump(&s->vendor_reg_gen);
+    }
 }
 
 static uint64_t apple_ans_vendor_reg_read(void *opaque,
@@ -303,14 +307,49 @@ static int apple_ans_post_load(void *opaque, int version_id)
     return 0;
 }
 
+static VMStateGen *apple_ans_vendor_reg_gen(void *opaque)
+{
+    AppleANSState *s = APPLE_ANS(opaque);
+
+    return &s->vendor_reg_gen;
+}
+
+static bool apple_ans_vendor_reg_v1(void *opaque, int version_id)
+{
+    return version_id < 2;
+}
+
+static const VMStateDescription vmstate_apple_ans_vendor_reg = {
+    .name = "apple_ans/vendor_reg",
+    .version_id = 2,
+    .minimum_version_id = 1,
+    .gen = apple_ans_vendor_reg_gen,
+    .fields = (VMStateField[]) {
+        VMSTATE_ARRAY_TEST(vendor_reg, AppleANSState,
+                           NVME_APPLE_VENDOR_REG_SIZE / sizeof(uint32_t),
+                           apple_ans_vendor_reg_v1,
+                           vmstate_info_uint32, uint32_t),
+        VMSTATE_UINT32_SPARSE_ARRAY_V(vendor_reg, AppleANSState,
+                                      NVME_APPLE_VENDOR_REG_SIZE /
+                                      sizeof(uint32_t), 2),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
 static const VMStateDescription vmstate_apple_ans = {
     .name = "apple_ans",
     .post_load = apple_ans_post_load,
+    .threaded_save = true,
+    .save_early = true,
     .fields = (VMStateField[]) {
         VMSTATE_UINT32(nvme_interrupt_idx, AppleANSState),
         VMSTATE_BOOL(started, AppleANSState),
 
         VMSTATE_END_OF_LIST()
+    },
+    .subsections = (const VMStateDescription * []) {
+        &vmstate_apple_ans_vendor_reg,
+        NULL
     }
 };
 
@@ -17,11 +17,14 @@
  */
 
 #include "qemu/osdep.h"
+#include "qemu/atomic.h"
 #include "hw/sysbus.h"
 #include "migration/vmstate.h"
 #include "qapi/error.h"
+#include "qapi/visitor.h"
 #include "qemu/error-report.h"
 #include "qemu/fifo8.h"
+#include "qemu/host-utils.h"
 #include "qemu/log.h"
 #include "qemu/module.h"
 #include "qemu/timer.h"
@@ -153,15 +156,27 @@ struct AppleUartState {
     uint32_t tx_fifo_size;
 
     QEMUTimer *fifo_timeout_timer;
+    QEMUTimer *tx_flush_timer;
     uint64_t wordtime;        /* word time in ns */
 
     CharBackend       chr;
     qemu_irq          irq;
     qemu_irq          dmairq;
+    int               irq_level;
 
     uint32_t channel;
     uint32_t last_irq;
 
+    /*
+     * Optional capture of everything the guest transmits. Only the
+     * device writes it, QOM property readers copy it out without locking.
+     * log_head counts every byte and wraps at 2^32; log_size is a power of
+     * 2 so that slot numbers stay in order across that wrap.
+     */
+    uint8_t *log;
+    uint32_t log_size;
+    uint32_t log_head;
+    bool log_full;
 };
 
 
@@ -233,10 +248,14 @@ static void apple_uart_update_irq(AppleUartState *s)
     /*
      * The Tx interrupt is always requested if the number of data in the
      * transmit FIFO is smaller than the trigger level.
+     * The emulated transmitter drains instantly, s->tx only stages bytes
+     * for the chardev, so it never counts towards the trigger level.
      */
     uint32_t mask = UTRSTAT_Rx_BUFFER_DATA_READY;
+    int level;
+
     if (s->reg[I_(UFCON)] & UFCON_FIFO_ENABLE) {
-        uint32_t count = fifo8_num_used(&s->tx);
+        uint32_t count = 0;
 
         if (s->reg[I_(UCON)] & UCON_TXTHRESH_ENA) {
             mask |= UTRSTAT_Tx_THRESH | UTRSTAT_Tx_EMPTY |
@@ -265,16 +284,82 @@ static void apple_uart_update_irq(AppleUartState *s)
         }
     }
 
-    if (s->reg[I_(UTRSTAT)] & mask) {
-        s->last_irq = s->reg[I_(UTRSTAT)] & mask; 
-        qemu_irq_raise(s->irq);
+    level = (s->reg[I_(UTRSTAT)] & mask) != 0;
+    if (level) {
+        s->last_irq = s->reg[I_(UTRSTAT)] & mask;
+    }
+    if (level == s->irq_level) {
+        return;
+    }
+    s->irq_level = level;
+    qemu_set_irq(s->irq, level);
+    if (level) {
         trace_apple_uart_irq_raised(s->channel, s->reg[I_(UTRSTAT)]);
     } else {
-        qemu_irq_lower(s->irq);
         trace_apple_uart_irq_lowered(s->channel);
     }
 }
 
+static void apple_uart_log_push(AppleUartState *s, uint8_t ch)
+{
+    uint32_t head;
+
+    if (!s->log) {
+        return;
+    }
+
+    head = qatomic_read(&s->log_head);
+    s->log[head & (s->log_size - 1)] = ch;
+    if (head + 1 == s->log_size) {
+        qatomic_set(&s->log_full, true);
+    }
+    qatomic_store_release(&s->log_head, head + 1);
+}
+
+static void apple_uart_tx_flush(AppleUartState *s)
+{
+    const uint8_t *buf;
+    uint32_t len;
+    uint32_t count = fifo8_num_used(&s->tx);
+
+    timer_del(s->tx_flush_timer);
+    if (!count) {
+        return;
+    }
+
+    trace_apple_uart_tx_flush(s->channel, count);
+    while (!fifo8_is_empty(&s->tx)) {
+        buf = fifo8_pop_buf(&s->tx, fifo8_num_used(&s->tx), &len);
+        /* XXX this blocks entire thread. Rewrite to use
+         * qemu_chr_fe_write and background I/O callbacks */
+        qemu_chr_fe_write_all(&s->chr, buf, len);
+    }
+}
+
+static void apple_uart_tx_flush_timer(void *opaque)
+{
+    apple_uart_tx_flush(opaque);
+}
+
+static void apple_uart_tx(AppleUartState *s, uint8_t ch)
+{
+    trace_apple_uart_tx(s->channel, ch);
+    apple_uart_log_push(s, ch);
+
+    if (!qemu_chr_fe_backend_connected(&s->chr)) {
+        return;
+    }
+
+    fifo8_push(&s->tx, ch);
+    if (fifo8_is_full(&s->tx) || ch == '\n') {
+        apple_uart_tx_flush(s);
+    } else if (!timer_pending(s->tx_flush_timer)) {
+        timer_mod(s->tx_flush_timer,
+                  qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) +
+                  s->wordtime * s->tx_fifo_size);
+    }
+}
+
 static void apple_uart_timeout_int(void *opaque)
 {
     AppleUartState *s = opaque;
@@ -350,7 +435,6 @@ static void apple_uart_write(void *opaque, hwaddr offset,
                                uint64_t val, unsigned size)
 {
     AppleUartState *s = (AppleUartState *)opaque;
-    uint8_t ch;
 
     trace_apple_uart_write(s->channel, offset,
                             apple_uart_regname(offset), val);
@@ -370,21 +454,22 @@ static void apple_uart_write(void *opaque, hwaddr offset,
             trace_apple_uart_rx_fifo_reset(s->channel);
         }
         if (val & UFCON_Tx_FIFO_RESET) {
-            fifo8_reset(&s->tx);
+            apple_uart_tx_flush(s);
             s->reg[I_(UFCON)] &= ~UFCON_Tx_FIFO_RESET;
             trace_apple_uart_tx_fifo_reset(s->channel);
         }
         break;
 
     case UTXH:
-        if (qemu_chr_fe_backend_connected(&s->chr)) {
-            s->reg[I_(UTRSTAT)] &= ~(UTRSTAT_Tx_EMPTY |
-                    UTRSTAT_Tx_BUFFER_EMPTY);
-            ch = (uint8_t)val;
-            /* XXX this blocks entire thread. Rewrite to use
-             * qemu_chr_fe_write and background I/O callbacks */
-            qemu_chr_fe_write_all(&s->chr, &ch, 1);
-            trace_apple_uart_tx(s->channel, ch);
+        /*
+         * Bytes are staged in the Tx FIFO and handed to the chardev in
+         * batches. The transmitter is reported empty right away, so
+         * UTRSTAT only changes (and the IRQ needs recomputing) if the
+         * guest had cleared the Tx empty bits.
+         */
+        apple_uart_tx(s, (uint8_t)val);
+        if ((s->reg[I_(UTRSTAT)] & (UTRSTAT_Tx_EMPTY | UTRSTAT_Tx_BUFFER_EMPTY))
+            != (UTRSTAT_Tx_EMPTY | UTRSTAT_Tx_BUFFER_EMPTY)) {
             s->reg[I_(UTRSTAT)] |= UTRSTAT_Tx_EMPTY |
                     UTRSTAT_Tx_BUFFER_EMPTY;
             apple_uart_update_irq(s);
@@ -393,11 +478,17 @@ static void apple_uart_write(void *opaque, hwaddr offset,
 
     case UTRSTAT:
         val &= (UTRSTAT_Tx_EMPTY);
+        if (!(s->reg[I_(UTRSTAT)] & val)) {
+            break;
+        }
         s->reg[I_(UTRSTAT)] &= ~val;
         trace_apple_uart_intclr(s->channel, s->reg[I_(UTRSTAT)]);
         apple_uart_update_irq(s);
         break;
     case UERSTAT:
+        if (!(s->reg[I_(UERSTAT)] & val)) {
+            break;
+        }
         s->reg[I_(UERSTAT)] &= ~val;
         apple_uart_update_irq(s);
         break;
@@ -431,6 +522,8 @@ static uint64_t apple_uart_read(void *opaque, hwaddr offset,
                                apple_uart_regname(offset), res);
         return res;
     case UFSTAT: /* Read Only */
+        /* The guest is looking at the Tx FIFO level, push out what's staged */
+        apple_uart_tx_flush(s);
         s->reg[I_(UFSTAT)] = fifo8_num_used(&s->rx) & 0xf;
         if (fifo8_num_free(&s->rx) == 0) {
             s->reg[I_(UFSTAT)] |= UFSTAT_Rx_FIFO_FULL;
@@ -543,12 +636,26 @@ static void apple_uart_reset(DeviceState *dev)
                 apple_uart_regs[i].reset_value;
     }
 
+    apple_uart_tx_flush(s);
     fifo8_reset(&s->rx);
     fifo8_reset(&s->tx);
 
+    s->irq_level = 0;
+    qemu_irq_lower(s->irq);
+
     trace_apple_uart_rxsize(s->channel, s->rx_fifo_size);
 }
 
+static int apple_uart_pre_save(void *opaque)
+{
+    AppleUartState *s = APPLE_UART(opaque);
+
+    /* The staged Tx bytes are not part of the migration stream */
+    apple_uart_tx_flush(s);
+
+    return 0;
+}
+
 static int apple_uart_post_load(void *opaque, int version_id)
 {
     AppleUartState *s = APPLE_UART(opaque);
@@ -556,6 +663,10 @@ static int apple_uart_post_load(void *opaque, int version_id)
     apple_uart_update_parameters(s);
     apple_uart_rx_timeout_set(s);
 
+    /* Force the IRQ line to follow the loaded state */
+    s->irq_level = -1;
+    apple_uart_update_irq(s);
+
     return 0;
 }
 
@@ -563,6 +674,7 @@ static const VMStateDescription vmstate_apple_uart = {
     .name = "apple.uart",
     .version_id = 1,
     .minimum_version_id = 1,
+    .pre_save = apple_uart_pre_save,
     .post_load = apple_uart_post_load,
     .fields = (VMStateField[]) {
         VMSTATE_FIFO8(rx, AppleUartState),
@@ -598,6 +710,50 @@ DeviceState *apple_uart_create(hwaddr addr,
     return dev;
 }
 
+/*
+ * The guest may transmit any byte, including NULs and invalid UTF-8, so the
+ * log is returned base64 encoded rather than as a raw string.
+ */
+static char *apple_uart_get_log(Object *obj, Error **errp)
+{
+    AppleUartState *s = APPLE_UART(obj);
+    uint32_t head, tail, len, i;
+    g_autofree guchar *buf = NULL;
+
+    if (!s->log) {
+        return g_strdup("");
+    }
+
+    head = qatomic_load_acquire(&s->log_head);
+    len = qatomic_read(&s->log_full) ? s->log_size : head;
+    tail = head - len;
+    buf = g_malloc(len);
+    for (i = 0; i < len; i++) {
+        buf[i] = s->log[(tail + i) & (s->log_size - 1)];
+    }
+
+    /* Drop whatever the device overwrote while we were copying */
+    smp_rmb();
+    head = qatomic_read(&s->log_head);
+    if (head - tail > s->log_size) {
+        i = MIN(head - tail - s->log_size, len);
+        memmove(buf, buf + i, len - i);
+        len -= i;
+    }
+
+    return g_base64_encode(buf, len);
+}
+
+static void apple_uart_get_log_head(Object *obj, Visitor *v,
+                                    const char *name, void *opaque,
+                                    Error **errp)
+{
+    AppleUartState *s = APPLE_UART(obj);
+    uint32_t value = qatomic_load_acquire(&s->log_head);
+
+    visit_type_uint32(v, name, &value, errp);
+}
+
 static void apple_uart_init(Object *obj)
 {
     SysBusDevice *dev = SYS_BUS_DEVICE(obj);
@@ -612,6 +768,13 @@ static void apple_uart_init(Object *obj)
 
     sysbus_init_irq(dev, &s->irq);
     sysbus_init_irq(dev, &s->dmairq);
+
+    object_property_add_str(obj, "log", apple_uart_get_log, NULL);
+    object_property_set_description(obj, "log",
+                                    "Transmitted bytes kept in the log "
+                                    "ring, oldest first, base64 encoded");
+    object_property_add(obj, "log-head", "uint32",
+                        apple_uart_get_log_head, NULL, NULL, NULL);
 }
 
 static void apple_uart_realize(DeviceState *dev, Error **errp)
@@ -628,11 +791,22 @@ static void apple_uart_realize(DeviceState *dev, Error **errp)
         return;
     }
 
+    if (s->log_size && !is_power_of_2(s->log_size)) {
+        error_setg(errp, "log-size must be a power of 2");
+        return;
+    }
+
     fifo8_create(&s->rx, s->rx_fifo_size);
     fifo8_create(&s->tx, s->tx_fifo_size);
 
     s->fifo_timeout_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL,
                                          apple_uart_timeout_int, s);
+    s->tx_flush_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL,
+                                     apple_uart_tx_flush_timer, s);
+
+    if (s->log_size) {
+        s->log = g_malloc0(s->log_size);
+    }
 
     qemu_chr_fe_set_handlers(&s->chr, apple_uart_can_receive,
                              apple_uart_receive, apple_uart_event,
@@ -644,6 +818,7 @@ static Property apple_uart_properties[] = {
     DEFINE_PROP_UINT32("channel", AppleUartState, channel, 0),
     DEFINE_PROP_UINT32("rx-size", AppleUartState, rx_fifo_size, 15),
     DEFINE_PROP_UINT32("tx-size", AppleUartState, tx_fifo_size, 15),
+    DEFINE_PROP_UINT32("log-size", AppleUartState, log_size, 0),
     DEFINE_PROP_END_OF_LIST(),
 };
 
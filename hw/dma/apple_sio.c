@@ -163,6 +163,7 @@ int apple_sio_dma_read(AppleSIODMAEndpoint *ep, void *buffer, size_t len)
     assert(ep->dir == DMA_DIRECTION_TO_DEVICE);
     xlen = qemu_iovec_to_buf(&ep->iov, ep->actual_length, buffer, len);
     ep->actual_length += xlen;
+    stat64_add(&s->bytes_processed, xlen);
     if (ep->actual_length >= ep->iov.size) {
         apple_sio_dma_writeback(s, ep);
     }
@@ -179,6 +180,7 @@ int apple_sio_dma_write(AppleSIODMAEndpoint *ep, void *buffer, size_t len)
     assert(ep->dir == DMA_DIRECTION_FROM_DEVICE);
     xlen = qemu_iovec_from_buf(&ep->iov, ep->actual_length, buffer, len);
     ep->actual_length += xlen;
+    stat64_add(&s->bytes_processed, xlen);
     if (ep->actual_length >= ep->iov.size) {
         apple_sio_dma_writeback(s, ep);
     }
@@ -333,6 +335,9 @@ static void ascv2_core_reg_write(void *opaque, hwaddr addr,
                   uint64_t data,
                   unsigned size)
 {
+    AppleSIOState *s = APPLE_SIO(opaque);
+
+    apple_soc_stats_mmio_write(&s->stats);
 #ifdef DEBUG_SIO
     qemu_log_mask(LOG_UNIMP, "SIO: AppleASCWrapV2 core reg WRITE @ 0x"
                   TARGET_FMT_plx " value: 0x" TARGET_FMT_plx "\n", addr, data);
@@ -343,6 +348,9 @@ static uint64_t ascv2_core_reg_read(void *opaque,
                      hwaddr addr,
                      unsigned size)
 {
+    AppleSIOState *s = APPLE_SIO(opaque);
+
+    apple_soc_stats_mmio_read(&s->stats);
 #ifdef DEBUG_SIO
     qemu_log_mask(LOG_UNIMP, "SIO: AppleASCWrapV2 core reg READ @ 0x"
                   TARGET_FMT_plx "\n", addr);
@@ -415,6 +423,14 @@ SysBusDevice *apple_sio_create(DTBNode *node, uint32_t protocol_version)
     return sbd;
 }
 
+static void apple_sio_stats_fill(void *opaque, AppleSoCDeviceStats *info)
+{
+    AppleSIOState *s = APPLE_SIO(opaque);
+
+    info->has_bytes_processed = true;
+    info->bytes_processed = stat64_get(&s->bytes_processed);
+}
+
 static void apple_sio_realize(DeviceState *dev, Error **errp)
 {
     AppleSIOState *s = APPLE_SIO(dev);
@@ -433,12 +449,14 @@ static void apple_sio_realize(DeviceState *dev, Error **errp)
         s->eps[i].dir = i & 1 ? DMA_DIRECTION_FROM_DEVICE :
                                 DMA_DIRECTION_TO_DEVICE;
     }
+    apple_soc_stats_register(&s->stats, "sio", apple_sio_stats_fill, s);
 }
 
 static void apple_sio_unrealize(DeviceState *dev)
 {
     AppleSIOState *s = APPLE_SIO(dev);
 
+    apple_soc_stats_unregister(&s->stats);
     qdev_unrealize(DEVICE(s->mbox));
 }
 
@@ -9,6 +9,7 @@
 #include "qemu/module.h"
 #include "qemu/timer.h"
 #include "hw/arm/xnu_dtb.h"
+#include "trace.h"
 
 //#define DEBUG_APPLE_I2C
 
@@ -107,27 +108,58 @@ static void apple_i2c_update_irq(AppleI2CState *s)
     }
 }
 
-static void apple_i2c_reg_write(void *opaque,
-                  hwaddr addr,
-                  uint64_t data,
-                  unsigned size)
+static void apple_i2c_account(AppleI2CState *s, unsigned words)
 {
-    AppleI2CState *s = APPLE_I2C(opaque);
-    DeviceState *dev = DEVICE(opaque);
-    #ifdef DEBUG_APPLE_I2C
-    qemu_log_mask(LOG_UNIMP, "%s: reg WRITE @ 0x" TARGET_FMT_plx
-                             " value: 0x" TARGET_FMT_plx "\n", dev->id, addr, data);
-    #endif
+    int64_t now = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+
+    trace_apple_i2c_batch(DEVICE(s)->id, words);
+    if (now - s->xfer_window >= NANOSECONDS_PER_SECOND) {
+        if (s->xfer_window) {
+            trace_apple_i2c_rate(DEVICE(s)->id, s->xfers *
+                                 NANOSECONDS_PER_SECOND /
+                                 (now - s->xfer_window));
+        }
+        s->xfer_window = now;
+        s->xfers = 0;
+    }
+}
 
-    uint32_t *mmio = (uint32_t *)&s->reg[addr];
-    uint32_t value = data;
-    uint32_t orig = *mmio;
-    bool iflg = false;
+static void apple_i2c_send_pending(AppleI2CState *s, uint8_t *buf, int *len)
+{
+    if (*len && i2c_send_buf(s->bus, buf, *len)) {
+        REG(s, rSMSTA) |= kSMSTAmtn;
+        /* XXX: Should we end it here? */
+    }
+    *len = 0;
+}
 
-    switch (addr) {
-    case rMTXFIFO: {
+/*
+ * Execute the commands queued in the Tx FIFO.  Runs of plain data bytes
+ * go to the bus in one i2c_send_buf() call; the caller updates the
+ * interrupt once for the whole batch.
+ */
+static bool apple_i2c_run(AppleI2CState *s)
+{
+    DeviceState *dev = DEVICE(s);
+    uint8_t buf[APPLE_I2C_CMD_FIFO_DEPTH];
+    unsigned words = fifo32_num_used(&s->cmd_fifo);
+    int tx_len = 0;
+
+    if (!words) {
+        return false;
+    }
+
+    while (!fifo32_is_empty(&s->cmd_fifo)) {
+        uint32_t value = fifo32_pop(&s->cmd_fifo);
         uint8_t addr = kMTXFIFOData(value) >> 1;
-        iflg = true;
+
+        if (s->xip && !s->is_recv &&
+            !(value & (kMTXFIFOStart | kMTXFIFORead | kMTXFIFOStop))) {
+            buf[tx_len++] = kMTXFIFOData(value);
+            continue;
+        }
+        apple_i2c_send_pending(s, buf, &tx_len);
+
         if ((value & kMTXFIFOStart)) {
 
             if (kMTXFIFOData(value) & 1) {
@@ -139,24 +171,24 @@ static void apple_i2c_reg_write(void *opaque,
                 qemu_log_mask(LOG_GUEST_ERROR,
                               "%s: can't find device @ 0x%x\n", dev->id, addr);
                 REG(s, rSMSTA) |= kSMSTAmtn;
-                break;
+                continue;
             }
 
             s->xip = true;
             REG(s, rSMSTA) |= kSMSTAxip;
         } else if (s->xip) {
             if (value & kMTXFIFORead) {
-                uint8_t len = kMTXFIFOData(value);
+                uint8_t len = MIN(kMTXFIFOData(value),
+                                  fifo8_num_free(&s->rx_fifo));
                 if (!s->is_recv) {
                     s->is_recv = 1;
                     if (i2c_start_transfer(s->bus, addr, s->is_recv) != 0) {
                         REG(s, rSMSTA) |= kSMSTAmtn;
-                        break;
+                        continue;
                     }
                 }
-                while (len--) {
-                    fifo8_push(&s->rx_fifo, i2c_recv(s->bus));
-                }
+                i2c_recv_buf(s->bus, buf, len);
+                fifo8_push_all(&s->rx_fifo, buf, len);
                 if (kMTXFIFOData(value) > 0) {
                     REG(s, rSMSTA) |= (kSMSTAmrne);
                     if (kMTXFIFOData(value) >= kRDCOUNT(REG(s, rRDCOUNT))) {
@@ -168,7 +200,7 @@ static void apple_i2c_reg_write(void *opaque,
                     s->is_recv = 0;
                     if (i2c_start_transfer(s->bus, addr, s->is_recv) != 0) {
                         REG(s, rSMSTA) |= kSMSTAmtn;
-                        break;
+                        continue;
                     }
                 }
                 if (i2c_send(s->bus, kMTXFIFOData(value))) {
@@ -182,10 +214,48 @@ static void apple_i2c_reg_write(void *opaque,
                 i2c_end_transfer(s->bus);
                 REG(s, rSMSTA) |= kSMSTAxen;
                 s->xip = false;
+                s->xfers++;
             }
         }
-        break;
     }
+    apple_i2c_send_pending(s, buf, &tx_len);
+    apple_i2c_account(s, words);
+    return true;
+}
+
+static void apple_i2c_reg_write(void *opaque,
+                  hwaddr addr,
+                  uint64_t data,
+                  unsigned size)
+{
+    AppleI2CState *s = APPLE_I2C(opaque);
+    #ifdef DEBUG_APPLE_I2C
+    DeviceState *dev = DEVICE(opaque);
+    qemu_log_mask(LOG_UNIMP, "%s: reg WRITE @ 0x" TARGET_FMT_plx
+                             " value: 0x" TARGET_FMT_plx "\n", dev->id, addr, data);
+    #endif
+
+    uint32_t *mmio = (uint32_t *)&s->reg[addr];
+    uint32_t value = data;
+    uint32_t orig;
+    bool iflg = false;
+
+    /*
+     * Commands are only queued; they run as a batch once the guest ends
+     * or reads back a transaction, or touches any other register.
+     */
+    if (addr == rMTXFIFO) {
+        fifo32_push(&s->cmd_fifo, value);
+        if (!(value & (kMTXFIFOStop | kMTXFIFORead))
+            && !fifo32_is_full(&s->cmd_fifo)) {
+            *mmio = value;
+            return;
+        }
+    }
+    iflg = apple_i2c_run(s);
+    orig = *mmio;
+
+    switch (addr) {
     case rSMSTA:
         value = orig & (~value);
         iflg = true;
@@ -215,7 +285,12 @@ static uint64_t apple_i2c_reg_read(void *opaque,
 {
     AppleI2CState *s = APPLE_I2C(opaque);
     uint32_t *mmio = (uint32_t *)&s->reg[addr];
-    uint32_t value = *mmio;
+    uint32_t value;
+
+    if (apple_i2c_run(s)) {
+        apple_i2c_update_irq(s);
+    }
+    value = *mmio;
 
     switch (addr) {
     case rMRXFIFO:
@@ -262,6 +337,7 @@ static void apple_i2c_reset_enter(Object *obj, ResetType type)
     memset(s->reg, 0, sizeof(s->reg));
     s->nak = s->xip = s->is_recv = 0;
     fifo8_reset(&s->rx_fifo);
+    fifo32_reset(&s->cmd_fifo);
 }
 
 static void apple_i2c_reset_hold(Object *obj)
@@ -309,14 +385,27 @@ SysBusDevice *apple_i2c_create(const char *name)
 
     s->last_irq = 0;
     fifo8_create(&s->rx_fifo, 0x100);
+    fifo32_create(&s->cmd_fifo, APPLE_I2C_CMD_FIFO_DEPTH);
 
     return sbd;
 }
 
+static int apple_i2c_pre_save(void *opaque)
+{
+    AppleI2CState *s = APPLE_I2C(opaque);
+
+    /* Nothing is left queued in the migration stream */
+    if (apple_i2c_run(s)) {
+        apple_i2c_update_irq(s);
+    }
+    return 0;
+}
+
 static const VMStateDescription vmstate_apple_i2c = {
     .name = "apple_i2c",
     .version_id = 1,
     .minimum_version_id = 1,
+    .pre_save = apple_i2c_pre_save,
     .fields = (VMStateField[]) {
         VMSTATE_UINT8_ARRAY(reg, AppleI2CState, APPLE_I2C_MMIO_SIZE),
         VMSTATE_FIFO8(rx_fifo, AppleI2CState),
@@ -302,6 +302,48 @@ uint8_t i2c_recv(I2CBus *bus)
     return data;
 }
 
+int i2c_send_buf(I2CBus *bus, const uint8_t *buf, int len)
+{
+    I2CNode *node = QLIST_FIRST(&bus->current_devs);
+    I2CSlaveClass *sc;
+    int ret = 0;
+    int i;
+
+    if (node && !QLIST_NEXT(node, next)) {
+        sc = I2C_SLAVE_GET_CLASS(node->elt);
+        if (sc->send_buf) {
+            trace_i2c_send_buf(node->elt->address, len);
+            return sc->send_buf(node->elt, buf, len) ? -1 : 0;
+        }
+    }
+
+    for (i = 0; i < len; i++) {
+        ret |= i2c_send(bus, buf[i]);
+    }
+    return ret ? -1 : 0;
+}
+
+void i2c_recv_buf(I2CBus *bus, uint8_t *buf, int len)
+{
+    I2CSlaveClass *sc;
+    I2CSlave *s;
+    int i;
+
+    if (!QLIST_EMPTY(&bus->current_devs) && !bus->broadcast) {
+        s = QLIST_FIRST(&bus->current_devs)->elt;
+        sc = I2C_SLAVE_GET_CLASS(s);
+        if (sc->recv_buf) {
+            sc->recv_buf(s, buf, len);
+            trace_i2c_recv_buf(s->address, len);
+            return;
+        }
+    }
+
+    for (i = 0; i < len; i++) {
+        buf[i] = i2c_recv(bus);
+    }
+}
+
 void i2c_nack(I2CBus *bus)
 {
     I2CSlaveClass *sc;
@@ -112,9 +112,10 @@ static inline uint64_t apple_aic_emulate_timer(void)
 }
 
 /*
- * Check state and interrupt cpus, call with mutex locked
+ * Check state and interrupt cpus, call with mutex locked.
+ * Returns true if any cpu still has an interrupt to take.
  */
-static void apple_aic_update(AppleAICState *s)
+static bool apple_aic_update(AppleAICState *s)
 {
     uint32_t intr = 0;
     uint32_t potential = 0;
@@ -167,6 +168,20 @@ static void apple_aic_update(AppleAICState *s)
             qemu_irq_raise(s->cpus[i].irq);
         }
     }
+    return intr != 0;
+}
+
+/*
+ * Arm the delivery timer after a state change that may make an interrupt
+ * deliverable. The timer stops itself once nothing is pending, so idle
+ * and powered off cores are not woken every wait period. Call with mutex
+ * locked.
+ */
+static void apple_aic_kick(AppleAICState *s)
+{
+    if (!timer_pending(s->timer)) {
+        timer_mod_ns(s->timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + kAICWT);
+    }
 }
 
 static void apple_aic_set_irq(void *opaque, int irq, int level)
@@ -176,7 +191,10 @@ static void apple_aic_set_irq(void *opaque, int irq, int level)
     WITH_QEMU_LOCK_GUARD(&s->mutex) {
         trace_aic_set_irq(irq, level);
         if (level) {
-            set_bit(irq, (unsigned long *)s->eir_state);
+            if (!test_and_set_bit(irq, (unsigned long *)s->eir_state)) {
+                stat64_add(&s->irq_count[irq], 1);
+                apple_aic_kick(s);
+            }
         } else {
             clear_bit(irq, (unsigned long *)s->eir_state);
         }
@@ -188,10 +206,11 @@ static void apple_aic_tick(void *opaque)
     AppleAICState *s = APPLE_AIC(opaque);
 
     WITH_QEMU_LOCK_GUARD(&s->mutex) {
-        apple_aic_update(s);
+        if (apple_aic_update(s)) {
+            timer_mod_ns(s->timer,
+                         qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + kAICWT);
+        }
     }
-
-    timer_mod_ns(s->timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + kAICWT);
 }
 
 static void apple_aic_reset(DeviceState *dev)
@@ -224,6 +243,8 @@ static void apple_aic_write(void *opaque, hwaddr addr, uint64_t data,
     AppleAICState *s = APPLE_AIC(o->aic);
     uint32_t val = (uint32_t)data;
 
+    apple_soc_stats_mmio_write(&s->stats);
+
     WITH_QEMU_LOCK_GUARD(&s->mutex) {
         switch (addr) {
         case rAIC_RST:
@@ -393,6 +414,7 @@ static void apple_aic_write(void *opaque, hwaddr addr, uint64_t data,
                         " cpu %u: 0x%x\n", addr, o->cpu_id, val);
             break;
         }
+        apple_aic_kick(s);
     }
 }
 
@@ -401,6 +423,8 @@ static uint64_t apple_aic_read(void *opaque, hwaddr addr, unsigned size)
     AppleAICCPU *o = (AppleAICCPU *)opaque;
     AppleAICState *s = APPLE_AIC(o->aic);
 
+    apple_soc_stats_mmio_read(&s->stats);
+
     WITH_QEMU_LOCK_GUARD(&s->mutex) {
         switch (addr) {
         case rAIC_REV:
@@ -531,6 +555,27 @@ static const MemoryRegionOps apple_aic_ops = {
     .valid.unaligned = false,
 };
 
+static void apple_aic_stats_fill(void *opaque, AppleSoCDeviceStats *info)
+{
+    AppleAICState *s = APPLE_AIC(opaque);
+    AppleSoCIrqStatsList **tail = &info->irqs;
+    int i;
+
+    for (i = 0; i < s->numIRQ; i++) {
+        uint64_t count = stat64_get(&s->irq_count[i]);
+        AppleSoCIrqStats *irq;
+
+        if (!count) {
+            continue;
+        }
+        irq = g_new0(AppleSoCIrqStats, 1);
+        irq->irq = i;
+        irq->count = count;
+        QAPI_LIST_APPEND(tail, irq);
+    }
+    info->has_irqs = info->irqs != NULL;
+}
+
 static void apple_aic_realize(DeviceState *dev, struct Error **errp)
 {
     AppleAICState *s = APPLE_AIC(dev);
@@ -558,13 +603,14 @@ static void apple_aic_realize(DeviceState *dev, struct Error **errp)
     s->eir_mask = g_new0(uint32_t, s->numEIR);
     s->eir_dest = g_new0(uint32_t, s->numIRQ);
     s->eir_state = g_new0(uint32_t, s->numEIR);
+    s->irq_count = g_new0(Stat64, s->numIRQ);
+    apple_soc_stats_register(&s->stats, "aic", apple_aic_stats_fill, s);
 
 #ifdef AIC_DEBUG_NEW_IRQ
     s->eir_mask_once = g_new0(uint32_t, s->numEIR);
 #endif
 
     s->timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, apple_aic_tick, dev);
-    timer_mod_ns(s->timer, kAICWT);
     msi_nonbroken = true;
 }
 
@@ -572,6 +618,8 @@ static void apple_aic_unrealize(DeviceState *dev)
 {
     AppleAICState *s = APPLE_AIC(dev);
     timer_free(s->timer);
+    apple_soc_stats_unregister(&s->stats);
+    g_free(s->irq_count);
 }
 
 SysBusDevice *apple_aic_create(uint32_t numCPU, DTBNode *node,
@@ -630,10 +678,21 @@ static const VMStateDescription vmstate_apple_aic_cpu = {
     }
 };
 
+static int apple_aic_post_load(void *opaque, int version_id)
+{
+    AppleAICState *s = APPLE_AIC(opaque);
+
+    WITH_QEMU_LOCK_GUARD(&s->mutex) {
+        apple_aic_kick(s);
+    }
+    return 0;
+}
+
 static const VMStateDescription vmstate_apple_aic = {
     .name = "apple_aic",
     .version_id = 1,
     .minimum_version_id = 1,
+    .post_load = apple_aic_post_load,
     .fields = (VMStateField[]) {
         VMSTATE_UINT32(numEIR, AppleAICState),
         VMSTATE_UINT32(numIRQ, AppleAICState),
@@ -3,6 +3,7 @@
 #include "hw/irq.h"
 #include "hw/misc/apple_aes.h"
 #include "hw/misc/apple_aes_reg.h"
+#include "hw/misc/apple_soc_stats.h"
 #include "migration/vmstate.h"
 #include "qemu/bitops.h"
 #include "qemu/log.h"
@@ -60,6 +61,8 @@ struct AppleAESState {
     AESKey keys[2];
     uint8_t iv[4][16];
     bool stopped;
+    AppleSoCStats stats;
+    Stat64 bytes_processed;
 };
 
 static uint32_t key_size(uint8_t len) {
@@ -260,6 +263,7 @@ static bool aes_process_command(AppleAESState *s, AESCommand *cmd)
         }
         qcrypto_cipher_getiv(s->keys[key_ctx].cipher, s->iv[iv_ctx], 16, &errp);
         dma_memory_write(&s->dma_as, dest_addr, buffer, len, MEMTXATTRS_UNSPECIFIED);
+        stat64_add(&s->bytes_processed, len);
         break;
     }
     case OPCODE_STORE_IV:
@@ -355,6 +359,7 @@ static void aes_reg_write(void *opaque, hwaddr addr,
     int iflg = 0;
     bool nowrite = false;
 
+    apple_soc_stats_mmio_write(&s->stats);
     if (addr >= AES_BLK_REG_SIZE) {
         qemu_log_mask(LOG_GUEST_ERROR, "%s: Bad offset 0x%"HWADDR_PRIx"\n",
                       __func__, addr);
@@ -512,6 +517,7 @@ static uint64_t aes_reg_read(void *opaque,
     uint32_t val = 0;
     uint32_t *mmio = NULL;
 
+    apple_soc_stats_mmio_read(&s->stats);
     if (addr >= AES_BLK_REG_SIZE) {
         qemu_log_mask(LOG_GUEST_ERROR, "%s: Bad offset 0x%"HWADDR_PRIx"\n",
                       __func__, addr);
@@ -578,6 +584,14 @@ static void apple_aes_reset(DeviceState *dev)
     aes_empty_fifo(s);
 }
 
+static void apple_aes_stats_fill(void *opaque, AppleSoCDeviceStats *info)
+{
+    AppleAESState *s = APPLE_AES(opaque);
+
+    info->has_bytes_processed = true;
+    info->bytes_processed = stat64_get(&s->bytes_processed);
+}
+
 static void apple_aes_realize(DeviceState *dev, Error **errp)
 {
     AppleAESState *s = APPLE_AES(dev);
@@ -591,12 +605,14 @@ static void apple_aes_realize(DeviceState *dev, Error **errp)
     qemu_cond_init(&s->thread_cond);
     qemu_mutex_init(&s->queue_mutex);
     apple_aes_reset(dev);
+    apple_soc_stats_register(&s->stats, "aes", apple_aes_stats_fill, s);
 }
 
 static void apple_aes_unrealize(DeviceState *dev)
 {
     AppleAESState *s = APPLE_AES(dev);
 
+    apple_soc_stats_unregister(&s->stats);
     apple_aes_reset(dev);
     qemu_cond_destroy(&s->thread_cond);
     qemu_mutex_destroy(&s->queue_mutex);
@@ -0,0 +1,176 @@
+/*
+ * Apple SoC boot timeline recorder
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/error-report.h"
+#include "qemu/lockable.h"
+#include "qemu/notify.h"
+#include "qemu/thread.h"
+#include "qemu/timer.h"
+#include "qapi/qmp/json-writer.h"
+#include "sysemu/sysemu.h"
+#include "hw/misc/apple_boot_trace.h"
+
+typedef struct AppleBootTraceEvent {
+    int track;
+    char *name;
+    int64_t ts_ns;
+    /* -1 for instant events */
+    int64_t dur_ns;
+    int64_t vm_ns;
+} AppleBootTraceEvent;
+
+static struct {
+    bool enabled;
+    char *filename;
+    int64_t origin_ns;
+    QemuMutex lock;
+    GArray *events;
+    GPtrArray *tracks;
+    Notifier exit_notifier;
+} apple_boot_trace;
+
+static void apple_boot_trace_record(int track, const char *name,
+                                    int64_t ts_ns, int64_t dur_ns)
+{
+    AppleBootTraceEvent ev = {
+        .track = track,
+        .name = g_strdup(name),
+        .ts_ns = ts_ns,
+        .dur_ns = dur_ns,
+        .vm_ns = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL),
+    };
+
+    WITH_QEMU_LOCK_GUARD(&apple_boot_trace.lock) {
+        g_array_append_val(apple_boot_trace.events, ev);
+    }
+}
+
+static void apple_boot_trace_write(Notifier *notifier, void *data)
+{
+    JSONWriter *writer = json_writer_new(false);
+    g_autoptr(GError) err = NULL;
+    GString *out;
+    int i;
+
+    json_writer_start_object(writer, NULL);
+    json_writer_str(writer, "displayTimeUnit", "ms");
+    json_writer_start_array(writer, "traceEvents");
+
+    qemu_mutex_lock(&apple_boot_trace.lock);
+    for (i = 0; i < apple_boot_trace.tracks->len; i++) {
+        json_writer_start_object(writer, NULL);
+        json_writer_str(writer, "name", "thread_name");
+        json_writer_str(writer, "ph", "M");
+        json_writer_int64(writer, "pid", 1);
+        json_writer_int64(writer, "tid", i);
+        json_writer_start_object(writer, "args");
+        json_writer_str(writer, "name",
+                        g_ptr_array_index(apple_boot_trace.tracks, i));
+        json_writer_end_object(writer);
+        json_writer_end_object(writer);
+    }
+
+    for (i = 0; i < apple_boot_trace.events->len; i++) {
+        AppleBootTraceEvent *ev = &g_array_index(apple_boot_trace.events,
+                                                 AppleBootTraceEvent, i);
+
+        json_writer_start_object(writer, NULL);
+        json_writer_str(writer, "name", ev->name);
+        json_writer_str(writer, "cat", "boot");
+        json_writer_int64(writer, "pid", 1);
+        json_writer_int64(writer, "tid", ev->track);
+        json_writer_double(writer, "ts",
+                           (ev->ts_ns - apple_boot_trace.origin_ns) / 1000.0);
+        if (ev->dur_ns >= 0) {
+            json_writer_str(writer, "ph", "X");
+            json_writer_double(writer, "dur", ev->dur_ns / 1000.0);
+        } else {
+            json_writer_str(writer, "ph", "i");
+            json_writer_str(writer, "s", "p");
+        }
+        json_writer_start_object(writer, "args");
+        json_writer_int64(writer, "vm_ns", ev->vm_ns);
+        json_writer_end_object(writer);
+        json_writer_end_object(writer);
+    }
+    qemu_mutex_unlock(&apple_boot_trace.lock);
+
+    json_writer_end_array(writer);
+    json_writer_end_object(writer);
+
+    out = json_writer_get_and_free(writer);
+    if (!g_file_set_contents(apple_boot_trace.filename, out->str, out->len,
+                             &err)) {
+        error_report("boot-trace: failed to write %s: %s",
+                     apple_boot_trace.filename, err->message);
+    }
+    g_string_free(out, true);
+}
+
+void apple_boot_trace_start(const char *filename)
+{
+    if (apple_boot_trace.enabled) {
+        return;
+    }
+
+    apple_boot_trace.filename = g_strdup(filename);
+    apple_boot_trace.origin_ns = get_clock();
+    qemu_mutex_init(&apple_boot_trace.lock);
+    apple_boot_trace.events = g_array_new(false, false,
+                                          sizeof(AppleBootTraceEvent));
+    apple_boot_trace.tracks = g_ptr_array_new_with_free_func(g_free);
+    g_ptr_array_add(apple_boot_trace.tracks, g_strdup("machine"));
+    g_ptr_array_add(apple_boot_trace.tracks, g_strdup("guest"));
+    apple_boot_trace.exit_notifier.notify = apple_boot_trace_write;
+    qemu_add_exit_notifier(&apple_boot_trace.exit_notifier);
+    qatomic_set(&apple_boot_trace.enabled, true);
+}
+
+bool apple_boot_trace_enabled(void)
+{
+    return qatomic_read(&apple_boot_trace.enabled);
+}
+
+int apple_boot_trace_track(const char *name)
+{
+    int i;
+
+    if (!apple_boot_trace_enabled()) {
+        return APPLE_BOOT_TRACE_MACHINE;
+    }
+
+    QEMU_LOCK_GUARD(&apple_boot_trace.lock);
+    for (i = 0; i < apple_boot_trace.tracks->len; i++) {
+        if (!strcmp(g_ptr_array_index(apple_boot_trace.tracks, i), name)) {
+            return i;
+        }
+    }
+    g_ptr_array_add(apple_boot_trace.tracks, g_strdup(name));
+    return i;
+}
+
+int64_t apple_boot_trace_now(void)
+{
+    return get_clock();
+}
+
+void apple_boot_trace_complete(int track, const char *name, int64_t start_ns)
+{
+    if (!apple_boot_trace_enabled()) {
+        return;
+    }
+    apple_boot_trace_record(track, name, start_ns, get_clock() - start_ns);
+}
+
+void apple_boot_trace_instant(int track, const char *name)
+{
+    if (!apple_boot_trace_enabled()) {
+        return;
+    }
+    apple_boot_trace_record(track, name, get_clock(), -1);
+}
@@ -8,6 +8,8 @@
 #include "migration/vmstate.h"
 #include "trace.h"
 #include "hw/qdev-properties.h"
+#include "hw/misc/apple_soc_stats.h"
+#include "hw/misc/apple_boot_trace.h"
 
 #define IOP_LOG_MSG(s, msg) \
 do { qemu_log_mask(LOG_GUEST_ERROR, "%s: message:" \
@@ -56,6 +58,9 @@ do { qemu_log_mask(LOG_GUEST_ERROR, "%s: message:" \
 #define REG_A7V4_I2A_RECV0                  0x8830
 #define REG_A7V4_I2A_RECV1                  0x8838
 
+/* Raw endpoint numbers above this are not accounted per endpoint */
+#define APPLE_MBOX_STATS_EP_MAX             256
+
 #define REG_A7V2_INT_MASK_SET               0x4000
 #define REG_A7V2_INT_MASK_CLR               0x4004
 #define REG_A7V2_I2A_NON_EMPTY                  (1 << 12)
@@ -215,6 +220,13 @@ struct AppleMboxState {
     uint32_t int_mask;
     uint32_t iop_int_mask;
     bool real;
+
+    int64_t boot_trace_handshake_ns;
+    int64_t boot_trace_rollcall_ns;
+
+    AppleSoCStats stats;
+    Stat64 ep_messages_in[APPLE_MBOX_STATS_EP_MAX];
+    Stat64 ep_messages_out[APPLE_MBOX_STATS_EP_MAX];
 };
 
 struct iop_rollcall_data {
@@ -303,6 +315,9 @@ static void apple_mbox_inbox_push(AppleMboxState *s,
 {
     QTAILQ_INSERT_TAIL(&s->inbox, msg, entry);
     s->inboxCount++;
+    if (msg->endpoint < APPLE_MBOX_STATS_EP_MAX) {
+        stat64_add(&s->ep_messages_in[msg->endpoint], 1);
+    }
     ap_update_irq(s);
     qemu_bh_schedule(s->bh);
 }
@@ -327,6 +342,9 @@ static void apple_mbox_push(AppleMboxState *s,
 {
     QTAILQ_INSERT_TAIL(&s->outbox, msg, entry);
     s->outboxCount++;
+    if (msg->endpoint < APPLE_MBOX_STATS_EP_MAX) {
+        stat64_add(&s->ep_messages_out[msg->endpoint], 1);
+    }
     ap_update_irq(s);
 }
 
@@ -416,6 +434,18 @@ static void iop_wakeup(AppleMboxState *s)
     }
 }
 
+static void iop_boot_trace(AppleMboxState *s, const char *phase,
+                           int64_t start_ns)
+{
+    g_autofree char *track = NULL;
+
+    if (!apple_boot_trace_enabled()) {
+        return;
+    }
+    track = g_strdup_printf("rtkit-%s", s->role);
+    apple_boot_trace_complete(apple_boot_trace_track(track), phase, start_ns);
+}
+
 static void iop_handle_management_msg(void *opaque, uint32_t ep,
                                                     uint64_t message)
 {
@@ -452,6 +482,7 @@ static void iop_handle_management_msg(void *opaque, uint32_t ep,
                 switch (MSG_GET_PSTATE(msg->raw)) {
                 case PSTATE_WAIT_VR:
                 case PSTATE_ON:
+                    s->boot_trace_handshake_ns = apple_boot_trace_now();
                     iop_wakeup(s);
                     m.type = MSG_SEND_HELLO;
                     m.hello.major = s->protocol_version;
@@ -479,6 +510,8 @@ static void iop_handle_management_msg(void *opaque, uint32_t ep,
             break;
         case EP0_WAIT_HELLO:
             if (msg->type == MSG_RECV_HELLO) {
+                iop_boot_trace(s, "hello", s->boot_trace_handshake_ns);
+                s->boot_trace_rollcall_ns = apple_boot_trace_now();
                 iop_start_rollcall(s);
             } else {
                 IOP_LOG_MGMT_MSG(s, msg);
@@ -493,6 +526,8 @@ static void iop_handle_management_msg(void *opaque, uint32_t ep,
                     m.power.state = 32;
                     s->ep0_status = EP0_IDLE;
                     apple_mbox_send_control_message(s, 0, m.raw);
+                    iop_boot_trace(s, "rollcall", s->boot_trace_rollcall_ns);
+                    iop_boot_trace(s, "handshake", s->boot_trace_handshake_ns);
                 } else {
                     apple_mbox_msg_t m = QTAILQ_FIRST(&s->rollcall);
                     QTAILQ_REMOVE(&s->rollcall, m, entry);
@@ -550,6 +585,8 @@ static void apple_mbox_reg_write(void *opaque, hwaddr addr,
     bool doorbell = false;
     bool iflg = false;
 
+    apple_soc_stats_mmio_write(&s->stats);
+
     s->int_mask = 0;
     WITH_QEMU_LOCK_GUARD(&s->mutex) {
         switch (addr) {
@@ -616,6 +653,8 @@ static uint64_t apple_mbox_reg_read(void *opaque, hwaddr addr,
 {
     AppleMboxState *s = APPLE_MBOX(opaque);
     uint64_t ret = 0;
+
+    apple_soc_stats_mmio_read(&s->stats);
     WITH_QEMU_LOCK_GUARD(&s->mutex) {
         apple_mbox_msg_t m;
         memcpy(&ret, &s->regs[addr], size);
@@ -682,6 +721,8 @@ static void apple_mbox_v2_reg_write(void *opaque, hwaddr addr,
     bool doorbell = false;
     bool iflg = false;
 
+    apple_soc_stats_mmio_write(&s->stats);
+
     WITH_QEMU_LOCK_GUARD(&s->mutex) {
         switch (addr) {
             case REG_A7V4_CPU_CTRL:
@@ -747,6 +788,7 @@ static uint64_t apple_mbox_v2_reg_read(void *opaque, hwaddr addr,
     AppleMboxState *s = APPLE_MBOX(opaque);
     uint64_t ret = 0;
 
+    apple_soc_stats_mmio_read(&s->stats);
     WITH_QEMU_LOCK_GUARD(&s->mutex) {
         apple_mbox_msg_t m;
         memcpy(&ret, &s->regs[addr], size);
@@ -806,6 +848,7 @@ static void apple_mbox_iop_reg_write(void *opaque, hwaddr addr,
     bool iflg = false;
     uint32_t value = data;
 
+    apple_soc_stats_mmio_write(&s->stats);
     WITH_QEMU_LOCK_GUARD(&s->mutex) {
         switch (addr) {
             case REG_IOP_I2A_SEND0:
@@ -855,6 +898,7 @@ static uint64_t apple_mbox_iop_reg_read(void *opaque, hwaddr addr,
 {
     AppleMboxState *s = APPLE_MBOX(opaque);
 
+    apple_soc_stats_mmio_read(&s->stats);
     WITH_QEMU_LOCK_GUARD(&s->mutex) {
         apple_mbox_msg_t m;
         uint32_t ret = 0;
@@ -1022,16 +1066,65 @@ AppleMboxState *apple_mbox_create(const char *role,
     return s;
 }
 
+struct apple_mbox_stats_data {
+    AppleMboxState *s;
+    AppleSoCEndpointStatsList **tail;
+};
+
+static gboolean apple_mbox_stats_fill_ep(gpointer key, gpointer value,
+                                         gpointer data)
+{
+    struct apple_mbox_stats_data *d = data;
+    AppleMboxState *s = d->s;
+    uint32_t ep = GPOINTER_TO_UINT(key);
+    AppleSoCEndpointStats *info;
+    apple_mbox_msg_t m;
+
+    if (ep >= APPLE_MBOX_STATS_EP_MAX) {
+        return false;
+    }
+
+    info = g_new0(AppleSoCEndpointStats, 1);
+    info->endpoint = ep;
+    info->messages_in = stat64_get(&s->ep_messages_in[ep]);
+    info->messages_out = stat64_get(&s->ep_messages_out[ep]);
+    QTAILQ_FOREACH(m, &s->inbox, entry) {
+        info->inbox_depth += m->endpoint == ep;
+    }
+    QTAILQ_FOREACH(m, &s->outbox, entry) {
+        info->outbox_depth += m->endpoint == ep;
+    }
+    QAPI_LIST_APPEND(d->tail, info);
+    return false;
+}
+
+static void apple_mbox_stats_fill(void *opaque, AppleSoCDeviceStats *info)
+{
+    AppleMboxState *s = APPLE_MBOX(opaque);
+    struct apple_mbox_stats_data d = { .s = s, .tail = &info->endpoints };
+
+    WITH_QEMU_LOCK_GUARD(&s->mutex) {
+        g_tree_foreach(s->endpoints, apple_mbox_stats_fill_ep, &d);
+    }
+    info->has_endpoints = info->endpoints != NULL;
+}
+
 static void apple_mbox_realize(DeviceState *dev, Error **errp)
 {
     AppleMboxState *s = APPLE_MBOX(dev);
+    g_autofree char *name = g_strdup_printf("mbox-%s", s->role);
+
     ap_update_irq(s);
 
     s->bh = qemu_bh_new(apple_mbox_bh, s);
+    apple_soc_stats_register(&s->stats, name, apple_mbox_stats_fill, s);
 }
 
 static void apple_mbox_unrealize(DeviceState *dev)
 {
+    AppleMboxState *s = APPLE_MBOX(dev);
+
+    apple_soc_stats_unregister(&s->stats);
 }
 
 static void apple_mbox_reset(DeviceState *dev)
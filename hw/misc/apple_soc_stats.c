@@ -0,0 +1,103 @@
+/*
+ * Apple SoC device statistics
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qapi/qapi-commands-apple.h"
+#include "qapi/qmp/qdict.h"
+#include "monitor/hmp.h"
+#include "monitor/monitor.h"
+#include "hw/misc/apple_soc_stats.h"
+
+/* Protected by the BQL */
+static QTAILQ_HEAD(, AppleSoCStats) apple_soc_stats =
+    QTAILQ_HEAD_INITIALIZER(apple_soc_stats);
+
+void apple_soc_stats_register(AppleSoCStats *stats, const char *name,
+                              AppleSoCStatsFill *fill, void *opaque)
+{
+    stats->name = g_strdup(name);
+    stats->fill = fill;
+    stats->opaque = opaque;
+    stat64_init(&stats->mmio_reads, 0);
+    stat64_init(&stats->mmio_writes, 0);
+    QTAILQ_INSERT_TAIL(&apple_soc_stats, stats, next);
+}
+
+void apple_soc_stats_unregister(AppleSoCStats *stats)
+{
+    QTAILQ_REMOVE(&apple_soc_stats, stats, next);
+    g_free(stats->name);
+    stats->name = NULL;
+}
+
+AppleSoCDeviceStatsList *qmp_query_apple_soc_stats(Error **errp)
+{
+    AppleSoCDeviceStatsList *head = NULL;
+    AppleSoCDeviceStatsList **tail = &head;
+    AppleSoCStats *stats;
+
+    QTAILQ_FOREACH(stats, &apple_soc_stats, next) {
+        AppleSoCDeviceStats *info = g_new0(AppleSoCDeviceStats, 1);
+
+        info->name = g_strdup(stats->name);
+        info->mmio_reads = stat64_get(&stats->mmio_reads);
+        info->mmio_writes = stat64_get(&stats->mmio_writes);
+        if (stats->fill) {
+            stats->fill(stats->opaque, info);
+        }
+        QAPI_LIST_APPEND(tail, info);
+    }
+
+    return head;
+}
+
+void hmp_info_apple_stats(Monitor *mon, const QDict *qdict)
+{
+    const char *name = qdict_get_try_str(qdict, "name");
+    AppleSoCDeviceStatsList *list = qmp_query_apple_soc_stats(NULL);
+    AppleSoCDeviceStatsList *l;
+    bool found = false;
+
+    for (l = list; l; l = l->next) {
+        AppleSoCDeviceStats *info = l->value;
+        AppleSoCIrqStatsList *irq;
+        AppleSoCEndpointStatsList *ep;
+
+        if (name && strcmp(name, info->name)) {
+            continue;
+        }
+        found = true;
+        monitor_printf(mon, "%s: mmio reads %" PRIu64 " writes %" PRIu64 "\n",
+                       info->name, info->mmio_reads, info->mmio_writes);
+        for (irq = info->irqs; irq; irq = irq->next) {
+            monitor_printf(mon, "\tirq %u: %" PRIu64 "\n",
+                           irq->value->irq, irq->value->count);
+        }
+        for (ep = info->endpoints; ep; ep = ep->next) {
+            monitor_printf(mon, "\tendpoint %u: in %" PRIu64 " out %" PRIu64
+                           " inbox %u outbox %u\n", ep->value->endpoint,
+                           ep->value->messages_in, ep->value->messages_out,
+                           ep->value->inbox_depth, ep->value->outbox_depth);
+        }
+        if (info->dart) {
+            monitor_printf(mon, "\ttlb hits %" PRIu64 " misses %" PRIu64
+                           " walks %" PRIu64 "\n", info->dart->tlb_hits,
+                           info->dart->tlb_misses, info->dart->walks);
+        }
+        if (info->has_bytes_processed) {
+            monitor_printf(mon, "\tbytes processed %" PRIu64 "\n",
+                           info->bytes_processed);
+        }
+    }
+
+    if (name && !found) {
+        monitor_printf(mon, "Cannot find device %s\n", name);
+    }
+
+    qapi_free_AppleSoCDeviceStatsList(list);
+}
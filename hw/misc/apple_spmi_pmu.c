@@ -225,13 +225,23 @@ DeviceState *apple_spmi_pmu_create(DTBNode *node)
     return dev;
 }
 
+/* Version 0 streams carry the whole register file */
+static bool apple_spmi_pmu_v0(void *opaque, int version_id)
+{
+    return version_id < 1;
+}
+
 static const VMStateDescription vmstate_apple_spmi_pmu = {
     .name = "apple_spmi_pmu",
+    .version_id = 1,
+    .minimum_version_id = 0,
     .fields = (VMStateField[]) {
         VMSTATE_UINT64(tick_offset, AppleSPMIPMUState),
         VMSTATE_UINT64(rtc_offset, AppleSPMIPMUState),
         VMSTATE_UINT16(addr, AppleSPMIPMUState),
-        VMSTATE_UINT8_ARRAY(reg, AppleSPMIPMUState, 0xffff),
+        VMSTATE_ARRAY_TEST(reg, AppleSPMIPMUState, 0xffff, apple_spmi_pmu_v0,
+                           vmstate_info_uint8, uint8_t),
+        VMSTATE_UINT8_SPARSE_ARRAY_V(reg, AppleSPMIPMUState, 0xffff, 1),
         VMSTATE_TIMER_PTR(timer, AppleSPMIPMUState),
         VMSTATE_END_OF_LIST()
     }
@@ -9,6 +9,9 @@
 #include "hw/arm/xnu.h"
 #include "hw/arm/xnu_dtb.h"
 #include "hw/spmi/apple_spmi.h"
+#include "hw/misc/apple_soc_stats.h"
+#include "qemu/timer.h"
+#include "trace.h"
 
 //#define DEBUG_SPMI
 
@@ -166,6 +169,133 @@ static void apple_spmi_update_queues_status(AppleSPMIState *s)
     }
 }
 
+/* Execute one request queue word; returns true when a transaction ended */
+static bool apple_spmi_req_push(AppleSPMIState *s, uint32_t value)
+{
+    if (s->data == NULL) {
+        uint8_t sid = SPMI_REQ_SID(value);
+        uint8_t opc = spmi_opcode(value);
+        uint32_t addr = spmi_address(value);
+        bool parity = !(value & SPMI_REQ_FINAL);
+        uint32_t len = spmi_data_length(value);
+
+        s->command = value;
+        #ifdef DEBUG_SPMI
+        qemu_log_mask(LOG_UNIMP, "%s: sid: 0x%x opc: 0x%x addr: 0x%x len: 0x%x\n",
+                                 DEVICE(s)->id, sid, opc, addr, len);
+        #endif
+
+        if (opc == SPMI_CMD_EXT_WRITE || opc == SPMI_CMD_EXT_WRITEL) {
+            s->data_length = (len + 3) / 4;
+            s->data_filled = 0;
+            s->data = g_new0(uint32_t, s->data_length);
+        }
+        if (spmi_start_transfer(s->bus, sid, opc, addr)) {
+            return false;
+        }
+        if (s->data == NULL && len) {
+            assert(opc == SPMI_CMD_EXT_READ || opc == SPMI_CMD_EXT_READL);
+            g_autofree uint32_t *data = g_malloc0(len + 3);
+            int count = spmi_recv(s->bus, (uint8_t *)data, len);
+            uint8_t ack = 0;
+            value &= 0xFFF;
+            if (count > 0) {
+                ack = ~(-1 << count);
+            }
+            value |= (ack << SPMI_RSP_ACK_SHIFT);
+            fifo32_push(&s->resp_fifo, value);
+            for (int i = 0; i < (len + 3) / 4; i++) {
+                fifo32_push(&s->resp_fifo, data[i]);
+            }
+        }
+        if (s->data == NULL && !parity) {
+            spmi_end_transfer(s->bus);
+            return true;
+        }
+    } else {
+        s->data[s->data_filled++] = value;
+        if (s->data_filled >= s->data_length) {
+            uint32_t requested_len = spmi_data_length(s->command);
+            uint32_t count = spmi_send(s->bus, (uint8_t *)s->data,
+                                       requested_len);
+            fifo32_push(&s->resp_fifo, (s->command & 0xFFF)
+                                       | ((count == requested_len) << 15));
+            g_free(s->data);
+            s->data = NULL;
+            s->data_length = 0;
+            if (s->command & SPMI_REQ_FINAL) {
+                spmi_end_transfer(s->bus);
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/*
+ * Execute the queued request words as one batch and update the response
+ * queue and interrupt state once for all of them.
+ */
+static void apple_spmi_run(AppleSPMIState *s)
+{
+    unsigned words = fifo32_num_used(&s->req_fifo);
+    bool done = false;
+
+    if (!words) {
+        return;
+    }
+
+    while (!fifo32_is_empty(&s->req_fifo)) {
+        if (apple_spmi_req_push(s, fifo32_pop(&s->req_fifo))) {
+            s->xfers++;
+            done = true;
+        }
+    }
+    trace_apple_spmi_batch(DEVICE(s)->id, words);
+
+    if (done) {
+        int64_t now = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+
+        if (now - s->xfer_window >= NANOSECONDS_PER_SECOND) {
+            if (s->xfer_window) {
+                trace_apple_spmi_rate(DEVICE(s)->id, s->xfers *
+                                      NANOSECONDS_PER_SECOND /
+                                      (now - s->xfer_window));
+            }
+            s->xfer_window = now;
+            s->xfers = 0;
+        }
+        apple_spmi_update_queues_status(s);
+        apple_spmi_update_irq(s);
+    }
+}
+
+/*
+ * Queue a request word.  The batch runs once a final command has all of
+ * its data, when the queue fills up, or before the guest looks at any
+ * register that could observe the result.
+ */
+static void apple_spmi_req_queue(AppleSPMIState *s, uint32_t value)
+{
+    bool run;
+
+    fifo32_push(&s->req_fifo, value);
+    if (s->req_data_left) {
+        run = !--s->req_data_left && s->req_final;
+    } else {
+        uint8_t opc = spmi_opcode(value);
+
+        s->req_final = value & SPMI_REQ_FINAL;
+        if (opc == SPMI_CMD_EXT_WRITE || opc == SPMI_CMD_EXT_WRITEL) {
+            s->req_data_left = (spmi_data_length(value) + 3) / 4;
+        }
+        run = !s->req_data_left && s->req_final;
+    }
+    if (run || fifo32_is_full(&s->req_fifo)) {
+        apple_spmi_run(s);
+    }
+}
+
 static void apple_spmi_queue_reg_write(void *opaque, hwaddr addr,
                                        uint64_t data,
                                        unsigned size)
@@ -174,76 +304,22 @@ static void apple_spmi_queue_reg_write(void *opaque, hwaddr addr,
     uint32_t value = data;
     uint32_t *mmio = &s->queue_reg[addr >> 2];
     bool iflg = false;
-    bool qflg = false;
+
+    apple_soc_stats_mmio_write(&s->stats);
 #ifdef DEBUG_SPMI
     qemu_log_mask(LOG_UNIMP, "%s: %s @ 0x"
     TARGET_FMT_plx " value: 0x" TARGET_FMT_plx "\n", DEVICE(s)->id,
     __func__, addr, data);
 #endif
 
+    if (addr != SPMI_REQ_QUEUE_PUSH) {
+        apple_spmi_run(s);
+    }
+
     switch (addr) {
-    case SPMI_REQ_QUEUE_PUSH: {
-        if (s->data == NULL) {
-            uint8_t sid = SPMI_REQ_SID(value);
-            uint8_t opc = spmi_opcode(value);
-            uint32_t addr = spmi_address(value);
-            bool parity = !(value & SPMI_REQ_FINAL);
-            uint32_t len = spmi_data_length(value);
-
-            s->command = value;
-            #ifdef DEBUG_SPMI
-            qemu_log_mask(LOG_UNIMP, "%s: sid: 0x%x opc: 0x%x addr: 0x%x len: 0x%x\n",
-                                     DEVICE(s)->id, sid, opc, addr, len);
-            #endif
-
-            if (opc == SPMI_CMD_EXT_WRITE || opc == SPMI_CMD_EXT_WRITEL) {
-                s->data_length = (len + 3) / 4;
-                s->data_filled = 0;
-                s->data = g_new0(uint32_t, s->data_length);
-            }
-            if (spmi_start_transfer(s->bus, sid, opc, addr)) {
-                return;
-            }
-            if (s->data == NULL && len) {
-                assert(opc == SPMI_CMD_EXT_READ || opc == SPMI_CMD_EXT_READL);
-                g_autofree uint32_t *data = g_malloc0(len + 3);
-                int count = spmi_recv(s->bus, (uint8_t *)data, len);
-                uint8_t ack = 0;
-                value &= 0xFFF;
-                if (count > 0) {
-                    ack = ~(-1 << count);
-                }
-                value |= (ack << SPMI_RSP_ACK_SHIFT);
-                fifo32_push(&s->resp_fifo, value);
-                for (int i = 0; i < (len + 3) / 4; i++) {
-                    fifo32_push(&s->resp_fifo, data[i]);
-                }
-            }
-            if (s->data == NULL && !parity) {
-                spmi_end_transfer(s->bus);
-                qflg = 1;
-                iflg = 1;
-            }
-        } else {
-            s->data[s->data_filled++] = value;
-            if (s->data_filled >= s->data_length) {
-                uint32_t requested_len = spmi_data_length(s->command);
-                uint32_t count = spmi_send(s->bus, (uint8_t *)s->data,
-                                           requested_len);
-                fifo32_push(&s->resp_fifo, (s->command & 0xFFF)
-                                           | ((count == requested_len) << 15));
-                g_free(s->data);
-                s->data = NULL;
-                s->data_length = 0;
-                if (s->command & SPMI_REQ_FINAL) {
-                    spmi_end_transfer(s->bus);
-                    qflg = 1;
-                    iflg = 1;
-                }
-            }
-        }
+    case SPMI_REQ_QUEUE_PUSH:
+        apple_spmi_req_queue(s, value);
         break;
-    }
     case SPMI_INT_ENAB(0) ... SPMI_INT_ENAB(SPMI_NUM_IRQ_BANK - 1):
         iflg = true;
         break;
@@ -255,9 +331,6 @@ static void apple_spmi_queue_reg_write(void *opaque, hwaddr addr,
         break;
     }
     *mmio = value;
-    if (qflg) {
-        apple_spmi_update_queues_status(s);
-    }
     if (iflg) {
         apple_spmi_update_irq(s);
     }
@@ -271,6 +344,9 @@ static uint64_t apple_spmi_queue_reg_read(void *opaque,
     bool qflg = false;
     bool iflg = false;
     uint32_t value = 0;
+
+    apple_soc_stats_mmio_read(&s->stats);
+    apple_spmi_run(s);
     value = s->queue_reg[addr >> 2];
 
     switch (addr) {
@@ -327,6 +403,9 @@ static uint64_t apple_spmi_control_read(void *opaque, hwaddr addr, unsigned size
     bool qflg = false;
     bool iflg = false;
     uint32_t value = 0;
+
+    apple_soc_stats_mmio_read(&s->stats);
+    apple_spmi_run(s);
     value = s->control_reg[addr >> 2];
 
     switch (addr) {
@@ -355,12 +434,16 @@ static void apple_spmi_control_write(void *opaque, hwaddr addr,
     uint32_t *mmio = &s->control_reg[addr >> 2];
     bool iflg = false;
     bool qflg = false;
+
+    apple_soc_stats_mmio_write(&s->stats);
 #ifdef DEBUG_SPMI
     qemu_log_mask(LOG_UNIMP, "%s: %s @ 0x"
     TARGET_FMT_plx " value: 0x" TARGET_FMT_plx "\n",
     DEVICE(s)->id, __func__, addr, data);
 #endif
 
+    apple_spmi_run(s);
+
     switch (addr) {
     case SPMI_CONTROL_QUEUE_RESET:
         if (value & SPMI_CONTROL_QUEUE_RESET_RSP) {
@@ -399,6 +482,9 @@ static uint64_t apple_spmi_fault_read(void *opaque, hwaddr addr, unsigned size)
     bool qflg = false;
     bool iflg = false;
     uint32_t value = 0;
+
+    apple_soc_stats_mmio_read(&s->stats);
+    apple_spmi_run(s);
     value = s->fault_reg[addr >> 2];
 
     switch (addr) {
@@ -432,6 +518,8 @@ static void apple_spmi_fault_write(void *opaque, hwaddr addr,
     uint32_t *mmio = &s->fault_reg[addr >> 2];
     bool iflg = false;
     bool qflg = false;
+
+    apple_soc_stats_mmio_write(&s->stats);
 #ifdef DEBUG_SPMI
     qemu_log_mask(LOG_UNIMP, "%s: %s @ 0x"
     TARGET_FMT_plx " value: 0x" TARGET_FMT_plx "\n",
@@ -475,6 +563,9 @@ static void apple_spmi_reset_enter(Object *obj, ResetType type)
     memset(s->fault_reg, 0, sizeof(s->fault_reg));
     memset(s->fault_counter_reg, 0, sizeof(s->fault_counter_reg));
     fifo32_reset(&s->resp_fifo);
+    fifo32_reset(&s->req_fifo);
+    s->req_data_left = 0;
+    s->req_final = false;
     if (s->data) {
         g_free(s->data);
     }
@@ -504,6 +595,14 @@ static void apple_spmi_realize(DeviceState *dev, Error **errp)
 
     qdev_connect_gpio_out_named(dev, APPLE_SPMI_RESP_IRQ, 0,
                                 qdev_get_gpio_in(dev, s->resp_intr_index));
+    apple_soc_stats_register(&s->stats, dev->id, NULL, NULL);
+}
+
+static void apple_spmi_unrealize(DeviceState *dev)
+{
+    AppleSPMIState *s = APPLE_SPMI(dev);
+
+    apple_soc_stats_unregister(&s->stats);
 }
 
 static void apple_spmi_init(Object *obj)
@@ -516,6 +615,7 @@ static void apple_spmi_init(Object *obj)
     s->resp_intr_index = SPMI_RESP_IRQ;
 
     fifo32_create(&s->resp_fifo, SPMI_QUEUE_DEPTH);
+    fifo32_create(&s->req_fifo, SPMI_QUEUE_DEPTH);
 
     memory_region_init_io(&s->iomems[0], obj, &apple_spmi_queue_reg_ops,
                           s, TYPE_APPLE_SPMI ".queue_reg", sizeof(s->queue_reg));
@@ -591,8 +691,31 @@ SysBusDevice *apple_spmi_create(DTBNode *node)
     return sbd;
 }
 
+static int apple_spmi_pre_save(void *opaque)
+{
+    AppleSPMIState *s = APPLE_SPMI(opaque);
+
+    /*
+     * Run what is queued so that only the per word state machine below
+     * is migrated; a partial command continues from s->data.
+     */
+    apple_spmi_run(s);
+    return 0;
+}
+
+static int apple_spmi_post_load(void *opaque, int version_id)
+{
+    AppleSPMIState *s = APPLE_SPMI(opaque);
+
+    s->req_data_left = s->data ? s->data_length - s->data_filled : 0;
+    s->req_final = s->command & SPMI_REQ_FINAL;
+    return 0;
+}
+
 static const VMStateDescription vmstate_apple_spmi = {
     .name = "apple_spmi",
+    .pre_save = apple_spmi_pre_save,
+    .post_load = apple_spmi_post_load,
     .fields = (VMStateField[]) {
         VMSTATE_FIFO32(resp_fifo, AppleSPMIState),
         VMSTATE_UINT32_ARRAY(control_reg, AppleSPMIState,
@@ -620,6 +743,7 @@ static void apple_spmi_class_init(ObjectClass *klass, void *data)
     ResettableClass *rc = RESETTABLE_CLASS(klass);
 
     dc->realize = apple_spmi_realize;
+    dc->unrealize = apple_spmi_unrealize;
     dc->desc = "Apple SPMI Controller";
     dc->vmsd = &vmstate_apple_spmi;
     set_bit(DEVICE_CATEGORY_BRIDGE, dc->categories);
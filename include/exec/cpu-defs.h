@@ -167,7 +167,18 @@ typedef struct CPUTLBDesc {
     int64_t window_begin_ns;
     /* maximum number of entries observed in the window */
     size_t window_max_entries;
+    /* misses observed in the window: victim tlb hits and refills */
+    size_t window_victim_hits;
+    size_t window_fills;
     size_t n_used_entries;
+    /*
+     * Statistics, read atomically by the monitor like those in
+     * CPUTLBCommon.  Hits in the fast path are not counted since they
+     * never leave the generated code.
+     */
+    size_t victim_hit_count;
+    size_t fill_count;
+    size_t flush_count;
     /* The next index to use in the tlb victim table.  */
     size_t vindex;
     /* The tlb victim table, in two parts.  */
@@ -208,6 +219,9 @@ typedef struct CPUTLBCommon {
     size_t full_flush_count;
     size_t part_flush_count;
     size_t elide_flush_count;
+    /* Range flushes done in place, and those that became full flushes */
+    size_t range_flush_count;
+    size_t range_full_flush_count;
 } CPUTLBCommon;
 
 /*
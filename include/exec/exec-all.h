@@ -490,6 +490,14 @@ struct TranslationBlock {
     uint16_t size;
     uint16_t icount;
 
+    /*
+     * Tiered translation (-accel tcg,hot-threshold): executions counted by
+     * the generated code, and the number of guest blocks merged into this
+     * TB, 0 if it is not a superblock.
+     */
+    uint32_t exec_count;
+    uint16_t sb_blocks;
+
     struct tb_tc tc;
 
     /* first and second physical page containing code. The lower bit
@@ -64,6 +64,8 @@ typedef enum DisasJumpType {
  * @num_insns: Number of translated instructions (including current).
  * @max_insns: Maximum number of instructions to be translated in this TB.
  * @singlestep_enabled: "Hardware" single stepping enabled.
+ * @superblock: The TB is hot and may follow direct branches.
+ * @sb_blocks: Number of guest blocks merged into the superblock so far.
  *
  * Architecture-agnostic disassembly context.
  */
@@ -75,6 +77,8 @@ typedef struct DisasContextBase {
     int num_insns;
     int max_insns;
     bool singlestep_enabled;
+    bool superblock;
+    int sb_blocks;
 #ifdef CONFIG_USER_ONLY
     /*
      * Guest address of the last byte of the last protected page.
@@ -156,6 +160,22 @@ void translator_loop_temp_check(DisasContextBase *db);
  */
 bool translator_use_goto_tb(DisasContextBase *db, target_ulong dest);
 
+/* Upper bound of guest blocks merged into one superblock */
+#define TB_SUPERBLOCK_MAX_BLOCKS 8
+
+/**
+ * translator_extend_superblock
+ * @db: Disassembly context
+ * @dest: target pc of a direct branch
+ *
+ * Return true if translation may continue at @dest instead of ending the
+ * TB: the TB is a superblock with room for another block, and @dest is a
+ * forward target on the same page, so that [pc_first, pc_next) keeps
+ * covering all the translated code for invalidation.  On success the
+ * caller sets pc_next to @dest and leaves is_jmp as DISAS_NEXT.
+ */
+bool translator_extend_superblock(DisasContextBase *db, target_ulong dest);
+
 /*
  * Translator Load Functions
  *
@@ -5,6 +5,7 @@
 #include "cpu.h"
 #include "exec/hwaddr.h"
 #include "qemu/queue.h"
+#include "qemu/stats64.h"
 #include "hw/arm/xnu_dtb.h"
 #include "hw/cpu/cluster.h"
 
@@ -43,10 +44,19 @@ typedef struct AppleA13State {
     uint32_t cpu_id;
     uint32_t phys_id;
     uint32_t cluster_id;
+    uint32_t cluster_type;
     uint64_t mpidr;
     uint64_t ipi_sr;
     hwaddr cluster_reg[2];
     qemu_irq fast_ipi;
+    /* host-side scheduling */
+    int throttle_scheduled;
+    int64_t exec_start_ns;
+    int64_t idle_start_ns;
+    int64_t off_start_ns;
+    Stat64 exec_ns;
+    Stat64 idle_ns;
+    Stat64 off_ns;
     A13_CPREG_VAR_DEF(ARM64_REG_EHID4);
     A13_CPREG_VAR_DEF(ARM64_REG_EHID10);
     A13_CPREG_VAR_DEF(ARM64_REG_HID0);
@@ -90,6 +100,9 @@ typedef struct AppleA13Cluster {
     uint32_t noWakeIPI[A13_MAX_CPU][A13_MAX_CPU];
     uint64_t tick;
     uint64_t ipi_cr;
+    char *host_cpus;
+    uint32_t throttle;
+    QEMUTimer *throttle_timer;
     QTAILQ_ENTRY(AppleA13Cluster) next;
     A13_CPREG_VAR_DEF(CTRR_A_LWR_EL1);
     A13_CPREG_VAR_DEF(CTRR_A_UPR_EL1);
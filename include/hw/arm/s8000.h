@@ -70,5 +70,7 @@ typedef struct
     hwaddr panic_size;
     char pmgr_reg[0x100000];
     bool force_dfu;
+    char *dfu_image;
+    bool srom_mapped;
 } S8000MachineState;
 #endif
@@ -84,5 +84,10 @@ typedef struct
     MemoryRegion amcc;
     uint8_t amcc_reg[0x100000];
     bool kaslr_off;
+    char *ecluster_host_cpus;
+    char *pcluster_host_cpus;
+    uint32_t ecluster_throttle;
+    char *boot_trace_filename;
+    char *dram_snapshot;
 } T8030MachineState;
 #endif
@@ -318,6 +318,9 @@ void macho_setup_bootargs(const char *name, AddressSpace *as,
 void macho_allocate_segment_records(DTBNode *memory_map,
                                     struct mach_header_64 *mh);
 
+/* Unslid address of the kernel symbol @name, or 0 if it is not exported */
+uint64_t macho_find_symbol(struct mach_header_64 *mh, const char *name);
+
 hwaddr arm_load_macho(struct mach_header_64 *mh, AddressSpace *as, MemoryRegion *mem,
                       DTBNode *memory_map, hwaddr phys_base, hwaddr virt_slide);
 
@@ -335,6 +338,7 @@ void macho_load_dtb(DTBNode *root, AddressSpace *as, MemoryRegion *mem,
                     const char *name, macho_boot_info_t info);
 
 uint8_t *load_trustcache_from_file(const char *filename, uint64_t *size);
+uint8_t *load_im4p_payload_from_file(const char *filename, uint64_t *size);
 void macho_load_trustcache(void *trustcache, uint64_t size,
                            AddressSpace *as, MemoryRegion *mem, hwaddr pa);
 
@@ -46,6 +46,6 @@ uint8_t get_highest_different_bit_index(hwaddr addr1, hwaddr addr2);
 uint8_t get_lowest_non_zero_bit_index(hwaddr addr);
 hwaddr get_low_bits_mask_for_bit_index(uint8_t bit_index);
 
-void allocate_ram(MemoryRegion *top, const char *name, hwaddr addr,
-                  hwaddr size, int priority);
+MemoryRegion *allocate_ram(MemoryRegion *top, const char *name, hwaddr addr,
+                           hwaddr size, int priority);
 #endif
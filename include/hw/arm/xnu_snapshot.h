@@ -0,0 +1,32 @@
+/*
+ * Incremental DRAM snapshots
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef HW_ARM_XNU_SNAPSHOT_H
+#define HW_ARM_XNU_SNAPSHOT_H
+
+#include "exec/memory.h"
+
+/*
+ * Keep the contents of @dram in a chain of files named <prefix>.<n>
+ * instead of the migration stream.
+ *
+ * Every savevm writes one link: the first one (<prefix>.0) is a sparse
+ * image of the whole region, the following ones only contain the pages
+ * dirtied since the previous link.  loadvm maps the chain up to the link
+ * recorded in the snapshot privately over @dram, so pages are read from
+ * the files on first touch instead of being copied upfront.
+ *
+ * A run that resumed from the chain records the pages it touched in
+ * <prefix>.hint at exit; the next restore reads those ahead in the
+ * background while the vCPUs are already running.
+ *
+ * Only savevm/loadvm carry DRAM this way; a live migration fails when it
+ * reaches the device state instead of completing without DRAM.
+ */
+void xnu_snapshot_init(MemoryRegion *dram, const char *prefix, Error **errp);
+
+#endif /* HW_ARM_XNU_SNAPSHOT_H */
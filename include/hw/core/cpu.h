@@ -277,6 +277,9 @@ struct qemu_work_item;
  * @halted: Nonzero if the CPU is in suspended state.
  * @stop: Indicates a pending stop request.
  * @stopped: Indicates the CPU has been artificially stopped.
+ * @parked: Indicates the CPU is powered off. Cross-vCPU TLB flushes skip
+ *          it, so the target must flush the TLB (e.g. via cpu_reset())
+ *          before clearing the flag and running guest code again.
  * @unplug: Indicates a pending CPU unplug request.
  * @crash_occurred: Indicates the OS reported a crash (panic) for this CPU
  * @singlestep_enabled: Flags for single-stepping.
@@ -333,6 +336,7 @@ struct CPUState {
     bool created;
     bool stop;
     bool stopped;
+    bool parked;
 
     /* Should CPU start in powered-off state? */
     bool start_powered_off;
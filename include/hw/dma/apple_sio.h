@@ -7,6 +7,7 @@
 #include "qemu/iov.h"
 #include "sysemu/dma.h"
 #include "hw/misc/apple_mbox.h"
+#include "hw/misc/apple_soc_stats.h"
 #include "hw/arm/xnu_dtb.h"
 
 #define TYPE_APPLE_SIO "apple.sio"
@@ -53,6 +54,8 @@ typedef struct AppleSIOState {
 
     AppleSIODMAEndpoint eps[SIO_NUM_EPS];
     uint32_t params[0x100];
+    AppleSoCStats stats;
+    Stat64 bytes_processed;
 } AppleSIOState;
 
 int apple_sio_dma_read(AppleSIODMAEndpoint *ep, void *buffer, size_t len);
@@ -4,6 +4,7 @@
 #include "hw/sysbus.h"
 #include "qom/object.h"
 #include "qemu/fifo8.h"
+#include "qemu/fifo32.h"
 #include "hw/arm/xnu_dtb.h"
 
 #define TYPE_APPLE_I2C "apple.i2c"
@@ -12,6 +13,7 @@ OBJECT_DECLARE_TYPE(AppleI2CState, AppleHWI2CClass, APPLE_I2C)
 #define APPLE_I2C_MMIO_SIZE  (0x10000)
 #define APPLE_I2C_SDA        "i2c.sda"
 #define APPLE_I2C_SCL        "i2c.scl"
+#define APPLE_I2C_CMD_FIFO_DEPTH  (0x100)
 
 typedef struct AppleHWI2CClass {
     /*< private >*/
@@ -32,6 +34,9 @@ typedef struct AppleI2CState {
     qemu_irq sda, scl;
     uint8_t reg[APPLE_I2C_MMIO_SIZE];
     Fifo8 rx_fifo;
+    Fifo32 cmd_fifo;
+    uint64_t xfers;
+    int64_t xfer_window;
     bool last_irq;
     bool nak;
     bool xip;
@@ -38,6 +38,14 @@ struct I2CSlaveClass {
      */
     uint8_t (*recv)(I2CSlave *s);
 
+    /*
+     * Optional multi-byte versions of send and recv, used by
+     * i2c_send_buf() and i2c_recv_buf().  send_buf returns non-zero if
+     * any byte was NAKed.
+     */
+    int (*send_buf)(I2CSlave *s, const uint8_t *buf, int len);
+    void (*recv_buf)(I2CSlave *s, uint8_t *buf, int len);
+
     /*
      * Notify the slave of a bus state change.  For start event,
      * returns non-zero to NAK an operation.  For other events the
@@ -149,6 +157,22 @@ void i2c_bus_release(I2CBus *bus);
 int i2c_send(I2CBus *bus, uint8_t data);
 int i2c_send_async(I2CBus *bus, uint8_t data);
 uint8_t i2c_recv(I2CBus *bus);
+
+/**
+ * i2c_send_buf: send @len bytes to the current slave(s) of @bus
+ *
+ * Slaves without a send_buf method get the bytes one at a time.
+ *
+ * Return: 0 on success, -1 if any byte was NAKed
+ */
+int i2c_send_buf(I2CBus *bus, const uint8_t *buf, int len);
+
+/**
+ * i2c_recv_buf: receive @len bytes from the current slave of @bus
+ *
+ * Slaves without a recv_buf method are read one byte at a time.
+ */
+void i2c_recv_buf(I2CBus *bus, uint8_t *buf, int len);
 bool i2c_scan_bus(I2CBus *bus, uint8_t address, bool broadcast,
                   I2CNodeList *current_devs);
 
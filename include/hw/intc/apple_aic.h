@@ -4,6 +4,7 @@
 #include "hw/sysbus.h"
 #include "qom/object.h"
 #include "hw/arm/xnu_dtb.h"
+#include "hw/misc/apple_soc_stats.h"
 
 #define TYPE_APPLE_AIC "apple.aic"
 OBJECT_DECLARE_SIMPLE_TYPE(AppleAICState, APPLE_AIC)
@@ -37,6 +38,8 @@ struct AppleAICState {
     uint32_t *eir_dest;
     AppleAICCPU *cpus;
     uint32_t *eir_state;
+    Stat64 *irq_count;
+    AppleSoCStats stats;
 #ifdef AIC_DEBUG_NEW_IRQ
     uint32_t *eir_mask_once;
 #endif
@@ -0,0 +1,34 @@
+#ifndef HW_MISC_APPLE_BOOT_TRACE_H
+#define HW_MISC_APPLE_BOOT_TRACE_H
+
+/*
+ * Boot timeline recorder.
+ *
+ * Records host side boot phases and guest milestones and writes them as a
+ * Chrome trace (also understood by Perfetto) when QEMU exits.  Every call
+ * is a no-op until apple_boot_trace_start() has been called, so the hooks
+ * can stay in hot-ish paths such as the RTKit management endpoint.
+ */
+
+/* Tracks become threads in the trace viewer */
+enum {
+    APPLE_BOOT_TRACE_MACHINE,
+    APPLE_BOOT_TRACE_GUEST,
+};
+
+void apple_boot_trace_start(const char *filename);
+bool apple_boot_trace_enabled(void);
+
+/* Look up or create the track called @name, e.g. one per coprocessor */
+int apple_boot_trace_track(const char *name);
+
+/* Host timestamp to pass as @start_ns to apple_boot_trace_complete() */
+int64_t apple_boot_trace_now(void);
+
+/* A phase on @track that started at @start_ns and ends now */
+void apple_boot_trace_complete(int track, const char *name, int64_t start_ns);
+
+/* A point in time event on @track */
+void apple_boot_trace_instant(int track, const char *name);
+
+#endif /* HW_MISC_APPLE_BOOT_TRACE_H */
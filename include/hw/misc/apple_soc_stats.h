@@ -0,0 +1,44 @@
+#ifndef HW_MISC_APPLE_SOC_STATS_H
+#define HW_MISC_APPLE_SOC_STATS_H
+
+#include "qemu/queue.h"
+#include "qemu/stats64.h"
+#include "qapi/qapi-types-apple.h"
+
+/*
+ * Cheap, always-on counters of the Apple SoC device models, reported by
+ * the query-apple-soc-stats QMP command and "info apple-stats".
+ *
+ * Every device embeds an AppleSoCStats and registers it once at realize
+ * time.  The generic MMIO counters are bumped from the device's MMIO
+ * handlers; device specific counters are reported by the optional fill
+ * callback, which runs with the BQL held and may take device locks.
+ */
+typedef struct AppleSoCStats AppleSoCStats;
+
+typedef void AppleSoCStatsFill(void *opaque, AppleSoCDeviceStats *info);
+
+struct AppleSoCStats {
+    char *name;
+    Stat64 mmio_reads;
+    Stat64 mmio_writes;
+    AppleSoCStatsFill *fill;
+    void *opaque;
+    QTAILQ_ENTRY(AppleSoCStats) next;
+};
+
+void apple_soc_stats_register(AppleSoCStats *stats, const char *name,
+                              AppleSoCStatsFill *fill, void *opaque);
+void apple_soc_stats_unregister(AppleSoCStats *stats);
+
+static inline void apple_soc_stats_mmio_read(AppleSoCStats *stats)
+{
+    stat64_add(&stats->mmio_reads, 1);
+}
+
+static inline void apple_soc_stats_mmio_write(AppleSoCStats *stats)
+{
+    stat64_add(&stats->mmio_writes, 1);
+}
+
+#endif /* HW_MISC_APPLE_SOC_STATS_H */
@@ -8,6 +8,7 @@
 #include "qemu/fifo32.h"
 #include "hw/spmi/spmi.h"
 #include "hw/arm/xnu_dtb.h"
+#include "hw/misc/apple_soc_stats.h"
 
 #define TYPE_APPLE_SPMI     "apple.spmi"
 OBJECT_DECLARE_TYPE(AppleSPMIState, AppleSPMIClass, APPLE_SPMI)
@@ -29,6 +30,11 @@ struct AppleSPMIState {
     qemu_irq irq;
     qemu_irq resp_irq;
     Fifo32 resp_fifo;
+    Fifo32 req_fifo;
+    uint32_t req_data_left;
+    bool req_final;
+    uint64_t xfers;
+    int64_t xfer_window;
     uint32_t control_reg[0x100 / sizeof(uint32_t)];
     uint32_t queue_reg[0x100 / sizeof(uint32_t)];
     uint32_t fault_reg[0x100 / sizeof(uint32_t)];
@@ -39,6 +45,7 @@ struct AppleSPMIState {
     uint32_t data_length;
     uint32_t data_filled;
     uint32_t command;
+    AppleSoCStats stats;
 };
 
 SysBusDevice *apple_spmi_create(DTBNode *node);
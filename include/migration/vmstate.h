@@ -188,11 +188,47 @@ struct VMStateDescription {
     int (*post_save)(void *opaque);
     bool (*needed)(void *opaque);
     bool (*dev_unplug_pending)(void *opaque);
+    /*
+     * Subsections only: returns the generation of the subsection's
+     * fields.  The subsection is left out of a save if it was already
+     * saved in the same stream and did not change since.
+     */
+    VMStateGen *(*gen)(void *opaque);
+    /*
+     * Saving the state needs neither the iothread lock nor any other
+     * device, so with multifd it is serialized on a channel thread.
+     */
+    bool threaded_save;
+    /*
+     * The state is sent once more just before the guest is stopped, so
+     * that subsections with an unchanged generation can be left out of
+     * the final copy.  The device must cope with being loaded twice.
+     */
+    bool save_early;
 
     const VMStateField *fields;
     const VMStateDescription **subsections;
 };
 
+/*
+ * Generation of a large piece of device state, for VMStateDescription.gen.
+ * The device bumps @gen whenever the state changes; the rest is only
+ * used by the migration code.
+ */
+struct VMStateGen {
+    uint32_t gen;
+    uint32_t saved_gen;
+    uint32_t saved_epoch;
+};
+
+static inline void vmstate_gen_bump(VMStateGen *g)
+{
+    qatomic_inc(&g->gen);
+}
+
+/* Forget which generations were saved, at the start of a new stream */
+void vmstate_gen_new_epoch(void);
+
 extern const VMStateInfo vmstate_info_bool;
 
 extern const VMStateInfo vmstate_info_int8;
@@ -223,6 +259,8 @@ extern const VMStateInfo vmstate_info_buffer;
 extern const VMStateInfo vmstate_info_unused_buffer;
 extern const VMStateInfo vmstate_info_tmp;
 extern const VMStateInfo vmstate_info_bitmap;
+extern const VMStateInfo vmstate_info_sparse_uint8;
+extern const VMStateInfo vmstate_info_sparse_uint32;
 extern const VMStateInfo vmstate_info_qtailq;
 extern const VMStateInfo vmstate_info_gtree;
 extern const VMStateInfo vmstate_info_qlist;
@@ -379,6 +417,20 @@ extern const VMStateInfo vmstate_info_qlist;
     .offset       = vmstate_offset_array(_state, _field, _type, _num),\
 }
 
+/*
+ * The whole array is a single field, only its non-zero runs are sent.
+ * Not compatible with VMSTATE_ARRAY on the wire: older streams need a
+ * VMSTATE_ARRAY_TEST of the dense array next to it.
+ */
+#define VMSTATE_SPARSE_ARRAY(_field, _state, _num, _version, _info, _type) {\
+    .name       = (stringify(_field)),                               \
+    .version_id = (_version),                                        \
+    .info       = &(_info),                                          \
+    .size       = sizeof(_type) * (_num),                            \
+    .flags      = VMS_SINGLE,                                        \
+    .offset     = vmstate_offset_array(_state, _field, _type, _num), \
+}
+
 #define VMSTATE_SUB_ARRAY(_field, _state, _start, _num, _version, _info, _type) { \
     .name       = (stringify(_field)),                               \
     .version_id = (_version),                                        \
@@ -1128,6 +1180,9 @@ extern const VMStateInfo vmstate_info_qlist;
 #define VMSTATE_UINT8_ARRAY(_f, _s, _n)                               \
     VMSTATE_UINT8_ARRAY_V(_f, _s, _n, 0)
 
+#define VMSTATE_UINT8_SPARSE_ARRAY_V(_f, _s, _n, _v)                  \
+    VMSTATE_SPARSE_ARRAY(_f, _s, _n, _v, vmstate_info_sparse_uint8, uint8_t)
+
 #define VMSTATE_UINT8_SUB_ARRAY(_f, _s, _start, _num)                \
     VMSTATE_SUB_ARRAY(_f, _s, _start, _num, 0, vmstate_info_uint8, uint8_t)
 
@@ -1143,6 +1198,9 @@ extern const VMStateInfo vmstate_info_qlist;
 #define VMSTATE_UINT32_ARRAY(_f, _s, _n)                              \
     VMSTATE_UINT32_ARRAY_V(_f, _s, _n, 0)
 
+#define VMSTATE_UINT32_SPARSE_ARRAY_V(_f, _s, _n, _v)                 \
+    VMSTATE_SPARSE_ARRAY(_f, _s, _n, _v, vmstate_info_sparse_uint32, uint32_t)
+
 #define VMSTATE_UINT32_SUB_ARRAY(_f, _s, _start, _num)                \
     VMSTATE_SUB_ARRAY(_f, _s, _start, _num, 0, vmstate_info_uint32, uint32_t)
 
@@ -84,6 +84,15 @@ int64_t cpu_get_clock(void);
 
 void qemu_timer_notify_cb(void *opaque, QEMUClockType type);
 
+/*
+ * Idle time warp: while all vCPUs are idle, advance QEMU_CLOCK_VIRTUAL
+ * to its next deadline instead of waiting for it.
+ */
+void idle_warp_init(Error **errp);
+/* called when a vCPU goes idle */
+void idle_warp_kick(void);
+void idle_warp_dump_info(GString *buf);
+
 /* get the VIRTUAL clock and VM elapsed ticks via the cpus accel interface */
 int64_t cpus_get_virtual_clock(void);
 int64_t cpus_get_elapsed_ticks(void);
@@ -806,6 +806,8 @@ void tcg_pool_reset(TCGContext *s);
 TranslationBlock *tcg_tb_alloc(TCGContext *s);
 
 void tcg_region_reset_all(void);
+void tcg_region_touch(const void *tc_ptr);
+bool tcg_region_evict(TCGContext *s, void (*evict_tb)(TranslationBlock *));
 
 size_t tcg_code_size(void);
 size_t tcg_code_capacity(void);
@@ -835,7 +837,7 @@ static inline void *tcg_malloc(int size)
     }
 }
 
-void tcg_init(size_t tb_size, int splitwx, unsigned max_cpus);
+void tcg_init(size_t tb_size, int splitwx, unsigned max_cpus, bool evict);
 void tcg_register_thread(void);
 void tcg_prologue_init(TCGContext *s);
 void tcg_func_start(TCGContext *s);
@@ -1338,6 +1338,12 @@ static bool migrate_caps_check(bool *cap_list,
         }
     }
 
+    if (cap_list[MIGRATION_CAPABILITY_MULTIFD_DEVICE_STATE] &&
+        !cap_list[MIGRATION_CAPABILITY_MULTIFD]) {
+        error_setg(errp, "Multifd device state requires multifd");
+        return false;
+    }
+
     return true;
 }
 
@@ -2592,6 +2598,15 @@ bool migrate_use_multifd(void)
     return s->enabled_capabilities[MIGRATION_CAPABILITY_MULTIFD];
 }
 
+bool migrate_multifd_device_state(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->enabled_capabilities[MIGRATION_CAPABILITY_MULTIFD_DEVICE_STATE];
+}
+
 bool migrate_pause_before_switchover(void)
 {
     MigrationState *s;
@@ -3757,6 +3772,12 @@ static MigIterateState migration_iteration_run(MigrationState *s)
         qemu_savevm_state_iterate(s->to_dst_file, in_postcopy);
     } else {
         trace_migration_thread_low_pending(pending_size);
+        if (!in_postcopy) {
+            /* Let the final copy skip the device state that stays put */
+            qemu_mutex_lock_iothread();
+            qemu_savevm_state_save_early(s->to_dst_file);
+            qemu_mutex_unlock_iothread();
+        }
         migration_completion(s);
         return MIG_ITERATE_BREAK;
     }
@@ -4401,6 +4422,8 @@ static Property migration_properties[] = {
     DEFINE_PROP_MIG_CAP("x-block", MIGRATION_CAPABILITY_BLOCK),
     DEFINE_PROP_MIG_CAP("x-return-path", MIGRATION_CAPABILITY_RETURN_PATH),
     DEFINE_PROP_MIG_CAP("x-multifd", MIGRATION_CAPABILITY_MULTIFD),
+    DEFINE_PROP_MIG_CAP("x-multifd-device-state",
+            MIGRATION_CAPABILITY_MULTIFD_DEVICE_STATE),
     DEFINE_PROP_MIG_CAP("x-background-snapshot",
             MIGRATION_CAPABILITY_BACKGROUND_SNAPSHOT),
 #ifdef CONFIG_LINUX
@@ -26,6 +26,7 @@
 #include "multifd.h"
 
 #include "qemu/yank.h"
+#include "io/channel-buffer.h"
 #include "io/channel-socket.h"
 #include "yank_functions.h"
 
@@ -372,6 +373,14 @@ struct {
     int exiting;
     /* multifd ops */
     MultiFDMethods *ops;
+    /* this mutex protects the device state counters */
+    QemuMutex device_state_lock;
+    /* signalled when the last queued device state is sent */
+    QemuCond device_state_cond;
+    /* device states queued and not sent yet */
+    unsigned int device_state_pending;
+    /* bytes of device state sent since the last flush */
+    uint64_t device_state_bytes;
 } *multifd_send_state;
 
 /*
@@ -392,17 +401,15 @@ struct {
  * false.
  */
 
-static int multifd_send_pages(QEMUFile *f)
+/*
+ * Wait for an idle channel and give it a job.  Returns the channel with
+ * its mutex held, or NULL if it has already quit.
+ */
+static MultiFDSendParams *multifd_send_get_channel(void)
 {
     int i;
     static int next_channel;
-    MultiFDSendParams *p = NULL; /* make happy gcc */
-    MultiFDPages_t *pages = multifd_send_state->pages;
-    uint64_t transferred;
-
-    if (qatomic_read(&multifd_send_state->exiting)) {
-        return -1;
-    }
+    MultiFDSendParams *p;
 
     qemu_sem_wait(&multifd_send_state->channels_ready);
     /*
@@ -418,15 +425,31 @@ static int multifd_send_pages(QEMUFile *f)
         if (p->quit) {
             error_report("%s: channel %d has already quit!", __func__, i);
             qemu_mutex_unlock(&p->mutex);
-            return -1;
+            return NULL;
         }
         if (!p->pending_job) {
             p->pending_job++;
             next_channel = (i + 1) % migrate_multifd_channels();
-            break;
+            return p;
         }
         qemu_mutex_unlock(&p->mutex);
     }
+}
+
+static int multifd_send_pages(QEMUFile *f)
+{
+    MultiFDSendParams *p;
+    MultiFDPages_t *pages = multifd_send_state->pages;
+    uint64_t transferred;
+
+    if (qatomic_read(&multifd_send_state->exiting)) {
+        return -1;
+    }
+
+    p = multifd_send_get_channel();
+    if (!p) {
+        return -1;
+    }
     assert(!p->pages->num);
     assert(!p->pages->block);
 
@@ -472,6 +495,71 @@ int multifd_queue_page(QEMUFile *f, RAMBlock *block, ram_addr_t offset)
     return 1;
 }
 
+bool multifd_device_state_supported(void)
+{
+    return migrate_multifd_device_state() && multifd_send_state;
+}
+
+int multifd_queue_device_state(uint32_t section_id, const char *idstr,
+                               MultiFDDeviceStateSaveFn save, void *opaque)
+{
+    MultiFDDeviceState_t *ds;
+    MultiFDSendParams *p;
+
+    if (qatomic_read(&multifd_send_state->exiting)) {
+        return -1;
+    }
+
+    p = multifd_send_get_channel();
+    if (!p) {
+        return -1;
+    }
+
+    ds = g_new(MultiFDDeviceState_t, 1);
+    ds->section_id = section_id;
+    ds->idstr = idstr;
+    ds->save = save;
+    ds->opaque = opaque;
+    p->device_state = ds;
+    p->packet_num = multifd_send_state->packet_num++;
+
+    qemu_mutex_lock(&multifd_send_state->device_state_lock);
+    multifd_send_state->device_state_pending++;
+    qemu_mutex_unlock(&multifd_send_state->device_state_lock);
+
+    qemu_mutex_unlock(&p->mutex);
+    qemu_sem_post(&p->sem);
+
+    return 0;
+}
+
+/*
+ * Wait until every queued device state is on the wire.  Returns 0, or -1
+ * if the channels failed in the meantime.
+ */
+int multifd_device_state_flush(void)
+{
+    uint64_t bytes;
+    int ret = 0;
+
+    qemu_mutex_lock(&multifd_send_state->device_state_lock);
+    while (multifd_send_state->device_state_pending &&
+           !qatomic_read(&multifd_send_state->exiting)) {
+        qemu_cond_wait(&multifd_send_state->device_state_cond,
+                       &multifd_send_state->device_state_lock);
+    }
+    if (multifd_send_state->device_state_pending) {
+        ret = -1;
+    }
+    bytes = multifd_send_state->device_state_bytes;
+    multifd_send_state->device_state_bytes = 0;
+    qemu_mutex_unlock(&multifd_send_state->device_state_lock);
+
+    ram_counters.multifd_bytes += bytes;
+    ram_counters.transferred += bytes;
+    return ret;
+}
+
 static void multifd_send_terminate_threads(Error *err)
 {
     int i;
@@ -511,6 +599,11 @@ static void multifd_send_terminate_threads(Error *err)
         }
         qemu_mutex_unlock(&p->mutex);
     }
+
+    /* Nobody will send the device states that are still queued */
+    qemu_mutex_lock(&multifd_send_state->device_state_lock);
+    qemu_cond_broadcast(&multifd_send_state->device_state_cond);
+    qemu_mutex_unlock(&multifd_send_state->device_state_lock);
 }
 
 void multifd_save_cleanup(void)
@@ -551,6 +644,8 @@ void multifd_save_cleanup(void)
         p->iov = NULL;
         g_free(p->normal);
         p->normal = NULL;
+        g_free(p->device_state);
+        p->device_state = NULL;
         multifd_send_state->ops->send_cleanup(p, &local_err);
         if (local_err) {
             migrate_set_error(migrate_get_current(), local_err);
@@ -558,6 +653,8 @@ void multifd_save_cleanup(void)
         }
     }
     qemu_sem_destroy(&multifd_send_state->channels_ready);
+    qemu_cond_destroy(&multifd_send_state->device_state_cond);
+    qemu_mutex_destroy(&multifd_send_state->device_state_lock);
     g_free(multifd_send_state->params);
     multifd_send_state->params = NULL;
     multifd_pages_clear(multifd_send_state->pages);
@@ -640,6 +737,72 @@ int multifd_send_sync_main(QEMUFile *f)
     return 0;
 }
 
+/*
+ * Save a device state into a buffer and send it as a single packet,
+ * outside of the channel mutex.
+ */
+static int multifd_send_device_state(MultiFDSendParams *p,
+                                     MultiFDDeviceState_t *ds,
+                                     uint64_t packet_num, Error **errp)
+{
+    QIOChannelBuffer *bioc = qio_channel_buffer_new(4096);
+    QEMUFile *f = qemu_file_new_output(QIO_CHANNEL(bioc));
+    MultiFDPacket_t *packet = p->packet;
+    struct iovec iov[2];
+    int ret;
+
+    ret = ds->save(f, ds->opaque);
+    qemu_fflush(f);
+    if (!ret) {
+        ret = qemu_file_get_error(f);
+    }
+    if (ret) {
+        error_setg(errp, "multifd %u: failed to save device state of %s: %d",
+                   p->id, ds->idstr, ret);
+        goto out;
+    }
+    if (bioc->usage > MULTIFD_DEVICE_STATE_MAX) {
+        error_setg(errp, "multifd %u: device state of %s is too large: %zu",
+                   p->id, ds->idstr, bioc->usage);
+        ret = -1;
+        goto out;
+    }
+
+    packet->flags = cpu_to_be32(MULTIFD_FLAG_DEVICE_STATE);
+    packet->pages_alloc = 0;
+    packet->normal_pages = 0;
+    packet->next_packet_size = cpu_to_be32(bioc->usage);
+    packet->packet_num = cpu_to_be64(packet_num);
+    packet->section_id = cpu_to_be32(ds->section_id);
+    pstrcpy(packet->ramblock, sizeof(packet->ramblock), ds->idstr);
+
+    trace_multifd_send_device_state(p->id, packet_num, ds->idstr,
+                                    ds->section_id, bioc->usage);
+
+    iov[0].iov_base = packet;
+    iov[0].iov_len = p->packet_len;
+    iov[1].iov_base = bioc->data;
+    iov[1].iov_len = bioc->usage;
+    ret = qio_channel_writev_all(p->c, iov, 2, errp);
+    packet->section_id = 0;
+    if (ret != 0) {
+        goto out;
+    }
+    p->num_packets++;
+
+    qemu_mutex_lock(&multifd_send_state->device_state_lock);
+    multifd_send_state->device_state_bytes += p->packet_len + bioc->usage;
+    if (!--multifd_send_state->device_state_pending) {
+        qemu_cond_broadcast(&multifd_send_state->device_state_cond);
+    }
+    qemu_mutex_unlock(&multifd_send_state->device_state_lock);
+
+out:
+    qemu_fclose(f);
+    object_unref(OBJECT(bioc));
+    return ret;
+}
+
 static void *multifd_send_thread(void *opaque)
 {
     MultiFDSendParams *p = opaque;
@@ -668,6 +831,27 @@ static void *multifd_send_thread(void *opaque)
         if (p->pending_job) {
             uint64_t packet_num = p->packet_num;
             uint32_t flags = p->flags;
+            MultiFDDeviceState_t *ds = p->device_state;
+
+            if (ds) {
+                /* A pending SYNC goes with the next packet */
+                p->device_state = NULL;
+                qemu_mutex_unlock(&p->mutex);
+
+                ret = multifd_send_device_state(p, ds, packet_num,
+                                                &local_err);
+                g_free(ds);
+                if (ret != 0) {
+                    break;
+                }
+
+                qemu_mutex_lock(&p->mutex);
+                p->pending_job--;
+                qemu_mutex_unlock(&p->mutex);
+                qemu_sem_post(&multifd_send_state->channels_ready);
+                continue;
+            }
+
             p->normal_num = 0;
 
             if (use_zero_copy_send) {
@@ -917,6 +1101,8 @@ int multifd_save_setup(Error **errp)
     multifd_send_state->params = g_new0(MultiFDSendParams, thread_count);
     multifd_send_state->pages = multifd_pages_init(page_count);
     qemu_sem_init(&multifd_send_state->channels_ready, 0);
+    qemu_mutex_init(&multifd_send_state->device_state_lock);
+    qemu_cond_init(&multifd_send_state->device_state_cond);
     qatomic_set(&multifd_send_state->exiting, 0);
     multifd_send_state->ops = multifd_ops[migrate_multifd_compression()];
 
@@ -973,6 +1159,14 @@ struct {
     uint64_t packet_num;
     /* multifd ops */
     MultiFDMethods *ops;
+    /* this mutex protects the device states and closed_channels */
+    QemuMutex device_state_lock;
+    /* signalled when a device state arrives or a channel closes */
+    QemuCond device_state_cond;
+    /* device states not loaded yet, by section id */
+    GHashTable *device_states;
+    /* channel threads that have exited */
+    int closed_channels;
 } *multifd_recv_state;
 
 static void multifd_recv_terminate_threads(Error *err)
@@ -1050,6 +1244,9 @@ int multifd_load_cleanup(Error **errp)
         multifd_recv_state->ops->recv_cleanup(p);
     }
     qemu_sem_destroy(&multifd_recv_state->sem_sync);
+    qemu_cond_destroy(&multifd_recv_state->device_state_cond);
+    qemu_mutex_destroy(&multifd_recv_state->device_state_lock);
+    g_hash_table_destroy(multifd_recv_state->device_states);
     g_free(multifd_recv_state->params);
     multifd_recv_state->params = NULL;
     g_free(multifd_recv_state);
@@ -1085,6 +1282,79 @@ void multifd_recv_sync_main(void)
     trace_multifd_recv_sync_main(multifd_recv_state->packet_num);
 }
 
+static int multifd_recv_device_state_packet(MultiFDRecvParams *p,
+                                            Error **errp)
+{
+    MultiFDPacket_t *packet = p->packet;
+    uint32_t section_id = be32_to_cpu(packet->section_id);
+    GByteArray *data;
+
+    if (!migrate_multifd_device_state()) {
+        error_setg(errp, "multifd %u: received device state, but the "
+                   "multifd-device-state capability is not set", p->id);
+        return -1;
+    }
+    if (p->next_packet_size > MULTIFD_DEVICE_STATE_MAX) {
+        error_setg(errp, "multifd %u: received device state of %u bytes, "
+                   "maximum is %u", p->id, p->next_packet_size,
+                   MULTIFD_DEVICE_STATE_MAX);
+        return -1;
+    }
+
+    /* make sure that the device name is 0 terminated */
+    packet->ramblock[255] = 0;
+    trace_multifd_recv_device_state(p->id, p->packet_num, packet->ramblock,
+                                    section_id, p->next_packet_size);
+
+    data = g_byte_array_sized_new(p->next_packet_size);
+    g_byte_array_set_size(data, p->next_packet_size);
+    if (qio_channel_read_all(p->c, (char *)data->data, data->len, errp)) {
+        g_byte_array_unref(data);
+        return -1;
+    }
+
+    qemu_mutex_lock(&multifd_recv_state->device_state_lock);
+    g_hash_table_insert(multifd_recv_state->device_states,
+                        GUINT_TO_POINTER(section_id), data);
+    qemu_cond_broadcast(&multifd_recv_state->device_state_cond);
+    qemu_mutex_unlock(&multifd_recv_state->device_state_lock);
+    return 0;
+}
+
+/*
+ * Wait for the device state of @section_id; on success the caller owns
+ * the returned buffer.  Returns -1 if it cannot arrive anymore.
+ */
+int multifd_recv_device_state(uint32_t section_id, uint8_t **buf,
+                              size_t *len)
+{
+    gpointer key = GUINT_TO_POINTER(section_id);
+    GByteArray *data;
+
+    if (!migrate_use_multifd() || !multifd_recv_state) {
+        return -1;
+    }
+
+    qemu_mutex_lock(&multifd_recv_state->device_state_lock);
+    while (!(data = g_hash_table_lookup(multifd_recv_state->device_states,
+                                        key)) &&
+           multifd_recv_state->closed_channels < migrate_multifd_channels()) {
+        qemu_cond_wait(&multifd_recv_state->device_state_cond,
+                       &multifd_recv_state->device_state_lock);
+    }
+    if (data) {
+        g_hash_table_steal(multifd_recv_state->device_states, key);
+    }
+    qemu_mutex_unlock(&multifd_recv_state->device_state_lock);
+
+    if (!data) {
+        return -1;
+    }
+    *len = data->len;
+    *buf = g_byte_array_free(data, false);
+    return 0;
+}
+
 static void *multifd_recv_thread(void *opaque)
 {
     MultiFDRecvParams *p = opaque;
@@ -1126,7 +1396,12 @@ static void *multifd_recv_thread(void *opaque)
         p->total_normal_pages += p->normal_num;
         qemu_mutex_unlock(&p->mutex);
 
-        if (p->normal_num) {
+        if (flags & MULTIFD_FLAG_DEVICE_STATE) {
+            ret = multifd_recv_device_state_packet(p, &local_err);
+            if (ret != 0) {
+                break;
+            }
+        } else if (p->normal_num) {
             ret = multifd_recv_state->ops->recv_pages(p, &local_err);
             if (ret != 0) {
                 break;
@@ -1147,6 +1422,11 @@ static void *multifd_recv_thread(void *opaque)
     p->running = false;
     qemu_mutex_unlock(&p->mutex);
 
+    qemu_mutex_lock(&multifd_recv_state->device_state_lock);
+    multifd_recv_state->closed_channels++;
+    qemu_cond_broadcast(&multifd_recv_state->device_state_cond);
+    qemu_mutex_unlock(&multifd_recv_state->device_state_lock);
+
     rcu_unregister_thread();
     trace_multifd_recv_thread_end(p->id, p->num_packets, p->total_normal_pages);
 
@@ -1171,6 +1451,11 @@ int multifd_load_setup(Error **errp)
     multifd_recv_state->params = g_new0(MultiFDRecvParams, thread_count);
     qatomic_set(&multifd_recv_state->count, 0);
     qemu_sem_init(&multifd_recv_state->sem_sync, 0);
+    qemu_mutex_init(&multifd_recv_state->device_state_lock);
+    qemu_cond_init(&multifd_recv_state->device_state_cond);
+    multifd_recv_state->device_states =
+        g_hash_table_new_full(NULL, NULL, NULL,
+                              (GDestroyNotify)g_byte_array_unref);
     multifd_recv_state->ops = multifd_ops[migrate_multifd_compression()];
 
     for (i = 0; i < thread_count; i++) {
@@ -23,6 +23,23 @@ void multifd_recv_sync_main(void);
 int multifd_send_sync_main(QEMUFile *f);
 int multifd_queue_page(QEMUFile *f, RAMBlock *block, ram_addr_t offset);
 
+/*
+ * Device state on multifd channels
+ *
+ * @save runs on a channel thread and writes the state of one device,
+ * which is then sent as a single packet tagged with @section_id.  The
+ * main stream only records where the section goes, and the destination
+ * waits for the packet when it gets there, so load order is unchanged.
+ */
+typedef int (*MultiFDDeviceStateSaveFn)(QEMUFile *f, void *opaque);
+
+bool multifd_device_state_supported(void);
+int multifd_queue_device_state(uint32_t section_id, const char *idstr,
+                               MultiFDDeviceStateSaveFn save, void *opaque);
+int multifd_device_state_flush(void);
+int multifd_recv_device_state(uint32_t section_id, uint8_t **buf,
+                              size_t *len);
+
 /* Multifd Compression flags */
 #define MULTIFD_FLAG_SYNC (1 << 0)
 
@@ -33,9 +50,15 @@ int multifd_queue_page(QEMUFile *f, RAMBlock *block, ram_addr_t offset);
 #define MULTIFD_FLAG_ZLIB (1 << 1)
 #define MULTIFD_FLAG_ZSTD (2 << 1)
 
+/* The packet carries the state of a device instead of pages */
+#define MULTIFD_FLAG_DEVICE_STATE (1 << 4)
+
 /* This value needs to be a multiple of qemu_target_page_size() */
 #define MULTIFD_PACKET_SIZE (512 * 1024)
 
+/* Largest device state packet we accept */
+#define MULTIFD_DEVICE_STATE_MAX (64 * 1024 * 1024)
+
 typedef struct {
     uint32_t magic;
     uint32_t version;
@@ -47,11 +70,22 @@ typedef struct {
     /* size of the next packet that contains pages */
     uint32_t next_packet_size;
     uint64_t packet_num;
-    uint64_t unused[4];    /* Reserved for future use */
+    /* section of a device state packet */
+    uint32_t section_id;
+    uint32_t unused32;
+    uint64_t unused[3];    /* Reserved for future use */
+    /* RAMBlock, or the device of a device state packet */
     char ramblock[256];
     uint64_t offset[];
 } __attribute__((packed)) MultiFDPacket_t;
 
+typedef struct {
+    uint32_t section_id;
+    const char *idstr;
+    MultiFDDeviceStateSaveFn save;
+    void *opaque;
+} MultiFDDeviceState_t;
+
 typedef struct {
     /* number of used pages */
     uint32_t num;
@@ -106,6 +140,8 @@ typedef struct {
      * pending_job != 0 -> multifd_channel can use it.
      */
     MultiFDPages_t *pages;
+    /* device state to save instead of pages, same ownership rules */
+    MultiFDDeviceState_t *device_state;
 
     /* thread local variables. No locking required */
 
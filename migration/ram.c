@@ -28,6 +28,7 @@
 
 #include "qemu/osdep.h"
 #include "qemu/cutils.h"
+#include "qemu/units.h"
 #include "qemu/bitops.h"
 #include "qemu/bitmap.h"
 #include "qemu/madvise.h"
@@ -749,41 +750,18 @@ static void xbzrle_cache_zero_page(RAMState *rs, ram_addr_t current_addr)
 #define ENCODING_FLAG_XBZRLE 0x1
 
 /**
- * save_xbzrle_page: compress and send current page
+ * save_xbzrle_cached_page: compress and send a page that is in the cache
  *
- * Returns: 1 means that we wrote the page
- *          0 means that page is identical to the one already sent
- *          -1 means that xbzrle would be longer than normal
- *
- * @rs: current RAM state
- * @current_data: pointer to the address of the page contents
- * @current_addr: addr of the page
- * @block: block that contains the page we want to send
- * @offset: offset inside the block for the page
+ * Like save_xbzrle_page, for a page that hit the cache and has already
+ * been copied to XBZRLE.current_buf.
  */
-static int save_xbzrle_page(RAMState *rs, uint8_t **current_data,
-                            ram_addr_t current_addr, RAMBlock *block,
-                            ram_addr_t offset)
+static int save_xbzrle_cached_page(RAMState *rs, uint8_t **current_data,
+                                   ram_addr_t current_addr, RAMBlock *block,
+                                   ram_addr_t offset)
 {
     int encoded_len = 0, bytes_xbzrle;
     uint8_t *prev_cached_page;
 
-    if (!cache_is_cached(XBZRLE.cache, current_addr,
-                         ram_counters.dirty_sync_count)) {
-        xbzrle_counters.cache_miss++;
-        if (!rs->last_stage) {
-            if (cache_insert(XBZRLE.cache, current_addr, *current_data,
-                             ram_counters.dirty_sync_count) == -1) {
-                return -1;
-            } else {
-                /* update *current_data when the page has been
-                   inserted into cache */
-                *current_data = get_cached_data(XBZRLE.cache, current_addr);
-            }
-        }
-        return -1;
-    }
-
     /*
      * Reaching here means the page has hit the xbzrle cache, no matter what
      * encoding result it is (normal encoding, overflow or skipping the page),
@@ -798,9 +776,6 @@ static int save_xbzrle_page(RAMState *rs, uint8_t **current_data,
     xbzrle_counters.pages++;
     prev_cached_page = get_cached_data(XBZRLE.cache, current_addr);
 
-    /* save current buffer into memory */
-    memcpy(XBZRLE.current_buf, *current_data, TARGET_PAGE_SIZE);
-
     /* XBZRLE encoding (if there is no overflow) */
     encoded_len = xbzrle_encode_buffer(prev_cached_page, XBZRLE.current_buf,
                                        TARGET_PAGE_SIZE, XBZRLE.encoded_buf,
@@ -848,6 +823,46 @@ static int save_xbzrle_page(RAMState *rs, uint8_t **current_data,
     return 1;
 }
 
+/**
+ * save_xbzrle_page: compress and send current page
+ *
+ * Returns: 1 means that we wrote the page
+ *          0 means that page is identical to the one already sent
+ *          -1 means that xbzrle would be longer than normal
+ *
+ * @rs: current RAM state
+ * @current_data: pointer to the address of the page contents
+ * @current_addr: addr of the page
+ * @block: block that contains the page we want to send
+ * @offset: offset inside the block for the page
+ */
+static int save_xbzrle_page(RAMState *rs, uint8_t **current_data,
+                            ram_addr_t current_addr, RAMBlock *block,
+                            ram_addr_t offset)
+{
+    if (!cache_is_cached(XBZRLE.cache, current_addr,
+                         ram_counters.dirty_sync_count)) {
+        xbzrle_counters.cache_miss++;
+        if (!rs->last_stage) {
+            if (cache_insert(XBZRLE.cache, current_addr, *current_data,
+                             ram_counters.dirty_sync_count) == -1) {
+                return -1;
+            } else {
+                /* update *current_data when the page has been
+                   inserted into cache */
+                *current_data = get_cached_data(XBZRLE.cache, current_addr);
+            }
+        }
+        return -1;
+    }
+
+    /* save current buffer into memory */
+    memcpy(XBZRLE.current_buf, *current_data, TARGET_PAGE_SIZE);
+
+    return save_xbzrle_cached_page(rs, current_data, current_addr, block,
+                                   offset);
+}
+
 /**
  * migration_bitmap_find_dirty: find the next dirty page from start
  *
@@ -1060,6 +1075,206 @@ static void ramblock_sync_dirty_bitmap(RAMState *rs, RAMBlock *rb)
     rs->num_dirty_pages_period += new_dirty_pages;
 }
 
+/*
+ * Dirty bitmap sync threads
+ *
+ * On large guests, moving the dirty log into the RAMBlocks' bitmaps is
+ * the bulk of migration_bitmap_sync(), and the vCPUs of a guest that is
+ * being stopped wait for it.  The blocks are cut in chunks that start on
+ * a word of rb->bmap, so each word is only written by the thread that
+ * syncs its chunk and the merge needs no locking; the migration thread
+ * and a few helpers then take chunks until none is left.
+ *
+ * RAM_SYNC_CHUNK_SIZE is a multiple of BITS_PER_LONG target pages, which
+ * also keeps whole chunks on the fast path of
+ * cpu_physical_memory_sync_dirty_bitmap().
+ */
+#define RAM_SYNC_CHUNK_SIZE     (1 * GiB)
+/* Below this much guest RAM a single thread syncs fast enough */
+#define RAM_SYNC_MIN_SIZE       (4 * GiB)
+#define RAM_SYNC_MAX_THREADS    8
+
+typedef struct RAMSyncChunk {
+    RAMBlock *block;
+    ram_addr_t start;
+    ram_addr_t length;
+    uint64_t new_dirty_pages;
+} RAMSyncChunk;
+
+static struct {
+    QemuThread *threads;
+    unsigned int nthreads;
+    QemuMutex lock;
+    /* Signalled when chunks are queued or the threads must exit */
+    QemuCond work_cond;
+    /* Signalled when the last queued chunk is synced */
+    QemuCond done_cond;
+    /* Protected by @lock */
+    RAMSyncChunk *chunks;
+    unsigned int chunks_size;
+    unsigned int nchunks;
+    unsigned int next;
+    unsigned int pending;
+    bool quit;
+} ram_sync;
+
+/* Called with ram_sync.lock held, which is dropped while syncing */
+static void ram_sync_chunks_locked(void)
+{
+    while (ram_sync.next < ram_sync.nchunks) {
+        RAMSyncChunk *c = &ram_sync.chunks[ram_sync.next++];
+
+        qemu_mutex_unlock(&ram_sync.lock);
+        WITH_RCU_READ_LOCK_GUARD() {
+            c->new_dirty_pages =
+                cpu_physical_memory_sync_dirty_bitmap(c->block, c->start,
+                                                      c->length);
+        }
+        qemu_mutex_lock(&ram_sync.lock);
+
+        if (!--ram_sync.pending) {
+            qemu_cond_signal(&ram_sync.done_cond);
+        }
+    }
+}
+
+static void *ram_sync_thread(void *opaque)
+{
+    rcu_register_thread();
+
+    qemu_mutex_lock(&ram_sync.lock);
+    while (!ram_sync.quit) {
+        if (ram_sync.next < ram_sync.nchunks) {
+            ram_sync_chunks_locked();
+        } else {
+            qemu_cond_wait(&ram_sync.work_cond, &ram_sync.lock);
+        }
+    }
+    qemu_mutex_unlock(&ram_sync.lock);
+
+    rcu_unregister_thread();
+    return NULL;
+}
+
+static void ram_sync_threads_setup(void)
+{
+    unsigned int i, nthreads;
+
+    if (ram_bytes_total() < RAM_SYNC_MIN_SIZE) {
+        return;
+    }
+
+    /* The migration thread syncs chunks too */
+    nthreads = MIN(g_get_num_processors() / 2, RAM_SYNC_MAX_THREADS);
+    if (nthreads < 2) {
+        return;
+    }
+    nthreads--;
+
+    qemu_mutex_init(&ram_sync.lock);
+    qemu_cond_init(&ram_sync.work_cond);
+    qemu_cond_init(&ram_sync.done_cond);
+    ram_sync.quit = false;
+    ram_sync.nthreads = nthreads;
+    ram_sync.threads = g_new0(QemuThread, nthreads);
+    for (i = 0; i < nthreads; i++) {
+        qemu_thread_create(ram_sync.threads + i, "dirtysync",
+                           ram_sync_thread, NULL, QEMU_THREAD_JOINABLE);
+    }
+}
+
+static void ram_sync_threads_cleanup(void)
+{
+    unsigned int i;
+
+    if (!ram_sync.threads) {
+        return;
+    }
+
+    qemu_mutex_lock(&ram_sync.lock);
+    ram_sync.quit = true;
+    qemu_cond_broadcast(&ram_sync.work_cond);
+    qemu_mutex_unlock(&ram_sync.lock);
+
+    for (i = 0; i < ram_sync.nthreads; i++) {
+        qemu_thread_join(ram_sync.threads + i);
+    }
+    g_free(ram_sync.threads);
+    ram_sync.threads = NULL;
+    ram_sync.nthreads = 0;
+    g_free(ram_sync.chunks);
+    ram_sync.chunks = NULL;
+    ram_sync.chunks_size = 0;
+    ram_sync.nchunks = ram_sync.next = ram_sync.pending = 0;
+
+    qemu_cond_destroy(&ram_sync.done_cond);
+    qemu_cond_destroy(&ram_sync.work_cond);
+    qemu_mutex_destroy(&ram_sync.lock);
+}
+
+/* Called with RCU critical section */
+static void ramblock_sync_dirty_bitmaps(RAMState *rs)
+{
+    int64_t start_time = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+    uint64_t new_dirty_pages = 0;
+    unsigned int i, nchunks = 0;
+    RAMBlock *block;
+    ram_addr_t start;
+
+    if (!ram_sync.threads) {
+        uint64_t old_dirty_pages = rs->migration_dirty_pages;
+
+        RAMBLOCK_FOREACH_NOT_IGNORED(block) {
+            ramblock_sync_dirty_bitmap(rs, block);
+        }
+        trace_migration_bitmap_sync_blocks(0, 0,
+            rs->migration_dirty_pages - old_dirty_pages,
+            (qemu_clock_get_ns(QEMU_CLOCK_REALTIME) - start_time) / SCALE_US);
+        return;
+    }
+
+    RAMBLOCK_FOREACH_NOT_IGNORED(block) {
+        nchunks += DIV_ROUND_UP(block->used_length, RAM_SYNC_CHUNK_SIZE);
+    }
+
+    qemu_mutex_lock(&ram_sync.lock);
+    if (nchunks > ram_sync.chunks_size) {
+        ram_sync.chunks = g_renew(RAMSyncChunk, ram_sync.chunks, nchunks);
+        ram_sync.chunks_size = nchunks;
+    }
+    i = 0;
+    RAMBLOCK_FOREACH_NOT_IGNORED(block) {
+        for (start = 0; start < block->used_length;
+             start += RAM_SYNC_CHUNK_SIZE) {
+            ram_sync.chunks[i++] = (RAMSyncChunk) {
+                .block = block,
+                .start = start,
+                .length = MIN(RAM_SYNC_CHUNK_SIZE,
+                              block->used_length - start),
+            };
+        }
+    }
+    ram_sync.nchunks = ram_sync.pending = nchunks;
+    ram_sync.next = 0;
+    qemu_cond_broadcast(&ram_sync.work_cond);
+
+    ram_sync_chunks_locked();
+    while (ram_sync.pending) {
+        qemu_cond_wait(&ram_sync.done_cond, &ram_sync.lock);
+    }
+    qemu_mutex_unlock(&ram_sync.lock);
+
+    for (i = 0; i < nchunks; i++) {
+        new_dirty_pages += ram_sync.chunks[i].new_dirty_pages;
+    }
+    rs->migration_dirty_pages += new_dirty_pages;
+    rs->num_dirty_pages_period += new_dirty_pages;
+
+    trace_migration_bitmap_sync_blocks(nchunks, ram_sync.nthreads + 1,
+        new_dirty_pages,
+        (qemu_clock_get_ns(QEMU_CLOCK_REALTIME) - start_time) / SCALE_US);
+}
+
 /**
  * ram_pagesize_summary: calculate all the pagesizes of a VM
  *
@@ -1170,7 +1385,7 @@ static void migration_trigger_throttle(RAMState *rs)
 
 static void migration_bitmap_sync(RAMState *rs)
 {
-    RAMBlock *block;
+    int64_t start_ns = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
     int64_t end_time;
 
     ram_counters.dirty_sync_count++;
@@ -1184,15 +1399,14 @@ static void migration_bitmap_sync(RAMState *rs)
 
     qemu_mutex_lock(&rs->bitmap_mutex);
     WITH_RCU_READ_LOCK_GUARD() {
-        RAMBLOCK_FOREACH_NOT_IGNORED(block) {
-            ramblock_sync_dirty_bitmap(rs, block);
-        }
+        ramblock_sync_dirty_bitmaps(rs);
         ram_counters.remaining = ram_bytes_remaining();
     }
     qemu_mutex_unlock(&rs->bitmap_mutex);
 
     memory_global_after_dirty_log_sync();
-    trace_migration_bitmap_sync_end(rs->num_dirty_pages_period);
+    trace_migration_bitmap_sync_end(rs->num_dirty_pages_period,
+        (qemu_clock_get_ns(QEMU_CLOCK_REALTIME) - start_ns) / SCALE_US);
 
     end_time = qemu_clock_get_ms(QEMU_CLOCK_REALTIME);
 
@@ -1243,6 +1457,17 @@ static void ram_release_page(const char *rbname, uint64_t offset)
     ram_discard_range(rbname, offset, TARGET_PAGE_SIZE);
 }
 
+static int save_zero_page_header(RAMState *rs, QEMUFile *file,
+                                 RAMBlock *block, ram_addr_t offset)
+{
+    int len = save_page_header(rs, file, block, offset | RAM_SAVE_FLAG_ZERO);
+
+    qemu_put_byte(file, 0);
+    len += 1;
+    ram_release_page(block->idstr, offset);
+    return len;
+}
+
 /**
  * save_zero_page_to_file: send the zero page to the file
  *
@@ -1261,10 +1486,7 @@ static int save_zero_page_to_file(RAMState *rs, QEMUFile *file,
     int len = 0;
 
     if (buffer_is_zero(p, TARGET_PAGE_SIZE)) {
-        len += save_page_header(rs, file, block, offset | RAM_SAVE_FLAG_ZERO);
-        qemu_put_byte(file, 0);
-        len += 1;
-        ram_release_page(block->idstr, offset);
+        len += save_zero_page_header(rs, file, block, offset);
     }
     return len;
 }
@@ -2269,6 +2491,66 @@ static bool save_compress_page(RAMState *rs, RAMBlock *block, ram_addr_t offset)
     return false;
 }
 
+/*
+ * XBZRLE applies to the pages that reach ram_save_page: not compressed,
+ * not sent through multifd and not in postcopy.
+ */
+static bool save_page_use_xbzrle(RAMState *rs)
+{
+    return rs->xbzrle_enabled && !migration_in_postcopy() &&
+           !save_page_use_compression(rs) && !migrate_use_multifd();
+}
+
+/**
+ * ram_save_xbzrle_target_page: save a page that is in the XBZRLE cache
+ *
+ * Returns true if the page was in the cache and has been sent, with the
+ * number of pages written in @pages.
+ *
+ * The page is copied out of guest memory and checked for zeroes in a
+ * single pass, then sent as a zero page or XBZRLE encoded from the copy,
+ * instead of being read once by save_zero_page() and again by
+ * save_xbzrle_page().
+ *
+ * @rs: current RAM state
+ * @pss: data about the page we want to send
+ * @pages: number of pages written
+ */
+static bool ram_save_xbzrle_target_page(RAMState *rs, PageSearchStatus *pss,
+                                        int *pages)
+{
+    RAMBlock *block = pss->block;
+    ram_addr_t offset = ((ram_addr_t)pss->page) << TARGET_PAGE_BITS;
+    ram_addr_t current_addr = block->offset + offset;
+    uint8_t *p = block->host + offset;
+    int len;
+
+    XBZRLE_cache_lock();
+    if (!cache_is_cached(XBZRLE.cache, current_addr,
+                         ram_counters.dirty_sync_count)) {
+        XBZRLE_cache_unlock();
+        return false;
+    }
+
+    trace_ram_save_page(block->idstr, (uint64_t)offset, p);
+    if (xbzrle_copy_page(XBZRLE.current_buf, p, TARGET_PAGE_SIZE)) {
+        len = save_zero_page_header(rs, rs->f, block, offset);
+        ram_counters.duplicate++;
+        ram_transferred_add(len);
+        xbzrle_cache_zero_page(rs, current_addr);
+        *pages = 1;
+    } else {
+        *pages = save_xbzrle_cached_page(rs, &p, current_addr, block, offset);
+        if (*pages == -1) {
+            /* XBZRLE overflow, the cached data can't be sent async */
+            *pages = save_normal_page(rs, block, offset, p, rs->last_stage);
+        }
+    }
+    XBZRLE_cache_unlock();
+
+    return true;
+}
+
 /**
  * ram_save_target_page: save one target page
  *
@@ -2291,6 +2573,11 @@ static int ram_save_target_page(RAMState *rs, PageSearchStatus *pss)
         return 1;
     }
 
+    if (save_page_use_xbzrle(rs) &&
+        ram_save_xbzrle_target_page(rs, pss, &res)) {
+        return res;
+    }
+
     res = save_zero_page(rs, block, offset);
     if (res > 0) {
         /* Must let xbzrle know, otherwise a previous (now 0'd) cached
@@ -2687,6 +2974,7 @@ static void ram_save_cleanup(void *opaque)
 
     xbzrle_cleanup();
     compress_threads_save_cleanup();
+    ram_sync_threads_cleanup();
     ram_state_cleanup(rsp);
 }
 
@@ -3098,6 +3386,7 @@ static int ram_init_all(RAMState **rsp)
         return -1;
     }
 
+    ram_sync_threads_setup();
     ram_init_bitmaps(*rsp);
 
     return 0;
@@ -38,6 +38,7 @@
 #include "migration/channel-block.h"
 #include "ram.h"
 #include "qemu-file.h"
+#include "multifd.h"
 #include "savevm.h"
 #include "postcopy-ram.h"
 #include "qapi/error.h"
@@ -876,6 +877,56 @@ static int vmstate_load(QEMUFile *f, SaveStateEntry *se)
     return vmstate_load_state(f, se->vmsd, se->opaque, se->load_version_id);
 }
 
+/* Load a device state that was sent on a multifd channel */
+static int vmstate_load_multifd(SaveStateEntry *se)
+{
+    QIOChannelBuffer *bioc;
+    QEMUFile *f;
+    uint8_t *buf;
+    size_t len;
+    int ret;
+
+    if (!migrate_multifd_device_state()) {
+        error_report("Device state of '%s' is sent on the multifd channels, "
+                     "but the multifd-device-state capability is not set",
+                     se->idstr);
+        return -EINVAL;
+    }
+    if (!se->vmsd) {
+        error_report("Old style device '%s' cannot be loaded from multifd",
+                     se->idstr);
+        return -EINVAL;
+    }
+    if (multifd_recv_device_state(se->load_section_id, &buf, &len) < 0) {
+        error_report("Device state of '%s' did not arrive on the multifd "
+                     "channels", se->idstr);
+        return -EIO;
+    }
+    trace_vmstate_load_multifd(se->idstr, se->load_section_id, len);
+
+    bioc = qio_channel_buffer_new(0);
+    bioc->data = buf;
+    bioc->capacity = bioc->usage = len;
+    f = qemu_file_new_input(QIO_CHANNEL(bioc));
+    object_unref(OBJECT(bioc));
+
+    ret = vmstate_load(f, se);
+    if (!ret) {
+        ret = qemu_file_get_error(f);
+    }
+    qemu_fclose(f);
+    return ret;
+}
+
+/* Runs on a multifd channel thread, see VMStateDescription.threaded_save */
+static int vmstate_save_threaded(QEMUFile *f, void *opaque)
+{
+    SaveStateEntry *se = opaque;
+
+    trace_vmstate_save(se->idstr, se->vmsd->name);
+    return vmstate_save_state(f, se->vmsd, se->opaque, NULL);
+}
+
 static void vmstate_save_old_style(QEMUFile *f, SaveStateEntry *se,
                                    JSONWriter *vmdesc)
 {
@@ -909,7 +960,8 @@ static int vmstate_save(QEMUFile *f, SaveStateEntry *se,
 }
 
 /*
- * Write the header for device section (QEMU_VM_SECTION START/END/PART/FULL)
+ * Write the header for device section
+ * (QEMU_VM_SECTION START/END/PART/FULL/MULTIFD)
  */
 static void save_section_header(QEMUFile *f, SaveStateEntry *se,
                                 uint8_t section_type)
@@ -918,7 +970,8 @@ static void save_section_header(QEMUFile *f, SaveStateEntry *se,
     qemu_put_be32(f, se->section_id);
 
     if (section_type == QEMU_VM_SECTION_FULL ||
-        section_type == QEMU_VM_SECTION_START) {
+        section_type == QEMU_VM_SECTION_START ||
+        section_type == QEMU_VM_SECTION_MULTIFD) {
         /* ID string */
         size_t len = strlen(se->idstr);
         qemu_put_byte(f, len);
@@ -1168,6 +1221,7 @@ void qemu_savevm_state_setup(QEMUFile *f)
     int ret;
 
     trace_savevm_state_setup();
+    vmstate_gen_new_epoch();
     QTAILQ_FOREACH(se, &savevm_state.handlers, entry) {
         if (!se->ops || !se->ops->save_setup) {
             continue;
@@ -1360,11 +1414,42 @@ int qemu_savevm_state_complete_precopy_iterable(QEMUFile *f, bool in_postcopy)
     return 0;
 }
 
+/*
+ * Send the state of the devices that want it (VMStateDescription.save_early)
+ * while the guest still runs, so that the final copy can leave out their
+ * subsections that do not change until then.  Called with the iothread
+ * lock held.
+ */
+void qemu_savevm_state_save_early(QEMUFile *f)
+{
+    SaveStateEntry *se;
+    int ret;
+
+    trace_savevm_state_save_early();
+    QTAILQ_FOREACH(se, &savevm_state.handlers, entry) {
+        if (!se->vmsd || !se->vmsd->save_early ||
+            !vmstate_save_needed(se->vmsd, se->opaque)) {
+            continue;
+        }
+
+        trace_savevm_section_start(se->idstr, se->section_id);
+        save_section_header(f, se, QEMU_VM_SECTION_FULL);
+        ret = vmstate_save(f, se, NULL);
+        if (ret) {
+            qemu_file_set_error(f, ret);
+            return;
+        }
+        trace_savevm_section_end(se->idstr, se->section_id, 0);
+        save_section_footer(f, se);
+    }
+}
+
 int qemu_savevm_state_complete_precopy_non_iterable(QEMUFile *f,
                                                     bool in_postcopy,
                                                     bool inactivate_disks)
 {
     g_autoptr(JSONWriter) vmdesc = NULL;
+    bool use_multifd = !in_postcopy && multifd_device_state_supported();
     int vmdesc_len;
     SaveStateEntry *se;
     int ret;
@@ -1385,6 +1470,33 @@ int qemu_savevm_state_complete_precopy_non_iterable(QEMUFile *f,
 
         trace_savevm_section_start(se->idstr, se->section_id);
 
+        if (use_multifd && se->vmsd && se->vmsd->threaded_save) {
+            /*
+             * Only the section header goes here, the state itself is
+             * saved and sent by a channel while we go on.  The description
+             * has no fields, as none of them are in this stream.
+             */
+            json_writer_start_object(vmdesc, NULL);
+            json_writer_str(vmdesc, "name", se->idstr);
+            json_writer_int64(vmdesc, "instance_id", se->instance_id);
+            json_writer_str(vmdesc, "vmsd_name", se->vmsd->name);
+            json_writer_int64(vmdesc, "version", se->vmsd->version_id);
+            json_writer_bool(vmdesc, "multifd", true);
+            json_writer_start_array(vmdesc, "fields");
+            json_writer_end_array(vmdesc);
+            json_writer_end_object(vmdesc);
+
+            save_section_header(f, se, QEMU_VM_SECTION_MULTIFD);
+            ret = multifd_queue_device_state(se->section_id, se->idstr,
+                                             vmstate_save_threaded, se);
+            if (ret) {
+                qemu_file_set_error(f, ret);
+                return ret;
+            }
+            save_section_footer(f, se);
+            continue;
+        }
+
         json_writer_start_object(vmdesc, NULL);
         json_writer_str(vmdesc, "name", se->idstr);
         json_writer_int64(vmdesc, "instance_id", se->instance_id);
@@ -1401,6 +1513,15 @@ int qemu_savevm_state_complete_precopy_non_iterable(QEMUFile *f,
         json_writer_end_object(vmdesc);
     }
 
+    if (use_multifd && multifd_device_state_flush()) {
+        error_report("%s: failed to send device state on multifd channels",
+                     __func__);
+        qemu_file_set_error(f, -EIO);
+        return -EIO;
+    }
+    /* Whatever is saved next cannot rely on this copy */
+    vmstate_gen_new_epoch();
+
     if (inactivate_disks) {
         /* Inactivate before sending QEMU_VM_EOF so that the
          * bdrv_activate_all() on the other end won't fail. */
@@ -1582,6 +1703,7 @@ int qemu_save_device_state(QEMUFile *f)
 {
     SaveStateEntry *se;
 
+    vmstate_gen_new_epoch();
     if (!migration_in_colo_state()) {
         qemu_put_be32(f, QEMU_VM_FILE_MAGIC);
         qemu_put_be32(f, QEMU_VM_FILE_VERSION);
@@ -2363,7 +2485,8 @@ static bool check_section_footer(QEMUFile *f, SaveStateEntry *se)
 }
 
 static int
-qemu_loadvm_section_start_full(QEMUFile *f, MigrationIncomingState *mis)
+qemu_loadvm_section_start_full(QEMUFile *f, MigrationIncomingState *mis,
+                               uint8_t section_type)
 {
     uint32_t instance_id, version_id, section_id;
     SaveStateEntry *se;
@@ -2414,7 +2537,11 @@ qemu_loadvm_section_start_full(QEMUFile *f, MigrationIncomingState *mis)
         return -EINVAL;
     }
 
-    ret = vmstate_load(f, se);
+    if (section_type == QEMU_VM_SECTION_MULTIFD) {
+        ret = vmstate_load_multifd(se);
+    } else {
+        ret = vmstate_load(f, se);
+    }
     if (ret < 0) {
         error_report("error while loading state for instance 0x%"PRIx32" of"
                      " device '%s'", instance_id, idstr);
@@ -2630,7 +2757,8 @@ retry:
         switch (section_type) {
         case QEMU_VM_SECTION_START:
         case QEMU_VM_SECTION_FULL:
-            ret = qemu_loadvm_section_start_full(f, mis);
+        case QEMU_VM_SECTION_MULTIFD:
+            ret = qemu_loadvm_section_start_full(f, mis, section_type);
             if (ret < 0) {
                 goto out;
             }
@@ -15,6 +15,7 @@
 #include "qemu-file.h"
 #include "migration.h"
 #include "migration/vmstate.h"
+#include "qapi/qmp/json-writer.h"
 #include "qemu/error-report.h"
 #include "qemu/queue.h"
 #include "trace.h"
@@ -595,6 +596,155 @@ const VMStateInfo vmstate_info_bitmap = {
     .put = put_bitmap,
 };
 
+/*
+ * Sparse arrays of integers, for large register files that are mostly
+ * zero.  size is the size of the whole array in bytes.  On the wire
+ * there is the number of runs, then for each run its first index, its
+ * length and its elements; everything outside the runs is zero.  Zero
+ * gaps no longer than a run header are folded into the surrounding run.
+ */
+#define SPARSE_RUN_HEADER_SIZE 8
+
+static bool sparse_elem_is_zero(const uint8_t *p, size_t esz)
+{
+    size_t i;
+
+    for (i = 0; i < esz; i++) {
+        if (p[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Returns the start of the first run at or after @i, or @n if none */
+static size_t sparse_next_run(const uint8_t *buf, size_t n, size_t esz,
+                              size_t i, size_t *len)
+{
+    size_t start, end, j;
+
+    while (i < n && sparse_elem_is_zero(buf + i * esz, esz)) {
+        i++;
+    }
+    if (i == n) {
+        return n;
+    }
+
+    start = i;
+    end = i + 1;
+    for (j = i + 1; j < n; j++) {
+        if (!sparse_elem_is_zero(buf + j * esz, esz)) {
+            end = j + 1;
+        } else if ((j + 1 - end) * esz > SPARSE_RUN_HEADER_SIZE) {
+            break;
+        }
+    }
+    *len = end - start;
+    return start;
+}
+
+static int get_sparse(QEMUFile *f, uint8_t *buf, size_t size, size_t esz,
+                      const VMStateField *field)
+{
+    size_t n = size / esz;
+    uint32_t nr_runs, start, len, r;
+    size_t next = 0, i;
+
+    memset(buf, 0, size);
+    nr_runs = qemu_get_be32(f);
+    for (r = 0; r < nr_runs; r++) {
+        start = qemu_get_be32(f);
+        len = qemu_get_be32(f);
+        if (start < next || start >= n || !len || len > n - start) {
+            error_report("%s: invalid run %" PRIu32 "+%" PRIu32
+                         " in sparse array of %zu elements",
+                         field->name, start, len, n);
+            return -EINVAL;
+        }
+        if (esz == 1) {
+            qemu_get_buffer(f, buf + start, len);
+        } else {
+            for (i = start; i < start + len; i++) {
+                qemu_get_be32s(f, (uint32_t *)(buf + i * esz));
+            }
+        }
+        next = start + len;
+    }
+    return qemu_file_get_error(f);
+}
+
+static int put_sparse(QEMUFile *f, const uint8_t *buf, size_t size,
+                      size_t esz, JSONWriter *vmdesc)
+{
+    size_t n = size / esz;
+    size_t i, j, start, len;
+    uint32_t nr_runs = 0;
+
+    for (i = 0; (start = sparse_next_run(buf, n, esz, i, &len)) < n;
+         i = start + len) {
+        nr_runs++;
+    }
+
+    if (vmdesc) {
+        /* The field's size is what went on the wire, not the array's */
+        json_writer_str(vmdesc, "encoding", "sparse runs");
+        json_writer_int64(vmdesc, "element_size", esz);
+        json_writer_int64(vmdesc, "elements", n);
+        json_writer_int64(vmdesc, "runs", nr_runs);
+    }
+
+    qemu_put_be32(f, nr_runs);
+    for (i = 0; (start = sparse_next_run(buf, n, esz, i, &len)) < n;
+         i = start + len) {
+        qemu_put_be32(f, start);
+        qemu_put_be32(f, len);
+        if (esz == 1) {
+            qemu_put_buffer(f, buf + start, len);
+        } else {
+            for (j = start; j < start + len; j++) {
+                qemu_put_be32s(f, (const uint32_t *)(buf + j * esz));
+            }
+        }
+    }
+    return 0;
+}
+
+static int get_sparse_uint8(QEMUFile *f, void *pv, size_t size,
+                            const VMStateField *field)
+{
+    return get_sparse(f, pv, size, sizeof(uint8_t), field);
+}
+
+static int put_sparse_uint8(QEMUFile *f, void *pv, size_t size,
+                            const VMStateField *field, JSONWriter *vmdesc)
+{
+    return put_sparse(f, pv, size, sizeof(uint8_t), vmdesc);
+}
+
+const VMStateInfo vmstate_info_sparse_uint8 = {
+    .name = "sparse uint8",
+    .get = get_sparse_uint8,
+    .put = put_sparse_uint8,
+};
+
+static int get_sparse_uint32(QEMUFile *f, void *pv, size_t size,
+                             const VMStateField *field)
+{
+    return get_sparse(f, pv, size, sizeof(uint32_t), field);
+}
+
+static int put_sparse_uint32(QEMUFile *f, void *pv, size_t size,
+                             const VMStateField *field, JSONWriter *vmdesc)
+{
+    return put_sparse(f, pv, size, sizeof(uint32_t), vmdesc);
+}
+
+const VMStateInfo vmstate_info_sparse_uint32 = {
+    .name = "sparse uint32",
+    .get = get_sparse_uint32,
+    .put = put_sparse_uint32,
+};
+
 /* get for QTAILQ
  * meta data about the QTAILQ is encoded in a VMStateField structure
  */
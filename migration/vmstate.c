@@ -487,16 +487,32 @@ static int vmstate_subsection_load(QEMUFile *f, const VMStateDescription *vmsd,
     return 0;
 }
 
+/* Starts past the saved_epoch of devices that were never saved */
+static uint32_t vmstate_gen_epoch = 1;
+
+void vmstate_gen_new_epoch(void)
+{
+    qatomic_inc(&vmstate_gen_epoch);
+}
+
 static int vmstate_subsection_save(QEMUFile *f, const VMStateDescription *vmsd,
                                    void *opaque, JSONWriter *vmdesc)
 {
     const VMStateDescription **sub = vmsd->subsections;
     bool vmdesc_has_subsections = false;
+    uint32_t epoch = qatomic_read(&vmstate_gen_epoch);
     int ret = 0;
 
     trace_vmstate_subsection_save_top(vmsd->name);
     while (sub && *sub) {
-        if (vmstate_save_needed(*sub, opaque)) {
+        VMStateGen *g = (*sub)->gen ? (*sub)->gen(opaque) : NULL;
+        uint32_t gen = g ? qatomic_read(&g->gen) : 0;
+
+        if (g && g->saved_epoch == epoch && g->saved_gen == gen) {
+            /* The other side already has it */
+            trace_vmstate_subsection_save_unchanged(vmsd->name, (*sub)->name,
+                                                    gen);
+        } else if (vmstate_save_needed(*sub, opaque)) {
             const VMStateDescription *vmsdsub = *sub;
             uint8_t len;
 
@@ -520,6 +536,10 @@ static int vmstate_subsection_save(QEMUFile *f, const VMStateDescription *vmsd,
             if (ret) {
                 return ret;
             }
+            if (g) {
+                g->saved_gen = gen;
+                g->saved_epoch = epoch;
+            }
 
             if (vmdesc) {
                 json_writer_end_object(vmdesc);
@@ -12,6 +12,7 @@
  */
 #include "qemu/osdep.h"
 #include "qemu/cutils.h"
+#include "qemu/host-utils.h"
 #include "xbzrle.h"
 
 /*
@@ -24,8 +25,8 @@
 
   length = uleb128 encoded integer
  */
-int xbzrle_encode_buffer(uint8_t *old_buf, uint8_t *new_buf, int slen,
-                         uint8_t *dst, int dlen)
+static int xbzrle_encode_buffer_int(uint8_t *old_buf, uint8_t *new_buf,
+                                    int slen, uint8_t *dst, int dlen)
 {
     uint32_t zrun_len = 0, nzrun_len = 0;
     int d = 0, i = 0;
@@ -126,6 +127,431 @@ int xbzrle_encode_buffer(uint8_t *old_buf, uint8_t *new_buf, int slen,
     return d;
 }
 
+static bool xbzrle_copy_page_int(uint8_t *dst, const uint8_t *src, int len)
+{
+    memcpy(dst, src, len);
+    return buffer_is_zero(dst, len);
+}
+
+#if defined(CONFIG_AVX512BW_OPT) || defined(CONFIG_AVX2_OPT) || \
+    defined(__SSE2__)
+/*
+ * The vectorized encoders share this loop and only differ in how they find
+ * the end of a run of equal (zrun) or different (nzrun) bytes.  The runs
+ * are the same as those of xbzrle_encode_buffer_int, and so is the output.
+ */
+typedef int XBZRLESkipFn(const uint8_t *old_buf, const uint8_t *new_buf,
+                         int i, int slen);
+
+static inline __attribute__((always_inline)) int
+xbzrle_encode_vec(uint8_t *old_buf, uint8_t *new_buf, int slen,
+                  uint8_t *dst, int dlen,
+                  XBZRLESkipFn *skip_equal, XBZRLESkipFn *skip_diff)
+{
+    uint32_t zrun_len, nzrun_len;
+    int d = 0, i = 0, start;
+
+    while (i < slen) {
+        /* overflow */
+        if (d + 2 > dlen) {
+            return -1;
+        }
+
+        start = i;
+        i = skip_equal(old_buf, new_buf, i, slen);
+        zrun_len = i - start;
+
+        /* buffer unchanged */
+        if (zrun_len == slen) {
+            return 0;
+        }
+
+        /* skip last zero run */
+        if (i == slen) {
+            return d;
+        }
+
+        d += uleb128_encode_small(dst + d, zrun_len);
+
+        /* overflow */
+        if (d + 2 > dlen) {
+            return -1;
+        }
+
+        start = i;
+        i = skip_diff(old_buf, new_buf, i, slen);
+        nzrun_len = i - start;
+
+        d += uleb128_encode_small(dst + d, nzrun_len);
+        /* overflow */
+        if (d + nzrun_len > dlen) {
+            return -1;
+        }
+        memcpy(dst + d, new_buf + start, nzrun_len);
+        d += nzrun_len;
+    }
+
+    return d;
+}
+
+/* Do not use push_options pragmas unnecessarily, because clang
+ * does not support them.
+ */
+#if defined(CONFIG_AVX512BW_OPT) || defined(CONFIG_AVX2_OPT)
+#pragma GCC push_options
+#pragma GCC target("sse2")
+#endif
+#include <emmintrin.h>
+
+static inline int xbzrle_skip_equal_sse2(const uint8_t *old_buf,
+                                         const uint8_t *new_buf,
+                                         int i, int slen)
+{
+    for (; i + 16 <= slen; i += 16) {
+        __m128i o = _mm_loadu_si128((const __m128i *)(old_buf + i));
+        __m128i n = _mm_loadu_si128((const __m128i *)(new_buf + i));
+        uint32_t eq = _mm_movemask_epi8(_mm_cmpeq_epi8(o, n));
+
+        if (eq != 0xffff) {
+            return i + ctz32(~eq);
+        }
+    }
+    while (i < slen && old_buf[i] == new_buf[i]) {
+        i++;
+    }
+    return i;
+}
+
+static inline int xbzrle_skip_diff_sse2(const uint8_t *old_buf,
+                                        const uint8_t *new_buf,
+                                        int i, int slen)
+{
+    for (; i + 16 <= slen; i += 16) {
+        __m128i o = _mm_loadu_si128((const __m128i *)(old_buf + i));
+        __m128i n = _mm_loadu_si128((const __m128i *)(new_buf + i));
+        uint32_t eq = _mm_movemask_epi8(_mm_cmpeq_epi8(o, n));
+
+        if (eq) {
+            return i + ctz32(eq);
+        }
+    }
+    while (i < slen && old_buf[i] != new_buf[i]) {
+        i++;
+    }
+    return i;
+}
+
+static int xbzrle_encode_buffer_sse2(uint8_t *old_buf, uint8_t *new_buf,
+                                     int slen, uint8_t *dst, int dlen)
+{
+    return xbzrle_encode_vec(old_buf, new_buf, slen, dst, dlen,
+                             xbzrle_skip_equal_sse2, xbzrle_skip_diff_sse2);
+}
+
+/* Note that the copy functions require len to be a multiple of 64.  */
+
+static bool xbzrle_copy_page_sse2(uint8_t *dst, const uint8_t *src, int len)
+{
+    __m128i t = _mm_setzero_si128();
+    int i;
+
+    for (i = 0; i < len; i += 64) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(src + i + 16));
+        __m128i c = _mm_loadu_si128((const __m128i *)(src + i + 32));
+        __m128i d = _mm_loadu_si128((const __m128i *)(src + i + 48));
+
+        _mm_storeu_si128((__m128i *)(dst + i), a);
+        _mm_storeu_si128((__m128i *)(dst + i + 16), b);
+        _mm_storeu_si128((__m128i *)(dst + i + 32), c);
+        _mm_storeu_si128((__m128i *)(dst + i + 48), d);
+        t = _mm_or_si128(t, _mm_or_si128(_mm_or_si128(a, b),
+                                         _mm_or_si128(c, d)));
+    }
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(t, _mm_setzero_si128())) ==
+           0xffff;
+}
+#if defined(CONFIG_AVX512BW_OPT) || defined(CONFIG_AVX2_OPT)
+#pragma GCC pop_options
+#endif
+
+#ifdef CONFIG_AVX2_OPT
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#include <immintrin.h>
+
+static inline int xbzrle_skip_equal_avx2(const uint8_t *old_buf,
+                                         const uint8_t *new_buf,
+                                         int i, int slen)
+{
+    for (; i + 32 <= slen; i += 32) {
+        __m256i o = _mm256_loadu_si256((const __m256i *)(old_buf + i));
+        __m256i n = _mm256_loadu_si256((const __m256i *)(new_buf + i));
+        uint32_t eq = _mm256_movemask_epi8(_mm256_cmpeq_epi8(o, n));
+
+        if (eq != UINT32_MAX) {
+            return i + ctz32(~eq);
+        }
+    }
+    while (i < slen && old_buf[i] == new_buf[i]) {
+        i++;
+    }
+    return i;
+}
+
+static inline int xbzrle_skip_diff_avx2(const uint8_t *old_buf,
+                                        const uint8_t *new_buf,
+                                        int i, int slen)
+{
+    for (; i + 32 <= slen; i += 32) {
+        __m256i o = _mm256_loadu_si256((const __m256i *)(old_buf + i));
+        __m256i n = _mm256_loadu_si256((const __m256i *)(new_buf + i));
+        uint32_t eq = _mm256_movemask_epi8(_mm256_cmpeq_epi8(o, n));
+
+        if (eq) {
+            return i + ctz32(eq);
+        }
+    }
+    while (i < slen && old_buf[i] != new_buf[i]) {
+        i++;
+    }
+    return i;
+}
+
+static int xbzrle_encode_buffer_avx2(uint8_t *old_buf, uint8_t *new_buf,
+                                     int slen, uint8_t *dst, int dlen)
+{
+    return xbzrle_encode_vec(old_buf, new_buf, slen, dst, dlen,
+                             xbzrle_skip_equal_avx2, xbzrle_skip_diff_avx2);
+}
+
+static bool xbzrle_copy_page_avx2(uint8_t *dst, const uint8_t *src, int len)
+{
+    __m256i t = _mm256_setzero_si256();
+    int i;
+
+    for (i = 0; i < len; i += 64) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(src + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(src + i + 32));
+
+        _mm256_storeu_si256((__m256i *)(dst + i), a);
+        _mm256_storeu_si256((__m256i *)(dst + i + 32), b);
+        t = _mm256_or_si256(t, _mm256_or_si256(a, b));
+    }
+    return _mm256_testz_si256(t, t);
+}
+#pragma GCC pop_options
+#endif /* CONFIG_AVX2_OPT */
+
+#ifdef CONFIG_AVX512BW_OPT
+#pragma GCC push_options
+#pragma GCC target("avx512bw")
+#include <immintrin.h>
+
+static inline int xbzrle_skip_equal_avx512(const uint8_t *old_buf,
+                                           const uint8_t *new_buf,
+                                           int i, int slen)
+{
+    for (; i + 64 <= slen; i += 64) {
+        __m512i o = _mm512_loadu_si512(old_buf + i);
+        __m512i n = _mm512_loadu_si512(new_buf + i);
+        uint64_t eq = _mm512_cmpeq_epi8_mask(o, n);
+
+        if (eq != UINT64_MAX) {
+            return i + ctz64(~eq);
+        }
+    }
+    while (i < slen && old_buf[i] == new_buf[i]) {
+        i++;
+    }
+    return i;
+}
+
+static inline int xbzrle_skip_diff_avx512(const uint8_t *old_buf,
+                                          const uint8_t *new_buf,
+                                          int i, int slen)
+{
+    for (; i + 64 <= slen; i += 64) {
+        __m512i o = _mm512_loadu_si512(old_buf + i);
+        __m512i n = _mm512_loadu_si512(new_buf + i);
+        uint64_t eq = _mm512_cmpeq_epi8_mask(o, n);
+
+        if (eq) {
+            return i + ctz64(eq);
+        }
+    }
+    while (i < slen && old_buf[i] != new_buf[i]) {
+        i++;
+    }
+    return i;
+}
+
+static int xbzrle_encode_buffer_avx512(uint8_t *old_buf, uint8_t *new_buf,
+                                       int slen, uint8_t *dst, int dlen)
+{
+    return xbzrle_encode_vec(old_buf, new_buf, slen, dst, dlen,
+                             xbzrle_skip_equal_avx512,
+                             xbzrle_skip_diff_avx512);
+}
+
+static bool xbzrle_copy_page_avx512(uint8_t *dst, const uint8_t *src,
+                                    int len)
+{
+    __m512i t = _mm512_setzero_si512();
+    int i;
+
+    for (i = 0; i < len; i += 64) {
+        __m512i a = _mm512_loadu_si512(src + i);
+
+        _mm512_storeu_si512(dst + i, a);
+        t = _mm512_or_si512(t, a);
+    }
+    return !_mm512_test_epi64_mask(t, t);
+}
+#pragma GCC pop_options
+#endif /* CONFIG_AVX512BW_OPT */
+
+/* Note that for test_xbzrle_next_accel, the most preferred
+ * ISA must have the least significant bit.
+ */
+#define CACHE_AVX512BW 1
+#define CACHE_AVX2     2
+#define CACHE_SSE2     4
+
+/* Until the constructor below has run, use the code that every
+ * host supports.
+ */
+#if defined(CONFIG_AVX512BW_OPT) || defined(CONFIG_AVX2_OPT)
+# define INIT_CACHE      0
+# define INIT_ENCODE     xbzrle_encode_buffer_int
+# define INIT_COPY       xbzrle_copy_page_int
+# define INIT_NAME       "int"
+#else
+# define INIT_CACHE      CACHE_SSE2
+# define INIT_ENCODE     xbzrle_encode_buffer_sse2
+# define INIT_COPY       xbzrle_copy_page_sse2
+# define INIT_NAME       "sse2"
+#endif
+
+static unsigned cpuid_cache = INIT_CACHE;
+static int (*encode_accel)(uint8_t *, uint8_t *, int, uint8_t *, int) =
+    INIT_ENCODE;
+static bool (*copy_accel)(uint8_t *, const uint8_t *, int) = INIT_COPY;
+static const char *accel_name = INIT_NAME;
+
+static void init_accel(unsigned cache)
+{
+    encode_accel = xbzrle_encode_buffer_int;
+    copy_accel = xbzrle_copy_page_int;
+    accel_name = "int";
+    if (cache & CACHE_SSE2) {
+        encode_accel = xbzrle_encode_buffer_sse2;
+        copy_accel = xbzrle_copy_page_sse2;
+        accel_name = "sse2";
+    }
+#ifdef CONFIG_AVX2_OPT
+    if (cache & CACHE_AVX2) {
+        encode_accel = xbzrle_encode_buffer_avx2;
+        copy_accel = xbzrle_copy_page_avx2;
+        accel_name = "avx2";
+    }
+#endif
+#ifdef CONFIG_AVX512BW_OPT
+    if (cache & CACHE_AVX512BW) {
+        encode_accel = xbzrle_encode_buffer_avx512;
+        copy_accel = xbzrle_copy_page_avx512;
+        accel_name = "avx512bw";
+    }
+#endif
+}
+
+#if defined(CONFIG_AVX512BW_OPT) || defined(CONFIG_AVX2_OPT)
+#include "qemu/cpuid.h"
+
+static void __attribute__((constructor)) init_cpuid_cache(void)
+{
+    unsigned max = __get_cpuid_max(0, NULL);
+    int a, b, c, d;
+    unsigned cache = 0;
+
+    if (max >= 1) {
+        __cpuid(1, a, b, c, d);
+        if (d & bit_SSE2) {
+            cache |= CACHE_SSE2;
+        }
+
+        /* We must check that AVX is not just available, but usable.  */
+        if ((c & bit_OSXSAVE) && (c & bit_AVX) && max >= 7) {
+            int bv;
+            __asm("xgetbv" : "=a"(bv), "=d"(d) : "c"(0));
+            __cpuid_count(7, 0, a, b, c, d);
+            if ((bv & 0x6) == 0x6 && (b & bit_AVX2)) {
+                cache |= CACHE_AVX2;
+            }
+            /* The OS must save the opmask and ZMM state, see bufferiszero.c */
+            if ((bv & 0xe6) == 0xe6 && (b & bit_AVX512BW)) {
+                cache |= CACHE_AVX512BW;
+            }
+        }
+    }
+    cpuid_cache = cache;
+    init_accel(cache);
+}
+#endif /* CONFIG_AVX2_OPT */
+
+bool test_xbzrle_next_accel(void)
+{
+    /* If no bits set, we just tested the integer code, and there
+       are no more acceleration options to test.  */
+    if (cpuid_cache == 0) {
+        return false;
+    }
+    /* Disable the accelerator we used before and select a new one.  */
+    cpuid_cache &= cpuid_cache - 1;
+    init_accel(cpuid_cache);
+    return true;
+}
+
+const char *test_xbzrle_accel_name(void)
+{
+    return accel_name;
+}
+
+int xbzrle_encode_buffer(uint8_t *old_buf, uint8_t *new_buf, int slen,
+                         uint8_t *dst, int dlen)
+{
+    return encode_accel(old_buf, new_buf, slen, dst, dlen);
+}
+
+bool xbzrle_copy_page(uint8_t *dst, const uint8_t *src, int len)
+{
+    g_assert(!(len % 64));
+    return copy_accel(dst, src, len);
+}
+
+#else
+int xbzrle_encode_buffer(uint8_t *old_buf, uint8_t *new_buf, int slen,
+                         uint8_t *dst, int dlen)
+{
+    return xbzrle_encode_buffer_int(old_buf, new_buf, slen, dst, dlen);
+}
+
+bool xbzrle_copy_page(uint8_t *dst, const uint8_t *src, int len)
+{
+    return xbzrle_copy_page_int(dst, src, len);
+}
+
+bool test_xbzrle_next_accel(void)
+{
+    return false;
+}
+
+const char *test_xbzrle_accel_name(void)
+{
+    return "int";
+}
+#endif
+
 int xbzrle_decode_buffer(uint8_t *src, int slen, uint8_t *dst, int dlen)
 {
     int i = 0, d = 0;
@@ -18,4 +18,15 @@ int xbzrle_encode_buffer(uint8_t *old_buf, uint8_t *new_buf, int slen,
                          uint8_t *dst, int dlen);
 
 int xbzrle_decode_buffer(uint8_t *src, int slen, uint8_t *dst, int dlen);
+
+/*
+ * Copy a page of @len bytes, a multiple of 64, and return true if it is
+ * all zeroes.  This reads the page only once where xbzrle_encode_buffer
+ * and buffer_is_zero would each read it.
+ */
+bool xbzrle_copy_page(uint8_t *dst, const uint8_t *src, int len);
+
+/* Switch to the next slower implementation, for tests and benchmarks */
+bool test_xbzrle_next_accel(void);
+const char *test_xbzrle_accel_name(void);
 #endif
@@ -573,6 +573,16 @@ static void hmp_info_vnc_clients(Monitor *mon, VncClientInfoList *client)
         monitor_printf(mon, "    sasl_username: %s\n",
                        cinfo->has_sasl_username ?
                        cinfo->sasl_username : "none");
+        if (cinfo->has_encode_stats) {
+            VncEncodeStats *st = cinfo->encode_stats;
+
+            monitor_printf(mon, "    encoded: %" PRIu64 " updates, %" PRIu64
+                           " rects, %" PRIu64 " bytes in %" PRIu64
+                           " us (max %" PRIu64 " us)\n",
+                           st->updates, st->rects, st->bytes,
+                           st->encode_time_ns / SCALE_US,
+                           st->max_encode_time_ns / SCALE_US);
+        }
 
         client = client->next;
     }
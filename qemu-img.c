@@ -204,7 +204,7 @@ void help(void)
            "Parameters to convert subcommand:\n"
            "  '--bitmaps' copies all top-level persistent bitmaps to destination\n"
            "  '-m' specifies how many coroutines work in parallel during the convert\n"
-           "       process (defaults to 8)\n"
+           "       process (defaults to 8, or 16 for DMG sources)\n"
            "  '-W' allow to write to the target out of order rather than sequential\n"
            "\n"
            "Parameters to snapshot subcommand:\n"
@@ -2219,6 +2219,7 @@ static int img_convert(int argc, char **argv)
     int64_t ret = -EINVAL;
     bool force_share = false;
     bool explict_min_sparse = false;
+    bool explicit_num_coroutines = false;
     bool bitmaps = false;
     bool skip_broken = false;
     int64_t rate_limit = 0;
@@ -2338,6 +2339,7 @@ static int img_convert(int argc, char **argv)
                              " coroutines is between 1 and %d", MAX_COROUTINES);
                 goto fail_getopt;
             }
+            explicit_num_coroutines = true;
             break;
         case 'W':
             s.wr_in_order = false;
@@ -2478,6 +2480,14 @@ static int img_convert(int argc, char **argv)
             s.src_alignment[bs_i] = MAX(s.src_alignment[bs_i],
                                         bdi.cluster_size / BDRV_SECTOR_SIZE);
         }
+        /*
+         * DMG decompresses chunks on the thread pool, so reading is CPU
+         * bound: keep as many requests in flight as we can to feed it.
+         */
+        if (!explicit_num_coroutines &&
+            !strcmp(bdrv_get_format_name(src_bs), "dmg")) {
+            s.num_coroutines = MAX_COROUTINES;
+        }
         s.total_sectors += s.src_sectors[bs_i];
     }
 
@@ -184,6 +184,9 @@ DEF("accel", HAS_ARG, QEMU_OPTION_accel,
     "                kvm-shadow-mem=size of KVM shadow MMU in bytes\n"
     "                split-wx=on|off (enable TCG split w^x mapping)\n"
     "                tb-size=n (TCG translation block cache size)\n"
+    "                tb-evict=on|off (evict old TCG translations instead of flushing, default off)\n"
+    "                hot-threshold=n (retranslate hot TCG blocks as superblocks)\n"
+    "                idle-warp=on|off (skip idle virtual time, default off)\n"
     "                dirty-ring-size=n (KVM dirty ring GFN count, default 0)\n"
     "                thread=single|multi (enable multi-threaded TCG)\n", QEMU_ARCH_ALL)
 SRST
@@ -218,6 +221,31 @@ SRST
     ``tb-size=n``
         Controls the size (in MiB) of the TCG translation block cache.
 
+    ``tb-evict=on|off``
+        When the TCG translation block cache is full, frees only the
+        least recently used of its regions instead of discarding every
+        translation, so that the code the guest keeps running survives.
+        The cache is split into more regions than usual for this; if no
+        region can be freed, the whole cache is flushed as before.
+        ``info jit`` reports how often each happened.  Only in system
+        emulation; the default is off.
+
+    ``hot-threshold=n``
+        Counts the executions of every TCG translation block and
+        retranslates a block executed ``n`` times as a superblock that
+        follows direct branches within its page, for targets that support
+        it (currently AArch64).  ``info jit`` lists the superblocks that
+        were formed.  The default of 0 disables this.
+
+    ``idle-warp=on|off``
+        When all vCPUs are idle and no block request is in flight, moves
+        the virtual clock straight to the next timer deadline instead of
+        waiting for it, so that guests which mostly sleep run faster than
+        real time.  The guest sees time pass normally; only the host does
+        not wait.  ``info jit`` reports how much virtual time was skipped.
+        Cannot be combined with ``-icount``, whose ``sleep=off`` does the
+        same in instruction counting mode.
+
     ``thread=single|multi``
         Controls number of TCG threads. When the TCG is multi-threaded
         there will be one thread per vCPU therefore taking advantage of
@@ -2442,6 +2470,14 @@ SRST
         bandwidth when playing videos. Disabling adaptive encodings
         restores the original static behavior of encodings like Tight.
 
+    ``encode-threads=n``
+        Encode framebuffer updates on at least ``n`` threads (default
+        1).  The threads are shared by all VNC displays and clients;
+        each client's updates are still sent in order.  With the raw and
+        hextile encodings, large updates are also split between the
+        threads.  ``info vnc`` shows how long each client's updates took
+        to encode.
+
     ``share=[allow-exclusive|force-shared|ignore]``
         Set display sharing policy. 'allow-exclusive' allows clients to
         ask for exclusive access. As suggested by the rfb spec this is
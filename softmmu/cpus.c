@@ -420,6 +420,7 @@ void qemu_wait_io_event(CPUState *cpu)
             slept = true;
             qemu_plugin_vcpu_idle_cb(cpu);
         }
+        idle_warp_kick();
         qemu_cond_wait(cpu->halt_cond, &qemu_global_mutex);
     }
     if (slept) {
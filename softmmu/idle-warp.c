@@ -0,0 +1,111 @@
+/*
+ * Idle time warp
+ *
+ * When every vCPU is idle (e.g. in WFI) and no block request is in
+ * flight, nothing can happen before the next QEMU_CLOCK_VIRTUAL deadline
+ * other than external input.  Instead of waiting for it in real time,
+ * move the virtual clock forward to that deadline, much like icount's
+ * sleep=off does, but without counting instructions.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/main-loop.h"
+#include "qemu/seqlock.h"
+#include "block/block_int.h"
+#include "sysemu/cpus.h"
+#include "sysemu/cpu-timers.h"
+#include "sysemu/qtest.h"
+#include "sysemu/runstate.h"
+#include "timers-state.h"
+#include "trace.h"
+
+static QEMUBH *idle_warp_bh;
+static uint64_t idle_warp_count;
+static int64_t idle_warp_ns;
+
+static bool idle_warp_io_pending(void)
+{
+    BdrvNextIterator it;
+    BlockDriverState *bs;
+
+    for (bs = bdrv_first(&it); bs; bs = bdrv_next(&it)) {
+        if (qatomic_read(&bs->in_flight)) {
+            bdrv_next_cleanup(&it);
+            return true;
+        }
+    }
+    return false;
+}
+
+static void idle_warp_bh_cb(void *opaque)
+{
+    int64_t deadline;
+
+    if (!runstate_is_running() || !all_cpu_threads_idle() ||
+        idle_warp_io_pending()) {
+        return;
+    }
+
+    deadline = qemu_clock_deadline_ns_all(QEMU_CLOCK_VIRTUAL,
+                                          ~QEMU_TIMER_ATTR_EXTERNAL);
+    if (deadline < 0) {
+        /* Only external input can wake the vCPUs */
+        return;
+    }
+
+    if (deadline > 0) {
+        seqlock_write_lock(&timers_state.vm_clock_seqlock,
+                           &timers_state.vm_clock_lock);
+        timers_state.cpu_clock_offset += deadline;
+        seqlock_write_unlock(&timers_state.vm_clock_seqlock,
+                             &timers_state.vm_clock_lock);
+
+        idle_warp_count++;
+        idle_warp_ns += deadline;
+        trace_idle_warp(deadline);
+        qemu_clock_notify(QEMU_CLOCK_VIRTUAL);
+    }
+
+    /*
+     * Check again once the expired timers have run: if none of them woke
+     * up a vCPU, go on to the following deadline.
+     */
+    qemu_bh_schedule(idle_warp_bh);
+}
+
+void idle_warp_init(Error **errp)
+{
+    if (icount_enabled()) {
+        error_setg(errp, "idle-warp is incompatible with icount, "
+                   "use -icount sleep=off instead");
+        return;
+    }
+    if (qtest_enabled()) {
+        /* qtest moves the virtual clock itself */
+        return;
+    }
+    idle_warp_bh = qemu_bh_new(idle_warp_bh_cb, NULL);
+}
+
+void idle_warp_kick(void)
+{
+    if (idle_warp_bh) {
+        qemu_bh_schedule(idle_warp_bh);
+    }
+}
+
+void idle_warp_dump_info(GString *buf)
+{
+    if (!idle_warp_bh) {
+        return;
+    }
+
+    g_string_append_printf(buf, "\nIdle time warp:\n");
+    g_string_append_printf(buf, "warps               %" PRIu64 "\n",
+                           idle_warp_count);
+    g_string_append_printf(buf, "virtual time warped %" PRId64 " ms\n",
+                           idle_warp_ns / SCALE_MS);
+}
@@ -15,6 +15,7 @@
 #include "arm-powerctl.h"
 #include "qemu/log.h"
 #include "qemu/main-loop.h"
+#include "qemu/timer.h"
 
 #ifndef DEBUG_ARM_POWERCTL
 #define DEBUG_ARM_POWERCTL 0
@@ -137,7 +138,7 @@ static void arm_set_cpu_on_async_work(CPUState *target_cpu_state,
 
     /* Finally set the power status */
     assert(qemu_mutex_iothread_locked());
-    target_cpu->power_state = PSCI_ON;
+    arm_set_power_state(target_cpu, PSCI_ON);
 }
 
 int arm_set_cpu_on(uint64_t cpuid, uint64_t entry, uint64_t context_id,
@@ -245,7 +246,7 @@ static void arm_set_cpu_on_and_reset_async_work(CPUState *target_cpu_state,
 
     /* Finally set the power status */
     assert(qemu_mutex_iothread_locked());
-    target_cpu->power_state = PSCI_ON;
+    arm_set_power_state(target_cpu, PSCI_ON);
 }
 
 int arm_set_cpu_on_and_reset(uint64_t cpuid)
@@ -294,11 +295,23 @@ static void arm_set_cpu_off_async_work(CPUState *target_cpu_state,
                                        run_on_cpu_data data)
 {
     ARMCPU *target_cpu = ARM_CPU(target_cpu_state);
+    int i;
 
     assert(qemu_mutex_iothread_locked());
-    target_cpu->power_state = PSCI_OFF;
+    arm_set_power_state(target_cpu, PSCI_OFF);
     target_cpu_state->halted = 1;
     target_cpu_state->exception_index = EXCP_HLT;
+
+    /*
+     * A powered off core has no running timers; stop them so they do not
+     * keep kicking the parked vCPU thread. Powering the core back on goes
+     * through cpu_reset(), which puts them back in their reset state.
+     */
+    for (i = 0; i < NUM_GTIMERS; i++) {
+        if (target_cpu->gt_timer[i]) {
+            timer_del(target_cpu->gt_timer[i]);
+        }
+    }
 }
 
 int arm_set_cpu_off(uint64_t cpuid)
@@ -3463,6 +3463,33 @@ void arm_register_pre_el_change_hook(ARMCPU *cpu, ARMELChangeHookFn *hook,
 void arm_register_el_change_hook(ARMCPU *cpu, ARMELChangeHookFn *hook, void
         *opaque);
 
+/**
+ * ARMPCHookFn:
+ * type of a function which can be registered via arm_register_pc_hook()
+ * to get callbacks when any AArch64 CPU executes the instruction at a
+ * given virtual address.
+ */
+typedef void ARMPCHookFn(ARMCPU *cpu, uint64_t pc, void *opaque);
+
+/**
+ * arm_register_pc_hook:
+ * Register a hook function which will be called every time an AArch64
+ * CPU is about to execute the instruction at virtual address @pc.  The
+ * call is inserted at translation time, so unlike a breakpoint it does
+ * not leave the TB or raise a debug exception.  Only one hook can be
+ * registered per address; registering again replaces the previous one.
+ *
+ * Hooks must only be registered or removed while the vCPUs are stopped,
+ * e.g. from machine init or reset.
+ */
+void arm_register_pc_hook(uint64_t pc, ARMPCHookFn *hook, void *opaque);
+
+/**
+ * arm_remove_pc_hooks:
+ * Remove all hooks registered with the function @hook.
+ */
+void arm_remove_pc_hooks(ARMPCHookFn *hook);
+
 /**
  * arm_rebuild_hflags:
  * Rebuild the cached TBFLAGS for arbitrary changed processor state.
@@ -1177,6 +1177,64 @@ static void *get_page_write(CPUARMState *env, uint64_t vaddr_in, int mmu_idx)
     return mem;
 }
 
+typedef struct ARMPCHook {
+    ARMPCHookFn *hook;
+    void *opaque;
+} ARMPCHook;
+
+/* pc -> ARMPCHook; only modified while the vCPUs are stopped */
+static GHashTable *arm_pc_hooks;
+
+static void arm_pc_hooks_changed(void)
+{
+    if (first_cpu) {
+        tb_flush(first_cpu);
+    }
+}
+
+void arm_register_pc_hook(uint64_t pc, ARMPCHookFn *hook, void *opaque)
+{
+    ARMPCHook *entry = g_new0(ARMPCHook, 1);
+    uint64_t *key = g_new(uint64_t, 1);
+
+    if (!arm_pc_hooks) {
+        arm_pc_hooks = g_hash_table_new_full(g_int64_hash, g_int64_equal,
+                                             g_free, g_free);
+    }
+    *key = pc;
+    entry->hook = hook;
+    entry->opaque = opaque;
+    g_hash_table_replace(arm_pc_hooks, key, entry);
+    arm_pc_hooks_changed();
+}
+
+static gboolean arm_pc_hook_match(gpointer key, gpointer value, gpointer data)
+{
+    return ((ARMPCHook *)value)->hook == data;
+}
+
+void arm_remove_pc_hooks(ARMPCHookFn *hook)
+{
+    if (arm_pc_hooks &&
+        g_hash_table_foreach_remove(arm_pc_hooks, arm_pc_hook_match, hook)) {
+        arm_pc_hooks_changed();
+    }
+}
+
+bool arm_pc_hook_present(uint64_t pc)
+{
+    return arm_pc_hooks && g_hash_table_contains(arm_pc_hooks, &pc);
+}
+
+void HELPER(pc_hook)(CPUARMState *env, uint64_t pc)
+{
+    ARMPCHook *entry = g_hash_table_lookup(arm_pc_hooks, &pc);
+
+    if (entry) {
+        entry->hook(env_archcpu(env), pc, entry->opaque);
+    }
+}
+
 uint64_t HELPER(wkdmc)(CPUARMState *env, uint64_t vaddr_in, uint64_t vaddr_out)
 {
     int mmu_idx = cpu_mmu_index(env, false);
@@ -120,5 +120,7 @@ DEF_HELPER_FLAGS_2(ldgm, TCG_CALL_NO_WG, i64, env, i64)
 DEF_HELPER_FLAGS_3(stgm, TCG_CALL_NO_WG, void, env, i64, i64)
 DEF_HELPER_FLAGS_3(stzgm_tags, TCG_CALL_NO_WG, void, env, i64, i64)
 
+DEF_HELPER_FLAGS_2(pc_hook, TCG_CALL_NO_RWG, void, env, i64)
+
 DEF_HELPER_FLAGS_3(wkdmc, TCG_CALL_NO_WG, i64, env, i64, i64)
 DEF_HELPER_FLAGS_3(wkdmd, TCG_CALL_NO_WG, i64, env, i64, i64)
@@ -53,6 +53,17 @@ static inline bool excp_is_internal(int excp)
         || excp == EXCP_SEMIHOST;
 }
 
+/*
+ * Update the PSCI power state of @cpu. A powered off vCPU is parked:
+ * cross-vCPU TLB flushes leave it alone, which is safe because every
+ * path that powers it back on resets (and so flushes) it first.
+ */
+static inline void arm_set_power_state(ARMCPU *cpu, ARMPSCIState state)
+{
+    cpu->power_state = state;
+    qatomic_set(&CPU(cpu)->parked, state == PSCI_OFF);
+}
+
 /* Scale factor for generic timers, ie number of ns per tick.
  * This gives a 62.5MHz timer.
  */
@@ -185,6 +196,9 @@ static inline int r14_bank_number(int mode)
 void arm_cpu_register_gdb_regs_for_features(ARMCPU *cpu);
 void arm_translate_init(void);
 
+/* Return true if a hook is registered for @pc, see arm_register_pc_hook() */
+bool arm_pc_hook_present(uint64_t pc);
+
 #ifdef CONFIG_TCG
 void arm_cpu_synchronize_from_tb(CPUState *cs, const TranslationBlock *tb);
 #endif /* CONFIG_TCG */
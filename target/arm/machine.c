@@ -656,7 +656,7 @@ static int get_power(QEMUFile *f, void *opaque, size_t size,
 {
     ARMCPU *cpu = opaque;
     bool powered_off = qemu_get_byte(f);
-    cpu->power_state = powered_off ? PSCI_OFF : PSCI_ON;
+    arm_set_power_state(cpu, powered_off ? PSCI_OFF : PSCI_ON);
     return 0;
 }
 
@@ -396,6 +396,33 @@ static inline void gen_goto_tb(DisasContext *s, int n, uint64_t dest)
     }
 }
 
+/*
+ * In a superblock, translation continues at the target of an unconditional
+ * forward branch, and on the fall through path of a conditional forward
+ * branch whose taken path becomes a side exit at the end of the TB.
+ * Backward branches still end the TB.
+ */
+static bool a64_sb_follow(DisasContext *s, uint64_t dest)
+{
+    if (s->ss_active || !translator_extend_superblock(&s->base, dest)) {
+        return false;
+    }
+    s->base.pc_next = dest;
+    return true;
+}
+
+static bool a64_sb_side_exit(DisasContext *s, TCGLabel *taken, uint64_t dest)
+{
+    if (dest <= s->pc_curr || s->sb_exits == ARRAY_SIZE(s->sb_exit) ||
+        !a64_sb_follow(s, s->base.pc_next)) {
+        return false;
+    }
+    s->sb_exit[s->sb_exits].label = taken;
+    s->sb_exit[s->sb_exits].dest = dest;
+    s->sb_exits++;
+    return true;
+}
+
 static void init_tmp_a64_array(DisasContext *s)
 {
 #ifdef CONFIG_DEBUG_TCG
@@ -1371,6 +1398,9 @@ static void disas_uncond_b_imm(DisasContext *s, uint32_t insn)
 
     /* B Branch / BL Branch with link */
     reset_btype(s);
+    if (a64_sb_follow(s, addr)) {
+        return;
+    }
     gen_goto_tb(s, 0, addr);
 }
 
@@ -1398,6 +1428,9 @@ static void disas_comp_b_imm(DisasContext *s, uint32_t insn)
     reset_btype(s);
     tcg_gen_brcondi_i64(op ? TCG_COND_NE : TCG_COND_EQ,
                         tcg_cmp, 0, label_match);
+    if (a64_sb_side_exit(s, label_match, addr)) {
+        return;
+    }
 
     gen_goto_tb(s, 0, s->base.pc_next);
     gen_set_label(label_match);
@@ -1430,6 +1463,9 @@ static void disas_test_b_imm(DisasContext *s, uint32_t insn)
     tcg_gen_brcondi_i64(op ? TCG_COND_NE : TCG_COND_EQ,
                         tcg_cmp, 0, label_match);
     tcg_temp_free_i64(tcg_cmp);
+    if (a64_sb_side_exit(s, label_match, addr)) {
+        return;
+    }
     gen_goto_tb(s, 0, s->base.pc_next);
     gen_set_label(label_match);
     gen_goto_tb(s, 1, addr);
@@ -1458,10 +1494,13 @@ static void disas_cond_b_imm(DisasContext *s, uint32_t insn)
         /* genuinely conditional branches */
         TCGLabel *label_match = gen_new_label();
         arm_gen_test_cc(cond, label_match);
+        if (a64_sb_side_exit(s, label_match, addr)) {
+            return;
+        }
         gen_goto_tb(s, 0, s->base.pc_next);
         gen_set_label(label_match);
         gen_goto_tb(s, 1, addr);
-    } else {
+    } else if (!a64_sb_follow(s, addr)) {
         /* 0xe and 0xf are both "always" conditions */
         gen_goto_tb(s, 0, addr);
     }
@@ -14900,6 +14939,10 @@ static void aarch64_tr_translate_insn(DisasContextBase *dcbase, CPUState *cpu)
     s->insn = insn;
     s->base.pc_next = pc + 4;
 
+    if (unlikely(arm_pc_hook_present(pc))) {
+        gen_helper_pc_hook(cpu_env, tcg_constant_i64(pc));
+    }
+
     s->fp_access_checked = false;
     s->sve_access_checked = false;
 
@@ -15012,6 +15055,7 @@ static void aarch64_tr_translate_insn(DisasContextBase *dcbase, CPUState *cpu)
 static void aarch64_tr_tb_stop(DisasContextBase *dcbase, CPUState *cpu)
 {
     DisasContext *dc = container_of(dcbase, DisasContext, base);
+    int i;
 
     if (unlikely(dc->ss_active)) {
         /* Note that this means single stepping WFI doesn't halt the CPU.
@@ -15074,6 +15118,12 @@ static void aarch64_tr_tb_stop(DisasContextBase *dcbase, CPUState *cpu)
             tcg_gen_exit_tb(NULL, 0);
             break;
         }
+
+        for (i = 0; i < dc->sb_exits; i++) {
+            gen_set_label(dc->sb_exit[i].label);
+            gen_a64_set_pc_im(dc->sb_exit[i].dest);
+            tcg_gen_lookup_and_goto_ptr();
+        }
     }
 }
 
@@ -125,6 +125,12 @@ typedef struct DisasContext {
     int c15_cpar;
     /* TCG op of the current insn_start.  */
     TCGOp *insn_start;
+    /* Side exits of an A64 superblock, emitted at the end of the TB */
+    int sb_exits;
+    struct {
+        TCGLabel *label;
+        uint64_t dest;
+    } sb_exit[TB_SUPERBLOCK_MAX_BLOCKS];
 #define TMP_A64_MAX 16
     int tmp_a64_count;
     TCGv_i64 tmp_a64[TMP_A64_MAX];
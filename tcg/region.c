@@ -60,6 +60,16 @@ struct tcg_region_state {
     /* fields protected by the lock */
     size_t current; /* current region index */
     size_t agg_size_full; /* aggregate size of full regions */
+
+    /*
+     * With eviction enabled, a full buffer frees its least recently used
+     * region instead of being flushed.  @last_use holds, per region, the
+     * value of @clock when the region was last allocated or seen in use;
+     * @clock advances on every allocation.
+     */
+    bool evict;
+    uint64_t clock;
+    uint64_t *last_use;
 };
 
 static struct tcg_region_state region;
@@ -167,10 +177,9 @@ static void tcg_region_trees_init(void)
     }
 }
 
-static struct tcg_region_tree *tc_ptr_to_region_tree(const void *p)
+/* Returns the index of the region containing @p, or -1 */
+static ssize_t tc_ptr_to_region_idx(const void *p)
 {
-    size_t region_idx;
-
     /*
      * Like tcg_splitwx_to_rw, with no assert.  The pc may come from
      * a signal handler over which the caller has no control.
@@ -178,20 +187,28 @@ static struct tcg_region_tree *tc_ptr_to_region_tree(const void *p)
     if (!in_code_gen_buffer(p)) {
         p -= tcg_splitwx_diff;
         if (!in_code_gen_buffer(p)) {
-            return NULL;
+            return -1;
         }
     }
 
     if (p < region.start_aligned) {
-        region_idx = 0;
+        return 0;
     } else {
         ptrdiff_t offset = p - region.start_aligned;
 
         if (offset > region.stride * (region.n - 1)) {
-            region_idx = region.n - 1;
-        } else {
-            region_idx = offset / region.stride;
+            return region.n - 1;
         }
+        return offset / region.stride;
+    }
+}
+
+static struct tcg_region_tree *tc_ptr_to_region_tree(const void *p)
+{
+    ssize_t region_idx = tc_ptr_to_region_idx(p);
+
+    if (region_idx < 0) {
+        return NULL;
     }
     return region_trees + region_idx * tree_size;
 }
@@ -339,6 +356,9 @@ static bool tcg_region_alloc__locked(TCGContext *s)
         return true;
     }
     tcg_region_assign(s, region.current);
+    if (region.evict) {
+        region.last_use[region.current] = ++region.clock;
+    }
     region.current++;
     return false;
 }
@@ -398,13 +418,126 @@ void tcg_region_reset_all(void)
     tcg_region_tree_reset_all();
 }
 
-static size_t tcg_n_regions(size_t tb_size, unsigned max_cpus)
+/*
+ * Record that code in the region containing @tc_ptr is still in use.
+ * Call from a safe-work context.
+ */
+void tcg_region_touch(const void *tc_ptr)
+{
+    ssize_t idx;
+
+    if (!region.evict) {
+        return;
+    }
+    idx = tc_ptr_to_region_idx(tc_ptr);
+    if (idx >= 0) {
+        region.last_use[idx] = region.clock;
+    }
+}
+
+static bool tcg_region_in_use__locked(size_t idx)
+{
+    unsigned int n_ctxs = qatomic_read(&tcg_cur_ctxs);
+    unsigned int i;
+
+    for (i = 0; i < n_ctxs; i++) {
+        const TCGContext *s = qatomic_read(&tcg_ctxs[i]);
+
+        if (tc_ptr_to_region_idx(s->code_gen_buffer) == (ssize_t)idx) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static gboolean tcg_region_collect_tb(gpointer key, gpointer value,
+                                      gpointer data)
+{
+    g_ptr_array_add(data, value);
+    return false;
+}
+
+/*
+ * Once @s has filled its region and no region is left, free the least
+ * recently used region that no context is allocating from and make @s
+ * allocate from it.  @evict_tb is called on every TB of that region and
+ * must leave nothing that can reach it.
+ * Call from a safe-work context.  Returns false if eviction is disabled.
+ */
+bool tcg_region_evict(TCGContext *s, void (*evict_tb)(TranslationBlock *))
+{
+    g_autoptr(GPtrArray) tbs = NULL;
+    struct tcg_region_tree *rt;
+    size_t size_full = s->code_gen_buffer_size;
+    size_t i, victim = region.n;
+    void *start, *end;
+
+    if (!region.evict) {
+        return false;
+    }
+
+    qemu_mutex_lock(&region.lock);
+    for (i = 0; i < region.n; i++) {
+        if (tcg_region_in_use__locked(i)) {
+            continue;
+        }
+        if (victim == region.n ||
+            region.last_use[i] < region.last_use[victim]) {
+            victim = i;
+        }
+    }
+    qemu_mutex_unlock(&region.lock);
+    if (victim == region.n) {
+        return false;
+    }
+
+    rt = region_trees + victim * tree_size;
+    tbs = g_ptr_array_new();
+    qemu_mutex_lock(&rt->lock);
+    g_tree_foreach(rt->tree, tcg_region_collect_tb, tbs);
+    qemu_mutex_unlock(&rt->lock);
+
+    for (i = 0; i < tbs->len; i++) {
+        evict_tb(g_ptr_array_index(tbs, i));
+    }
+
+    qemu_mutex_lock(&rt->lock);
+    /* Increment the refcount first so that destroy acts as a reset */
+    g_tree_ref(rt->tree);
+    g_tree_destroy(rt->tree);
+    qemu_mutex_unlock(&rt->lock);
+
+    qemu_mutex_lock(&region.lock);
+    tcg_region_bounds(victim, &start, &end);
+    region.agg_size_full -= (end - start) - TCG_HIGHWATER;
+    region.agg_size_full += size_full - TCG_HIGHWATER;
+    tcg_region_assign(s, victim);
+    region.last_use[victim] = ++region.clock;
+    qemu_mutex_unlock(&region.lock);
+    return true;
+}
+
+/*
+ * With eviction, aim for this many regions so that an eviction only
+ * drops a small part of the cache, keeping regions >= 2 MB.
+ */
+#define TCG_EVICT_MAX_REGIONS 64
+
+static size_t tcg_n_regions(size_t tb_size, unsigned max_cpus, bool evict)
 {
 #ifdef CONFIG_USER_ONLY
     return 1;
 #else
     size_t n_regions;
 
+    if (evict) {
+        /* At least one region more than there are TCG contexts */
+        unsigned n_ctxs = qemu_tcg_mttcg_enabled() ? max_cpus : 1;
+
+        n_regions = MIN(tb_size / (2 * MiB), TCG_EVICT_MAX_REGIONS);
+        return MAX(n_regions, n_ctxs + 1);
+    }
+
     /*
      * It is likely that some vCPUs will translate more code than others,
      * so we first try to set more regions than max_cpus, with those regions
@@ -727,7 +860,8 @@ static int alloc_code_gen_buffer(size_t size, int splitwx, Error **errp)
  * in practice. Multi-threaded guests share most if not all of their translated
  * code, which makes parallel code generation less appealing than in softmmu.
  */
-void tcg_region_init(size_t tb_size, int splitwx, unsigned max_cpus)
+void tcg_region_init(size_t tb_size, int splitwx, unsigned max_cpus,
+                     bool evict)
 {
     const size_t page_size = qemu_real_host_page_size();
     size_t region_size;
@@ -765,7 +899,13 @@ void tcg_region_init(size_t tb_size, int splitwx, unsigned max_cpus)
      * As a result of this we might end up with a few extra pages at the end of
      * the buffer; we will assign those to the last region.
      */
-    region.n = tcg_n_regions(tb_size, max_cpus);
+    region.n = tcg_n_regions(tb_size, max_cpus, evict);
+#ifndef CONFIG_USER_ONLY
+    region.evict = evict;
+    if (evict) {
+        region.last_use = g_new0(uint64_t, region.n);
+    }
+#endif
     region_size = tb_size / region.n;
     region_size = QEMU_ALIGN_DOWN(region_size, page_size);
 
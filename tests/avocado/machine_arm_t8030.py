@@ -0,0 +1,81 @@
+# Functional tests for the t8030 machine
+#
+# This work is licensed under the terms of the GNU GPL, version 2 or
+# later.  See the COPYING file in the top-level directory.
+
+import os
+import time
+
+from avocado import skipUnless
+from avocado.utils import process
+from avocado.utils import wait
+from avocado.utils.path import find_command
+from avocado_qemu import BUILD_DIR
+from avocado_qemu import QemuSystemTest
+
+# The kernelcache and trustcache come from an iOS IPSW and cannot be
+# redistributed, so point these variables at a local copy.
+KERNELCACHE = os.getenv('T8030_KERNELCACHE')
+TRUSTCACHE = os.getenv('T8030_TRUSTCACHE')
+
+
+@skipUnless(KERNELCACHE and TRUSTCACHE,
+            'T8030_KERNELCACHE and T8030_TRUSTCACHE not set')
+class T8030DramSnapshot(QemuSystemTest):
+    """
+    Checkpoint a t8030 machine with -machine dram-snapshot and resume it
+
+    :avocado: tags=arch:aarch64
+    :avocado: tags=machine:t8030
+    """
+
+    timeout = 120
+
+    def create_image(self):
+        image_path = os.path.join(self.workdir, 'vmstate.qcow2')
+        qemu_img = os.path.join(BUILD_DIR, 'qemu-img')
+        if not os.path.exists(qemu_img):
+            qemu_img = find_command('qemu-img', False)
+        if qemu_img is False:
+            self.cancel('Could not find "qemu-img", which is required to '
+                        'create the qcow2 image holding the snapshots')
+        process.run('%s create -f qcow2 %s 128M' % (qemu_img, image_path))
+        return image_path
+
+    def launch(self, prefix):
+        vm = self.get_vm()
+        vm.add_args('-M', 't8030,trustcache-filename=%s,dram-snapshot=%s' %
+                    (TRUSTCACHE, prefix),
+                    '-kernel', KERNELCACHE,
+                    '-drive', 'if=none,format=qcow2,file=%s' %
+                    self.create_image())
+        vm.launch()
+        return vm
+
+    def hmp(self, vm, command):
+        return vm.command('human-monitor-command', command_line=command)
+
+    def test_savevm_loadvm(self):
+        prefix = os.path.join(self.workdir, 'dram')
+        vm = self.launch(prefix)
+        time.sleep(2)
+
+        self.assertEqual(self.hmp(vm, 'savevm first'), '')
+        self.assertTrue(os.path.exists(prefix + '.0'))
+        time.sleep(1)
+        self.assertEqual(self.hmp(vm, 'savevm second'), '')
+        self.assertTrue(os.path.exists(prefix + '.1'))
+
+        self.assertEqual(self.hmp(vm, 'loadvm first'), '')
+        self.assertEqual(vm.command('query-status')['status'], 'running')
+        self.assertEqual(self.hmp(vm, 'loadvm second'), '')
+        self.assertEqual(vm.command('query-status')['status'], 'running')
+
+    def test_migration_refused(self):
+        vm = self.launch(os.path.join(self.workdir, 'dram'))
+        vm.qmp('migrate', uri='exec:cat > /dev/null')
+        wait.wait_for(lambda: vm.command('query-migrate')['status'] in
+                      ('completed', 'failed'),
+                      timeout=self.timeout, step=0.1)
+        self.assertEqual(vm.command('query-migrate')['status'], 'failed')
+        self.assertEqual(vm.command('query-status')['status'], 'running')
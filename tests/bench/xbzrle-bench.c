@@ -0,0 +1,139 @@
+/*
+ * XBZRLE encoding speed benchmark
+ *
+ * Encodes pages with typical dirty patterns with every implementation the
+ * host supports, and reports how many GB of guest pages per second each
+ * one gets through.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qemu/units.h"
+#include "../migration/xbzrle.h"
+
+#define XBZRLE_PAGE_SIZE 4096
+#define XBZRLE_PAGES     1024
+#define XBZRLE_TOTAL     (4 * GiB)
+
+typedef struct XBZRLEPattern {
+    const char *name;
+    /* Change @len bytes every @stride bytes, starting at @offset */
+    int offset;
+    int stride;
+    int len;
+} XBZRLEPattern;
+
+static const XBZRLEPattern patterns[] = {
+    { "unchanged", 0, XBZRLE_PAGE_SIZE, 0 },
+    { "one-word", 2048, XBZRLE_PAGE_SIZE, 8 },
+    { "counters", 24, 256, 4 },
+    { "struct-fields", 8, 64, 16 },
+    { "half", 0, 128, 64 },
+    { "overflow", 0, 2, 1 },
+};
+
+static uint8_t *old_pages, *new_pages, *zero_pages, *encoded, *copy;
+
+static void fill_pages(const XBZRLEPattern *p)
+{
+    int i, j;
+
+    memcpy(new_pages, old_pages, XBZRLE_PAGE_SIZE * XBZRLE_PAGES);
+    for (i = 0; i < XBZRLE_PAGES; i++) {
+        uint8_t *page = new_pages + i * XBZRLE_PAGE_SIZE;
+
+        for (j = p->offset; j + p->len <= XBZRLE_PAGE_SIZE; j += p->stride) {
+            int k;
+
+            for (k = 0; k < p->len; k++) {
+                page[j + k] = ~page[j + k];
+            }
+        }
+    }
+}
+
+static void bench_encode(const XBZRLEPattern *p)
+{
+    size_t done = 0;
+    int i, len = 0;
+
+    fill_pages(p);
+
+    g_test_timer_start();
+    while (done < XBZRLE_TOTAL) {
+        for (i = 0; i < XBZRLE_PAGES; i++) {
+            len = xbzrle_encode_buffer(old_pages + i * XBZRLE_PAGE_SIZE,
+                                       new_pages + i * XBZRLE_PAGE_SIZE,
+                                       XBZRLE_PAGE_SIZE, encoded,
+                                       XBZRLE_PAGE_SIZE);
+        }
+        done += XBZRLE_PAGE_SIZE * XBZRLE_PAGES;
+    }
+    g_test_timer_elapsed();
+
+    g_test_message("xbzrle(%s): encode %-14s %5d bytes %6.2f GB/sec",
+                   test_xbzrle_accel_name(), p->name, len,
+                   done / g_test_timer_last() / GiB);
+}
+
+static void bench_copy(const char *name, const uint8_t *pages)
+{
+    size_t done = 0;
+    int i;
+
+    g_test_timer_start();
+    while (done < XBZRLE_TOTAL) {
+        for (i = 0; i < XBZRLE_PAGES; i++) {
+            xbzrle_copy_page(copy, pages + i * XBZRLE_PAGE_SIZE,
+                             XBZRLE_PAGE_SIZE);
+        }
+        done += XBZRLE_PAGE_SIZE * XBZRLE_PAGES;
+    }
+    g_test_timer_elapsed();
+
+    g_test_message("xbzrle(%s): copy %-16s %6.2f GB/sec",
+                   test_xbzrle_accel_name(), name,
+                   done / g_test_timer_last() / GiB);
+}
+
+static void test_xbzrle_speed(void)
+{
+    size_t i;
+
+    do {
+        for (i = 0; i < ARRAY_SIZE(patterns); i++) {
+            bench_encode(&patterns[i]);
+        }
+        bench_copy("zero", zero_pages);
+        bench_copy("data", old_pages);
+    } while (test_xbzrle_next_accel());
+}
+
+int main(int argc, char **argv)
+{
+    size_t i, size = XBZRLE_PAGE_SIZE * XBZRLE_PAGES;
+    int ret;
+
+    g_test_init(&argc, &argv, NULL);
+
+    old_pages = qemu_memalign(XBZRLE_PAGE_SIZE, size);
+    new_pages = qemu_memalign(XBZRLE_PAGE_SIZE, size);
+    zero_pages = qemu_memalign(XBZRLE_PAGE_SIZE, size);
+    encoded = g_malloc(XBZRLE_PAGE_SIZE);
+    copy = qemu_memalign(XBZRLE_PAGE_SIZE, XBZRLE_PAGE_SIZE);
+    for (i = 0; i < size; i++) {
+        old_pages[i] = g_test_rand_int();
+    }
+    memset(zero_pages, 0, size);
+
+    g_test_add_func("/migration/benchmark/xbzrle", test_xbzrle_speed);
+    ret = g_test_run();
+
+    qemu_vfree(old_pages);
+    qemu_vfree(new_pages);
+    qemu_vfree(zero_pages);
+    qemu_vfree(copy);
+    g_free(encoded);
+    return ret;
+}
@@ -0,0 +1,45 @@
+/*
+ * Translation cache eviction
+ *
+ * Runs more chained code than fits in a small translation cache, so that
+ * with -accel tcg,tb-evict=on whole regions of valid, chained TBs get
+ * evicted and retranslated on the next round.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include <stdint.h>
+#include <minilib.h>
+
+#define BLOCKS  65536
+#define ROUNDS  4
+
+/* BLOCKS TBs of one add each, every one chained to the next */
+static uint64_t run_blocks(uint64_t x)
+{
+    asm volatile(".rept 65536\n\t"
+                 "add %0, %0, #1\n\t"
+                 "b 1f\n"
+                 "1:\n\t"
+                 ".endr"
+                 : "+r"(x));
+    return x;
+}
+
+int main(void)
+{
+    uint64_t x = 0;
+    int r;
+
+    for (r = 0; r < ROUNDS; r++) {
+        x = run_blocks(x);
+    }
+
+    if (x != (uint64_t)BLOCKS * ROUNDS) {
+        ml_printf("FAIL: ran %llu blocks, expected %llu\n", x,
+                  (uint64_t)BLOCKS * ROUNDS);
+        return 1;
+    }
+    ml_printf("PASS\n");
+    return 0;
+}
@@ -29,6 +29,7 @@
 #include "migration/qemu-file-types.h"
 #include "../migration/qemu-file.h"
 #include "../migration/savevm.h"
+#include "qapi/qmp/json-writer.h"
 #include "qemu/coroutine.h"
 #include "qemu/module.h"
 #include "io/channel-file.h"
@@ -333,6 +334,202 @@ static void test_simple_array(void)
                          sizeof(wire_simple_arr)));
 }
 
+/* Sparse arrays: only the runs of non-zero elements go on the wire */
+
+typedef struct TestSparse8 {
+    uint8_t a[16];
+} TestSparse8;
+
+typedef struct TestSparse32 {
+    uint32_t a[8];
+} TestSparse32;
+
+static const VMStateDescription vmstate_sparse8 = {
+    .name = "sparse/uint8",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .fields = (VMStateField[]) {
+        VMSTATE_UINT8_SPARSE_ARRAY_V(a, TestSparse8, 16, 0),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static const VMStateDescription vmstate_sparse32 = {
+    .name = "sparse/uint32",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .fields = (VMStateField[]) {
+        VMSTATE_UINT32_SPARSE_ARRAY_V(a, TestSparse32, 8, 0),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static void test_sparse8(const TestSparse8 *obj, const uint8_t *wire,
+                         size_t size)
+{
+    TestSparse8 loaded;
+
+    save_vmstate(&vmstate_sparse8, (void *)obj);
+    compare_vmstate(wire, size);
+
+    memset(&loaded, 0xaa, sizeof(loaded));
+    SUCCESS(load_vmstate_one(&vmstate_sparse8, &loaded, 1, wire, size));
+    SUCCESS(memcmp(&loaded, obj, sizeof(loaded)));
+}
+
+static void test_sparse_zero(void)
+{
+    TestSparse8 obj = {};
+    uint8_t wire[] = {
+        /* runs */ 0x00, 0x00, 0x00, 0x00,
+        QEMU_VM_EOF,
+    };
+
+    test_sparse8(&obj, wire, sizeof(wire));
+}
+
+static void test_sparse_full(void)
+{
+    TestSparse8 obj;
+    uint8_t wire[] = {
+        /* runs */ 0x00, 0x00, 0x00, 0x01,
+        /* start */ 0x00, 0x00, 0x00, 0x00,
+        /* len */ 0x00, 0x00, 0x00, 0x10,
+        0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08,
+        0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f, 0x10,
+        QEMU_VM_EOF,
+    };
+    int i;
+
+    for (i = 0; i < 16; i++) {
+        obj.a[i] = i + 1;
+    }
+    test_sparse8(&obj, wire, sizeof(wire));
+}
+
+/* A gap as large as a run header is cheaper to send than to split at */
+static void test_sparse_gap_folded(void)
+{
+    TestSparse8 obj = { .a = { [0] = 0x11, [9] = 0x22 } };
+    uint8_t wire[] = {
+        /* runs */ 0x00, 0x00, 0x00, 0x01,
+        /* start */ 0x00, 0x00, 0x00, 0x00,
+        /* len */ 0x00, 0x00, 0x00, 0x0a,
+        0x11, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x22,
+        QEMU_VM_EOF,
+    };
+
+    test_sparse8(&obj, wire, sizeof(wire));
+}
+
+static void test_sparse_gap_split(void)
+{
+    TestSparse8 obj = { .a = { [0] = 0x11, [10] = 0x22 } };
+    uint8_t wire[] = {
+        /* runs */ 0x00, 0x00, 0x00, 0x02,
+        /* start */ 0x00, 0x00, 0x00, 0x00,
+        /* len */ 0x00, 0x00, 0x00, 0x01,
+        0x11,
+        /* start */ 0x00, 0x00, 0x00, 0x0a,
+        /* len */ 0x00, 0x00, 0x00, 0x01,
+        0x22,
+        QEMU_VM_EOF,
+    };
+
+    test_sparse8(&obj, wire, sizeof(wire));
+}
+
+static void test_sparse_uint32(void)
+{
+    TestSparse32 obj = { .a = { [0] = 0x11223344, [3] = 0x55667788,
+                                [7] = 0x99aabbcc } };
+    TestSparse32 loaded;
+    uint8_t wire[] = {
+        /* runs */ 0x00, 0x00, 0x00, 0x02,
+        /* start */ 0x00, 0x00, 0x00, 0x00,
+        /* len */ 0x00, 0x00, 0x00, 0x04,
+        0x11, 0x22, 0x33, 0x44,
+        0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00,
+        0x55, 0x66, 0x77, 0x88,
+        /* start */ 0x00, 0x00, 0x00, 0x07,
+        /* len */ 0x00, 0x00, 0x00, 0x01,
+        0x99, 0xaa, 0xbb, 0xcc,
+        QEMU_VM_EOF,
+    };
+
+    save_vmstate(&vmstate_sparse32, &obj);
+    compare_vmstate(wire, sizeof(wire));
+
+    memset(&loaded, 0xaa, sizeof(loaded));
+    SUCCESS(load_vmstate_one(&vmstate_sparse32, &loaded, 1, wire,
+                             sizeof(wire)));
+    SUCCESS(memcmp(&loaded, &obj, sizeof(loaded)));
+}
+
+static void test_sparse_invalid(void)
+{
+    TestSparse8 obj;
+    uint8_t overlap[] = {
+        /* runs */ 0x00, 0x00, 0x00, 0x02,
+        /* start */ 0x00, 0x00, 0x00, 0x00,
+        /* len */ 0x00, 0x00, 0x00, 0x04,
+        0x01, 0x02, 0x03, 0x04,
+        /* start */ 0x00, 0x00, 0x00, 0x02,
+        /* len */ 0x00, 0x00, 0x00, 0x01,
+        0x05,
+        QEMU_VM_EOF,
+    };
+    uint8_t past_end[] = {
+        /* runs */ 0x00, 0x00, 0x00, 0x01,
+        /* start */ 0x00, 0x00, 0x00, 0x0e,
+        /* len */ 0x00, 0x00, 0x00, 0x04,
+        0x01, 0x02, 0x03, 0x04,
+        QEMU_VM_EOF,
+    };
+    uint8_t start_past_end[] = {
+        /* runs */ 0x00, 0x00, 0x00, 0x01,
+        /* start */ 0x00, 0x00, 0x00, 0x10,
+        /* len */ 0x00, 0x00, 0x00, 0x01,
+        0x01,
+        QEMU_VM_EOF,
+    };
+    uint8_t empty[] = {
+        /* runs */ 0x00, 0x00, 0x00, 0x01,
+        /* start */ 0x00, 0x00, 0x00, 0x03,
+        /* len */ 0x00, 0x00, 0x00, 0x00,
+        QEMU_VM_EOF,
+    };
+
+    FAILURE(load_vmstate_one(&vmstate_sparse8, &obj, 1, overlap,
+                             sizeof(overlap)));
+    FAILURE(load_vmstate_one(&vmstate_sparse8, &obj, 1, past_end,
+                             sizeof(past_end)));
+    FAILURE(load_vmstate_one(&vmstate_sparse8, &obj, 1, start_past_end,
+                             sizeof(start_past_end)));
+    FAILURE(load_vmstate_one(&vmstate_sparse8, &obj, 1, empty,
+                             sizeof(empty)));
+}
+
+static void test_sparse_vmdesc(void)
+{
+    TestSparse32 obj = { .a = { [0] = 1, [7] = 2 } };
+    g_autoptr(JSONWriter) vmdesc = json_writer_new(false);
+    QEMUFile *f = open_test_file(true);
+    const char *desc;
+
+    json_writer_start_object(vmdesc, NULL);
+    SUCCESS(vmstate_save_state(f, &vmstate_sparse32, &obj, vmdesc));
+    json_writer_end_object(vmdesc);
+    qemu_fclose(f);
+
+    /* Two runs of one element each: count, 2 headers and 2 elements */
+    desc = json_writer_get(vmdesc);
+    g_assert(strstr(desc, "\"encoding\": \"sparse runs\""));
+    g_assert(strstr(desc, "\"runs\": 2"));
+    g_assert(strstr(desc, "\"size\": 28"));
+}
+
 typedef struct TestStruct {
     uint32_t a, b, c, e;
     uint64_t d, f;
@@ -1496,6 +1693,13 @@ int main(int argc, char **argv)
     g_test_init(&argc, &argv, NULL);
     g_test_add_func("/vmstate/simple/primitive", test_simple_primitive);
     g_test_add_func("/vmstate/simple/array", test_simple_array);
+    g_test_add_func("/vmstate/sparse/zero", test_sparse_zero);
+    g_test_add_func("/vmstate/sparse/full", test_sparse_full);
+    g_test_add_func("/vmstate/sparse/gap/folded", test_sparse_gap_folded);
+    g_test_add_func("/vmstate/sparse/gap/split", test_sparse_gap_split);
+    g_test_add_func("/vmstate/sparse/uint32", test_sparse_uint32);
+    g_test_add_func("/vmstate/sparse/invalid", test_sparse_invalid);
+    g_test_add_func("/vmstate/sparse/vmdesc", test_sparse_vmdesc);
     g_test_add_func("/vmstate/versioned/load/v1", test_load_v1);
     g_test_add_func("/vmstate/versioned/load/v2", test_load_v2);
     g_test_add_func("/vmstate/field_exists/load/noskip", test_load_noskip);
@@ -173,6 +173,98 @@ static void test_encode_decode(void)
     }
 }
 
+/* Byte at a time encoder with the runs xbzrle_encode_buffer must produce */
+static int encode_reference(uint8_t *old_buf, uint8_t *new_buf, int slen,
+                            uint8_t *dst, int dlen)
+{
+    int d = 0, i = 0, start;
+
+    while (i < slen) {
+        if (d + 2 > dlen) {
+            return -1;
+        }
+        start = i;
+        while (i < slen && old_buf[i] == new_buf[i]) {
+            i++;
+        }
+        if (i - start == slen) {
+            return 0;
+        }
+        if (i == slen) {
+            return d;
+        }
+        d += uleb128_encode_small(dst + d, i - start);
+        if (d + 2 > dlen) {
+            return -1;
+        }
+        start = i;
+        while (i < slen && old_buf[i] != new_buf[i]) {
+            i++;
+        }
+        d += uleb128_encode_small(dst + d, i - start);
+        if (d + i - start > dlen) {
+            return -1;
+        }
+        memcpy(dst + d, new_buf + start, i - start);
+        d += i - start;
+    }
+    return d;
+}
+
+static void test_encode_accel(void)
+{
+    uint8_t *old_buf = g_malloc(XBZRLE_PAGE_SIZE);
+    uint8_t *new_buf = g_malloc(XBZRLE_PAGE_SIZE);
+    uint8_t *ref = g_malloc(XBZRLE_PAGE_SIZE);
+    uint8_t *compressed = g_malloc(XBZRLE_PAGE_SIZE);
+    uint8_t *copy = g_malloc(XBZRLE_PAGE_SIZE);
+    int i, j, n, dlen, ref_len, len;
+
+    do {
+        for (i = 0; i < 2000; i++) {
+            for (j = 0; j < XBZRLE_PAGE_SIZE; j++) {
+                old_buf[j] = g_test_rand_int();
+            }
+            memcpy(new_buf, old_buf, XBZRLE_PAGE_SIZE);
+            /* From unchanged to a few bytes, short runs and all changed */
+            n = i % 8 == 7 ? XBZRLE_PAGE_SIZE : (1 << (i % 8 * 2)) - 1;
+            for (j = 0; j < n; j++) {
+                int pos = g_test_rand_int_range(0, XBZRLE_PAGE_SIZE);
+                int run = g_test_rand_int_range(1, 64);
+                int end = MIN(pos + run, XBZRLE_PAGE_SIZE);
+
+                for (; pos < end; pos++) {
+                    new_buf[pos] = ~old_buf[pos];
+                }
+            }
+            dlen = i % 3 ? XBZRLE_PAGE_SIZE :
+                   g_test_rand_int_range(0, XBZRLE_PAGE_SIZE);
+
+            ref_len = encode_reference(old_buf, new_buf, XBZRLE_PAGE_SIZE,
+                                       ref, dlen);
+            len = xbzrle_encode_buffer(old_buf, new_buf, XBZRLE_PAGE_SIZE,
+                                       compressed, dlen);
+            g_assert_cmpint(len, ==, ref_len);
+            g_assert(len <= 0 || memcmp(compressed, ref, len) == 0);
+
+            memset(copy, 0xa5, XBZRLE_PAGE_SIZE);
+            g_assert(!xbzrle_copy_page(copy, new_buf, XBZRLE_PAGE_SIZE));
+            g_assert(memcmp(copy, new_buf, XBZRLE_PAGE_SIZE) == 0);
+        }
+
+        memset(new_buf, 0, XBZRLE_PAGE_SIZE);
+        g_assert(xbzrle_copy_page(copy, new_buf, XBZRLE_PAGE_SIZE));
+        new_buf[g_test_rand_int_range(0, XBZRLE_PAGE_SIZE)] = 1;
+        g_assert(!xbzrle_copy_page(copy, new_buf, XBZRLE_PAGE_SIZE));
+    } while (test_xbzrle_next_accel());
+
+    g_free(old_buf);
+    g_free(new_buf);
+    g_free(ref);
+    g_free(compressed);
+    g_free(copy);
+}
+
 int main(int argc, char **argv)
 {
     g_test_init(&argc, &argv, NULL);
@@ -185,6 +277,8 @@ int main(int argc, char **argv)
     g_test_add_func("/xbzrle/encode_decode_overflow",
                     test_encode_decode_overflow);
     g_test_add_func("/xbzrle/encode_decode", test_encode_decode);
+    /* Last, as it leaves the slowest implementation selected */
+    g_test_add_func("/xbzrle/encode_accel", test_encode_accel);
 
     return g_test_run();
 }
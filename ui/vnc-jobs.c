@@ -31,6 +31,7 @@
 #include "vnc-jobs.h"
 #include "qemu/sockets.h"
 #include "qemu/main-loop.h"
+#include "qemu/timer.h"
 #include "block/aio.h"
 #include "trace.h"
 
@@ -38,34 +39,62 @@
  * Locking:
  *
  * There are three levels of locking:
- * - jobs queue lock: for each operation on the queue (push, pop, isEmpty?)
+ * - jobs queue lock: for each operation on the queue (push, pop, isEmpty?),
+ *                    on a client's job list and on job slices
  * - VncDisplay global lock: mainly used for framebuffer updates to avoid
  *                      screen corruption if the framebuffer is updated
  *                      while the worker is doing something.
  * - VncState::output lock: used to make sure the output buffer is not corrupted
  *                          if two threads try to write on it at the same time
  *
- * While the VNC worker thread is working, the VncDisplay global lock is held
+ * While a VNC worker thread is working, the VncDisplay global lock is held
  * to avoid screen corruption (this does not block vnc_refresh() because it
  * uses trylock()) but the output lock is not held because the thread works on
  * its own output buffer.
  * When the encoding job is done, the worker thread will hold the output lock
  * and copy its output buffer in vs->output.
+ *
+ * Each client has its own list of jobs, and the workers share a list of
+ * clients that have jobs waiting.  A client is taken off that list while
+ * a worker encodes one of its jobs, so that its updates are sent in order
+ * while the jobs of other clients are encoded in parallel.
+ *
+ * A large job with an encoding that keeps no state from one rectangle to
+ * the next is cut into slices.  The worker that owns the job keeps the
+ * display lock, encodes the first slice itself, queues the others for the
+ * idle workers, and appends their output to its own in order.
  */
 
+/* Split jobs that cover at least this many pixels between the workers */
+#define VNC_JOB_SLICE_MIN_PIXELS (256 * 256)
+/* Height of the bands large rectangles are cut into for slicing */
+#define VNC_JOB_SLICE_ROWS 64
+#define VNC_JOB_MAX_SLICES 16
+
+typedef struct VncSlice {
+    VncState vs; /* Local copy of the client with its own output buffer */
+    VncRect *rects;
+    int nrects;
+    int n_rectangles;
+    bool taken; /* Off the queue, being encoded */
+    bool done;
+    QSIMPLEQ_ENTRY(VncSlice) next;
+} VncSlice;
+
 struct VncJobQueue {
     QemuCond cond;
     QemuMutex mutex;
-    QemuThread thread;
+    unsigned int nthreads;
     bool exit;
-    QTAILQ_HEAD(, VncJob) jobs;
+    /* Clients with jobs waiting and no worker encoding for them */
+    QTAILQ_HEAD(, VncState) ready;
+    QSIMPLEQ_HEAD(, VncSlice) slices;
 };
 
 typedef struct VncJobQueue VncJobQueue;
 
 /*
- * We use a single global queue, but most of the functions are
- * already reentrant, so we can easily add more than one encoding thread
+ * We use a single global queue shared by all the encoding threads
  */
 static VncJobQueue *queue;
 
@@ -110,11 +139,17 @@ int vnc_job_add_rect(VncJob *job, int x, int y, int w, int h)
 
 void vnc_job_push(VncJob *job)
 {
+    VncState *vs = job->vs;
+
     vnc_lock_queue(queue);
     if (queue->exit || QLIST_EMPTY(&job->rectangles)) {
         g_free(job);
     } else {
-        QTAILQ_INSERT_TAIL(&queue->jobs, job, next);
+        QTAILQ_INSERT_TAIL(&vs->jobs, job, next);
+        if (!vs->job_running && !vs->job_ready) {
+            QTAILQ_INSERT_TAIL(&queue->ready, vs, job_next);
+            vs->job_ready = true;
+        }
         qemu_cond_broadcast(&queue->cond);
     }
     vnc_unlock_queue(queue);
@@ -122,14 +157,7 @@ void vnc_job_push(VncJob *job)
 
 static bool vnc_has_job_locked(VncState *vs)
 {
-    VncJob *job;
-
-    QTAILQ_FOREACH(job, &queue->jobs, next) {
-        if (job->vs == vs || !vs) {
-            return true;
-        }
-    }
-    return false;
+    return vs->job_running || !QTAILQ_EMPTY(&vs->jobs);
 }
 
 void vnc_jobs_join(VncState *vs)
@@ -142,6 +170,13 @@ void vnc_jobs_join(VncState *vs)
     vnc_jobs_consume_buffer(vs);
 }
 
+void vnc_jobs_get_stats(VncState *vs, VncEncodeStats *stats)
+{
+    vnc_lock_output(vs);
+    *stats = vs->encode_stats;
+    vnc_unlock_output(vs);
+}
+
 void vnc_jobs_consume_buffer(VncState *vs)
 {
     bool flush;
@@ -235,102 +270,292 @@ static bool vnc_worker_clamp_rect(VncState *vs, VncJob *job, VncRect *rect)
     return false;
 }
 
-static int vnc_worker_thread_loop(VncJobQueue *queue)
+/* Encode @rects into @vs, stopping early if @orig gets disconnected */
+static int vnc_worker_encode_rects(VncState *orig, VncState *vs,
+                                   const VncRect *rects, int nrects)
 {
-    VncJob *job;
-    VncRectEntry *entry, *tmp;
-    VncState vs = {};
-    int n_rectangles;
-    int saved_offset;
+    int i, n, n_rectangles = 0;
+
+    for (i = 0; i < nrects; i++) {
+        if (orig && orig->ioc == NULL) {
+            break;
+        }
+        n = vnc_send_framebuffer_update(vs, rects[i].x, rects[i].y,
+                                        rects[i].w, rects[i].h);
+        if (n >= 0) {
+            n_rectangles += n;
+        }
+    }
+    return n_rectangles;
+}
 
+static void vnc_slice_encode(VncJobQueue *queue, VncSlice *slice)
+{
+    slice->n_rectangles = vnc_worker_encode_rects(NULL, &slice->vs,
+                                                  slice->rects, slice->nrects);
+
+    vnc_lock_queue(queue);
+    slice->done = true;
+    vnc_unlock_queue(queue);
+    qemu_cond_broadcast(&queue->cond);
+}
+
+/* Wait for @slice, encoding it here if no worker has started it yet */
+static void vnc_slice_wait(VncJobQueue *queue, VncSlice *slice)
+{
     vnc_lock_queue(queue);
-    while (QTAILQ_EMPTY(&queue->jobs) && !queue->exit) {
+    if (!slice->taken) {
+        QSIMPLEQ_REMOVE(&queue->slices, slice, VncSlice, next);
+        slice->taken = true;
+        vnc_unlock_queue(queue);
+        vnc_slice_encode(queue, slice);
+        return;
+    }
+    while (!slice->done) {
         qemu_cond_wait(&queue->cond, &queue->mutex);
     }
-    /* Here job can only be NULL if queue->exit is true */
-    job = QTAILQ_FIRST(&queue->jobs);
     vnc_unlock_queue(queue);
-    assert(job->vs->magic == VNC_MAGIC);
+}
 
-    if (queue->exit) {
-        return -1;
+/*
+ * Return how many slices to cut a job covering @pixels into.  Encodings
+ * whose compression state carries over from one rectangle to the next
+ * (zlib, tight, zrle) must encode a client's rectangles in sequence.
+ */
+static int vnc_job_nslices(VncJobQueue *queue, VncState *vs, uint64_t pixels)
+{
+    unsigned int nthreads;
+
+    if (vs->vnc_encoding != VNC_ENCODING_RAW &&
+        vs->vnc_encoding != VNC_ENCODING_HEXTILE) {
+        return 1;
+    }
+    if (pixels < VNC_JOB_SLICE_MIN_PIXELS) {
+        return 1;
+    }
+
+    vnc_lock_queue(queue);
+    nthreads = queue->nthreads;
+    vnc_unlock_queue(queue);
+    return MIN(nthreads, VNC_JOB_MAX_SLICES);
+}
+
+/* Cut the rectangles in @rects into bands of at most VNC_JOB_SLICE_ROWS */
+static GArray *vnc_job_bands(GArray *rects)
+{
+    GArray *bands = g_array_new(FALSE, FALSE, sizeof(VncRect));
+    guint i;
+
+    for (i = 0; i < rects->len; i++) {
+        VncRect rect = g_array_index(rects, VncRect, i);
+        int y = rect.y, end = rect.y + rect.h;
+
+        for (; y < end; y += VNC_JOB_SLICE_ROWS) {
+            VncRect band = {
+                .x = rect.x,
+                .y = y,
+                .w = rect.w,
+                .h = MIN(VNC_JOB_SLICE_ROWS, end - y),
+            };
+
+            g_array_append_val(bands, band);
+        }
     }
+    g_array_free(rects, TRUE);
+    return bands;
+}
 
-    vnc_lock_output(job->vs);
-    if (job->vs->ioc == NULL || job->vs->abort == true) {
-        vnc_unlock_output(job->vs);
-        goto disconnected;
+static void vnc_worker_encode_job(VncJobQueue *queue, VncJob *job)
+{
+    VncState *orig = job->vs;
+    VncSlice *slices[VNC_JOB_MAX_SLICES] = {};
+    VncRectEntry *entry, *tmp;
+    VncState vs = {};
+    GArray *rects;
+    uint64_t pixels = 0, target;
+    int64_t start = get_clock(), ns;
+    int n_rectangles;
+    int saved_offset;
+    int nslices, nrects = 0, i;
+    guint first, last;
+
+    vnc_lock_output(orig);
+    if (orig->ioc == NULL || orig->abort == true) {
+        vnc_unlock_output(orig);
+        QLIST_FOREACH_SAFE(entry, &job->rectangles, next, tmp) {
+            g_free(entry);
+        }
+        return;
     }
-    if (buffer_empty(&job->vs->output)) {
+    if (buffer_empty(&orig->output)) {
         /*
          * Looks like a NOP as it obviously moves no data.  But it
          * moves the empty buffer, so we don't have to malloc a new
          * one for vs.output
          */
-        buffer_move_empty(&vs.output, &job->vs->output);
+        buffer_move_empty(&vs.output, &orig->output);
     }
-    vnc_unlock_output(job->vs);
+    vnc_unlock_output(orig);
 
     /* Make a local copy of vs and switch output buffers */
-    vnc_async_encoding_start(job->vs, &vs);
+    vnc_async_encoding_start(orig, &vs);
     vs.magic = VNC_MAGIC;
 
     /* Start sending rectangles */
-    n_rectangles = 0;
     vnc_write_u8(&vs, VNC_MSG_SERVER_FRAMEBUFFER_UPDATE);
     vnc_write_u8(&vs, 0);
     saved_offset = vs.output.offset;
     vnc_write_u16(&vs, 0);
 
-    vnc_lock_display(job->vs->vd);
+    vnc_lock_display(orig->vd);
+    rects = g_array_new(FALSE, FALSE, sizeof(VncRect));
     QLIST_FOREACH_SAFE(entry, &job->rectangles, next, tmp) {
-        int n;
-
-        if (job->vs->ioc == NULL) {
-            vnc_unlock_display(job->vs->vd);
-            /* Copy persistent encoding data */
-            vnc_async_encoding_end(job->vs, &vs);
-            goto disconnected;
+        if (vnc_worker_clamp_rect(&vs, job, &entry->rect)) {
+            g_array_append_val(rects, entry->rect);
+            pixels += (uint64_t)entry->rect.w * entry->rect.h;
         }
+        g_free(entry);
+    }
 
-        if (vnc_worker_clamp_rect(&vs, job, &entry->rect)) {
-            n = vnc_send_framebuffer_update(&vs, entry->rect.x, entry->rect.y,
-                                            entry->rect.w, entry->rect.h);
+    nslices = vnc_job_nslices(queue, &vs, pixels);
+    if (nslices > 1) {
+        rects = vnc_job_bands(rects);
+        nslices = MIN(nslices, rects->len);
+    }
 
-            if (n >= 0) {
-                n_rectangles += n;
+    /* Give every slice about the same number of pixels, in order */
+    target = pixels / nslices;
+    pixels = 0;
+    first = last = 0;
+    for (i = 0; i < nslices; i++) {
+        first = last;
+        if (i == nslices - 1) {
+            last = rects->len;
+        } else {
+            while (last < rects->len && pixels < target * (i + 1)) {
+                VncRect *rect = &g_array_index(rects, VncRect, last++);
+
+                pixels += (uint64_t)rect->w * rect->h;
             }
         }
-        g_free(entry);
+        if (i == 0) {
+            nrects = last;
+            continue;
+        }
+
+        slices[i] = g_new0(VncSlice, 1);
+        vnc_async_encoding_start(orig, &slices[i]->vs);
+        slices[i]->vs.magic = VNC_MAGIC;
+        slices[i]->rects = &g_array_index(rects, VncRect, first);
+        slices[i]->nrects = last - first;
+    }
+
+    if (nslices > 1) {
+        vnc_lock_queue(queue);
+        for (i = 1; i < nslices; i++) {
+            QSIMPLEQ_INSERT_TAIL(&queue->slices, slices[i], next);
+        }
+        vnc_unlock_queue(queue);
+        qemu_cond_broadcast(&queue->cond);
+    }
+
+    n_rectangles = vnc_worker_encode_rects(orig, &vs, &g_array_index(rects,
+                                           VncRect, 0), nrects);
+
+    for (i = 1; i < nslices; i++) {
+        VncSlice *slice = slices[i];
+
+        vnc_slice_wait(queue, slice);
+        n_rectangles += slice->n_rectangles;
+        buffer_reserve(&vs.output, slice->vs.output.offset);
+        buffer_append(&vs.output, slice->vs.output.buffer,
+                      slice->vs.output.offset);
+        buffer_free(&slice->vs.output);
+        slice->vs.magic = 0;
+        g_free(slice);
     }
     trace_vnc_job_nrects(&vs, job, n_rectangles);
-    vnc_unlock_display(job->vs->vd);
+    vnc_unlock_display(orig->vd);
+    g_array_free(rects, TRUE);
 
     /* Put n_rectangles at the beginning of the message */
     vs.output.buffer[saved_offset] = (n_rectangles >> 8) & 0xFF;
     vs.output.buffer[saved_offset + 1] = n_rectangles & 0xFF;
 
-    vnc_lock_output(job->vs);
-    if (job->vs->ioc != NULL) {
-        buffer_move(&job->vs->jobs_buffer, &vs.output);
+    ns = get_clock() - start;
+    trace_vnc_job_encoded(orig, job, n_rectangles, nslices,
+                          vs.output.offset, ns);
+
+    vnc_lock_output(orig);
+    if (orig->ioc != NULL) {
+        orig->encode_stats.updates++;
+        orig->encode_stats.rects += n_rectangles;
+        orig->encode_stats.bytes += vs.output.offset;
+        orig->encode_stats.encode_time_ns += ns;
+        orig->encode_stats.max_encode_time_ns =
+            MAX(orig->encode_stats.max_encode_time_ns, ns);
+
+        buffer_move(&orig->jobs_buffer, &vs.output);
         /* Copy persistent encoding data */
-        vnc_async_encoding_end(job->vs, &vs);
+        vnc_async_encoding_end(orig, &vs);
 
-        qemu_bh_schedule(job->vs->bh);
+        qemu_bh_schedule(orig->bh);
     }  else {
         buffer_reset(&vs.output);
         /* Copy persistent encoding data */
-        vnc_async_encoding_end(job->vs, &vs);
+        vnc_async_encoding_end(orig, &vs);
+    }
+    vnc_unlock_output(orig);
+    vs.magic = 0;
+}
+
+static int vnc_worker_thread_loop(VncJobQueue *queue)
+{
+    VncSlice *slice;
+    VncState *vs;
+    VncJob *job;
+
+    vnc_lock_queue(queue);
+    while (QTAILQ_EMPTY(&queue->ready) && QSIMPLEQ_EMPTY(&queue->slices) &&
+           !queue->exit) {
+        qemu_cond_wait(&queue->cond, &queue->mutex);
+    }
+
+    if (queue->exit) {
+        vnc_unlock_queue(queue);
+        return -1;
     }
-    vnc_unlock_output(job->vs);
 
-disconnected:
+    /* Help with the jobs that are already running first */
+    slice = QSIMPLEQ_FIRST(&queue->slices);
+    if (slice) {
+        QSIMPLEQ_REMOVE_HEAD(&queue->slices, next);
+        slice->taken = true;
+        vnc_unlock_queue(queue);
+        vnc_slice_encode(queue, slice);
+        return 0;
+    }
+
+    vs = QTAILQ_FIRST(&queue->ready);
+    QTAILQ_REMOVE(&queue->ready, vs, job_next);
+    vs->job_ready = false;
+    vs->job_running = true;
+    job = QTAILQ_FIRST(&vs->jobs);
+    QTAILQ_REMOVE(&vs->jobs, job, next);
+    vnc_unlock_queue(queue);
+    assert(job->vs->magic == VNC_MAGIC);
+
+    vnc_worker_encode_job(queue, job);
+
     vnc_lock_queue(queue);
-    QTAILQ_REMOVE(&queue->jobs, job, next);
+    vs->job_running = false;
+    if (!QTAILQ_EMPTY(&vs->jobs)) {
+        QTAILQ_INSERT_TAIL(&queue->ready, vs, job_next);
+        vs->job_ready = true;
+    }
     vnc_unlock_queue(queue);
     qemu_cond_broadcast(&queue->cond);
     g_free(job);
-    vs.magic = 0;
     return 0;
 }
 
@@ -340,7 +565,8 @@ static VncJobQueue *vnc_queue_init(void)
 
     qemu_cond_init(&queue->cond);
     qemu_mutex_init(&queue->mutex);
-    QTAILQ_INIT(&queue->jobs);
+    QTAILQ_INIT(&queue->ready);
+    QSIMPLEQ_INIT(&queue->slices);
     return queue;
 }
 
@@ -355,28 +581,32 @@ static void vnc_queue_clear(VncJobQueue *q)
 static void *vnc_worker_thread(void *arg)
 {
     VncJobQueue *queue = arg;
-
-    qemu_thread_get_self(&queue->thread);
+    bool last;
 
     while (!vnc_worker_thread_loop(queue)) ;
-    vnc_queue_clear(queue);
-    return NULL;
-}
 
-static bool vnc_worker_thread_running(void)
-{
-    return queue; /* Check global queue */
+    vnc_lock_queue(queue);
+    last = --queue->nthreads == 0;
+    vnc_unlock_queue(queue);
+    if (last) {
+        vnc_queue_clear(queue);
+    }
+    return NULL;
 }
 
-void vnc_start_worker_thread(void)
+void vnc_start_worker_threads(unsigned int nthreads)
 {
-    VncJobQueue *q;
+    QemuThread thread;
 
-    if (vnc_worker_thread_running())
-        return ;
+    if (!queue) {
+        queue = vnc_queue_init(); /* Set global queue */
+    }
 
-    q = vnc_queue_init();
-    qemu_thread_create(&q->thread, "vnc_worker", vnc_worker_thread, q,
-                       QEMU_THREAD_DETACHED);
-    queue = q; /* Set global queue */
+    vnc_lock_queue(queue);
+    while (queue->nthreads < nthreads) {
+        qemu_thread_create(&thread, "vnc_worker", vnc_worker_thread, queue,
+                           QEMU_THREAD_DETACHED);
+        queue->nthreads++;
+    }
+    vnc_unlock_queue(queue);
 }
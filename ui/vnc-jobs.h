@@ -35,9 +35,11 @@ VncJob *vnc_job_new(VncState *vs);
 int vnc_job_add_rect(VncJob *job, int x, int y, int w, int h);
 void vnc_job_push(VncJob *job);
 void vnc_jobs_join(VncState *vs);
+void vnc_jobs_get_stats(VncState *vs, VncEncodeStats *stats);
 
 void vnc_jobs_consume_buffer(VncState *vs);
-void vnc_start_worker_thread(void);
+/* Make sure at least @nthreads threads encode framebuffer updates */
+void vnc_start_worker_threads(unsigned int nthreads);
 
 /* Locks */
 static inline int vnc_trylock_display(VncDisplay *vd)
@@ -321,7 +321,7 @@ static void vnc_qmp_event(VncState *vs, QAPIEvent event)
     qapi_free_VncServerInfo(si);
 }
 
-static VncClientInfo *qmp_query_vnc_client(const VncState *client)
+static VncClientInfo *qmp_query_vnc_client(VncState *client)
 {
     VncClientInfo *info;
     Error *err = NULL;
@@ -350,6 +350,10 @@ static VncClientInfo *qmp_query_vnc_client(const VncState *client)
     }
 #endif
 
+    info->has_encode_stats = true;
+    info->encode_stats = g_new(VncEncodeStats, 1);
+    vnc_jobs_get_stats(client, info->encode_stats);
+
     return info;
 }
 
@@ -3321,6 +3325,7 @@ static void vnc_connect(VncDisplay *vd, QIOChannelSocket *sioc,
 
     qemu_mutex_init(&vs->output_mutex);
     vs->bh = qemu_bh_new(vnc_jobs_bh, vs);
+    QTAILQ_INIT(&vs->jobs);
 
     QTAILQ_INSERT_TAIL(&vd->clients, vs, next);
     if (first_client) {
@@ -3407,7 +3412,7 @@ void vnc_display_init(const char *id, Error **errp)
     vd->connections_limit = 32;
 
     qemu_mutex_init(&vd->mutex);
-    vnc_start_worker_thread();
+    vnc_start_worker_threads(1);
 
     vd->dcl.ops = &dcl_ops;
     register_displaychangelistener(&vd->dcl);
@@ -3585,6 +3590,9 @@ static QemuOptsList qemu_vnc_opts = {
         },{
             .name = "power-control",
             .type = QEMU_OPT_BOOL,
+        },{
+            .name = "encode-threads",
+            .type = QEMU_OPT_NUMBER,
         },
         { /* end of list */ }
     },
@@ -4023,6 +4031,7 @@ void vnc_display_open(const char *id, Error **errp)
     int key_delay_ms;
     const char *audiodev;
     const char *passwordSecret;
+    uint64_t encode_threads;
 
     if (!vd) {
         error_setg(errp, "VNC display not active");
@@ -4143,6 +4152,14 @@ void vnc_display_open(const char *id, Error **errp)
 
     vd->power_control = qemu_opt_get_bool(opts, "power-control", false);
 
+    encode_threads = qemu_opt_get_number(opts, "encode-threads", 1);
+    if (encode_threads < 1 || encode_threads > VNC_MAX_ENCODE_THREADS) {
+        error_setg(errp, "vnc encode-threads must be between 1 and %d",
+                   VNC_MAX_ENCODE_THREADS);
+        goto fail;
+    }
+    vnc_start_worker_threads(encode_threads);
+
     if (tlsauthz) {
         vd->tlsauthzid = g_strdup(tlsauthz);
     }
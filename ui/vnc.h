@@ -97,6 +97,8 @@ typedef void VncSendHextileTile(VncState *vs,
 
 #define VNC_AUTH_CHALLENGE_SIZE 16
 
+#define VNC_MAX_ENCODE_THREADS 64
+
 typedef struct VncDisplay VncDisplay;
 
 #include "vnc-auth-vencrypt.h"
@@ -337,6 +339,13 @@ struct VncState
     QemuMutex output_mutex;
     QEMUBH *bh;
     Buffer jobs_buffer;
+    VncEncodeStats encode_stats; /* protected by output_mutex */
+
+    /* Encoding jobs, protected by the job queue lock */
+    QTAILQ_HEAD(, VncJob) jobs;
+    QTAILQ_ENTRY(VncState) job_next;
+    bool job_ready; /* Waiting for a worker */
+    bool job_running; /* A worker is encoding one of its jobs */
 
     /* Encoding specific, if you add something here, don't forget to
      *  update vnc_async_encoding_start()